@@ -114,7 +114,9 @@ extern int amdgpu_vis_vram_limit;
 extern int amdgpu_gart_size;
 extern int amdgpu_gtt_size;
 extern int amdgpu_moverate;
+extern int amdgpu_vram_evict_policy;
 extern int amdgpu_benchmarking;
+extern int amdgpu_benchmarking_mock;
 extern int amdgpu_testing;
 extern int amdgpu_audio;
 extern int amdgpu_disp_priority;
@@ -166,6 +168,9 @@ extern int amdgpu_mcbp;
 extern int amdgpu_discovery;
 extern int amdgpu_mes;
 extern int amdgpu_noretry;
+extern uint amdgpu_sa_lane_size;
+extern uint amdgpu_ih_soft_size;
+extern int amdgpu_vmid_affinity;
 
 #ifdef CONFIG_DRM_AMDGPU_SI
 extern int amdgpu_si_support;
@@ -349,6 +354,38 @@ struct amdgpu_clock {
 
 #define AMDGPU_SA_NUM_FENCE_LISTS	32
 
+/* Optional per ring lanes in front of the shared manager.
+ *
+ * Each lane is a plain ring buffer. Allocation bumps head with a single
+ * cmpxchg on (sequence << 32 | byte position), freeing only publishes the
+ * fence and the lane tail is advanced in allocation order by whoever runs
+ * out of space first.
+ *
+ * IB space is handed out when the job is created, but the scheduler is free
+ * to run jobs from different entities on the same ring in another order, so
+ * fences in a lane don't necessarily signal in allocation order. Space is
+ * only reclaimed contiguously from the tail, which means a single unsignaled
+ * allocation holds back everything allocated after it. Allocations then
+ * simply fall back to the shared manager; the "blocked" counter tells how
+ * often that happens and the lane size has a floor to keep it rare.
+ */
+#define AMDGPU_SA_LANE_ENTRIES		256
+
+struct amdgpu_sa_lane {
+	spinlock_t		lock;
+	atomic64_t		head;
+	atomic64_t		tail;
+	unsigned		offset;
+	struct amdgpu_sa_bo	*entries[AMDGPU_SA_LANE_ENTRIES];
+
+	/* statistics */
+	atomic64_t		allocs;
+	atomic64_t		retries;
+	atomic64_t		reclaims;
+	atomic64_t		blocked;
+	atomic64_t		full;
+};
+
 struct amdgpu_sa_manager {
 	wait_queue_head_t	wq;
 	struct amdgpu_bo	*bo;
@@ -360,6 +397,21 @@ struct amdgpu_sa_manager {
 	void			*cpu_ptr;
 	uint32_t		domain;
 	uint32_t		align;
+
+	/* per ring lanes, NULL if disabled */
+	struct amdgpu_sa_lane	*lanes;
+	unsigned		num_lanes;
+	unsigned		lane_size;
+	struct amdgpu_bo	*lane_bo;
+	uint64_t		lane_gpu_addr;
+	void			*lane_cpu_ptr;
+
+	/* statistics of the shared path */
+	atomic64_t		allocs;
+	atomic64_t		contended;
+	atomic64_t		lock_wait_ns;
+	atomic64_t		waits;
+	atomic64_t		wait_ns;
 };
 
 /* sub-allocation buffer */
@@ -367,8 +419,11 @@ struct amdgpu_sa_bo {
 	struct list_head		olist;
 	struct list_head		flist;
 	struct amdgpu_sa_manager	*manager;
+	struct amdgpu_sa_lane		*lane;
 	unsigned			soffset;
 	unsigned			eoffset;
+	uint32_t			lane_end;
+	bool				lane_freed;
 	struct dma_fence	        *fence;
 };
 
@@ -428,6 +483,9 @@ int amdgpu_device_get_job_timeout_settings(struct amdgpu_device *adev);
 
 int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		  unsigned size, struct amdgpu_ib *ib);
+int amdgpu_ib_get_ring(struct amdgpu_device *adev, struct amdgpu_vm *vm,
+		       struct amdgpu_ring *ring, unsigned size,
+		       struct amdgpu_ib *ib);
 void amdgpu_ib_free(struct amdgpu_device *adev, struct amdgpu_ib *ib,
 		    struct dma_fence *f);
 int amdgpu_ib_schedule(struct amdgpu_ring *ring, unsigned num_ibs,
@@ -518,6 +576,8 @@ void amdgpu_device_wb_free(struct amdgpu_device *adev, u32 wb);
  * Benchmarking
  */
 void amdgpu_benchmark(struct amdgpu_device *adev, int test_number);
+void amdgpu_benchmark_cpu(struct amdgpu_device *adev, struct drm_printer *p);
+void amdgpu_benchmark_mock(void);
 
 
 /*
@@ -768,6 +828,7 @@ struct amdgpu_device {
 	unsigned			debugfs_count;
 #if defined(CONFIG_DEBUG_FS)
 	struct dentry                   *debugfs_preempt;
+	struct dentry                   *debugfs_sched_hist_reset;
 	struct dentry			*debugfs_regs[AMDGPU_DEBUGFS_MAX_COMPONENTS];
 #endif
 	struct amdgpu_atif		*atif;
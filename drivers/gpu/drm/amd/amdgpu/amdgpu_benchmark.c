@@ -22,11 +22,17 @@
  * Authors: Jerome Glisse
  */
 
+#include <linux/dma-fence-chain.h>
+#include <linux/kthread.h>
+#include <linux/sort.h>
+
 #include <drm/amdgpu_drm.h>
+#include <drm/drm_print.h>
 #include "amdgpu.h"
 
 #define AMDGPU_BENCHMARK_ITERATIONS 1024
 #define AMDGPU_BENCHMARK_COMMON_MODES_N 17
+#define AMDGPU_BENCHMARK_CPU_RUNS 256
 
 static int amdgpu_benchmark_do_move(struct amdgpu_device *adev, unsigned size,
 				    uint64_t saddr, uint64_t daddr, int n)
@@ -159,6 +165,1389 @@ out_cleanup:
 	}
 }
 
+/*
+ * CPU side benchmarks
+ *
+ * Each case times AMDGPU_BENCHMARK_CPU_RUNS runs of @ops operations on
+ * a CPU-only path of the driver. None of them touch the hardware, so they
+ * also work on a mock device without an AMD GPU.
+ */
+struct amdgpu_benchmark_ctx {
+	struct amdgpu_device	*adev;
+	void			*priv;
+};
+
+struct amdgpu_benchmark_case {
+	const char	*name;
+	unsigned	ops;
+	int (*init)(struct amdgpu_benchmark_ctx *ctx);
+	void (*run)(struct amdgpu_benchmark_ctx *ctx);
+	/* optional, appends case specific JSON fields after the timings */
+	void (*report)(struct amdgpu_benchmark_ctx *ctx,
+		       struct drm_printer *p);
+	void (*fini)(struct amdgpu_benchmark_ctx *ctx);
+};
+
+static int amdgpu_benchmark_cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* sync object dedup */
+#define AMDGPU_BENCHMARK_SYNC_FENCES	256
+#define AMDGPU_BENCHMARK_SYNC_CONTEXTS	8
+
+static DEFINE_SPINLOCK(amdgpu_benchmark_fence_lock);
+
+static const char *amdgpu_benchmark_fence_get_name(struct dma_fence *f)
+{
+	return "amdgpu_benchmark";
+}
+
+static const struct dma_fence_ops amdgpu_benchmark_fence_ops = {
+	.get_driver_name = amdgpu_benchmark_fence_get_name,
+	.get_timeline_name = amdgpu_benchmark_fence_get_name,
+};
+
+static void amdgpu_benchmark_sync_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct dma_fence **fences = ctx->priv;
+	unsigned i;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_SYNC_FENCES && fences[i]; ++i) {
+		dma_fence_signal(fences[i]);
+		dma_fence_put(fences[i]);
+	}
+	kfree(fences);
+}
+
+static int amdgpu_benchmark_sync_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct dma_fence **fences;
+	u64 context;
+	unsigned i;
+
+	fences = kcalloc(AMDGPU_BENCHMARK_SYNC_FENCES, sizeof(*fences),
+			 GFP_KERNEL);
+	if (!fences)
+		return -ENOMEM;
+	ctx->priv = fences;
+
+	context = dma_fence_context_alloc(AMDGPU_BENCHMARK_SYNC_CONTEXTS);
+	for (i = 0; i < AMDGPU_BENCHMARK_SYNC_FENCES; ++i) {
+		fences[i] = kzalloc(sizeof(*fences[i]), GFP_KERNEL);
+		if (!fences[i]) {
+			amdgpu_benchmark_sync_fini(ctx);
+			return -ENOMEM;
+		}
+		dma_fence_init(fences[i], &amdgpu_benchmark_fence_ops,
+			       &amdgpu_benchmark_fence_lock,
+			       context + i % AMDGPU_BENCHMARK_SYNC_CONTEXTS,
+			       i / AMDGPU_BENCHMARK_SYNC_CONTEXTS + 1);
+	}
+	return 0;
+}
+
+static void amdgpu_benchmark_sync_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct dma_fence **fences = ctx->priv;
+	struct amdgpu_sync sync;
+	unsigned i;
+
+	amdgpu_sync_create(&sync);
+	for (i = 0; i < AMDGPU_BENCHMARK_SYNC_FENCES; ++i)
+		amdgpu_sync_fence(ctx->adev, &sync, fences[i], false);
+	amdgpu_sync_free(&sync);
+}
+
+/* timeline point lookup */
+#define AMDGPU_BENCHMARK_CHAIN_LOOKUPS	64
+
+struct amdgpu_benchmark_chain {
+	struct dma_fence	**nodes;
+	unsigned		length;
+	unsigned		mismatches;
+};
+
+static void amdgpu_benchmark_chain_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_chain *bc = ctx->priv;
+	unsigned i;
+
+	/*
+	 * Newest node first, every node is still referenced by the array when
+	 * its successor drops it, so releasing the chain doesn't recurse.
+	 */
+	for (i = bc->length; i--;)
+		dma_fence_put(bc->nodes[i]);
+	kvfree(bc->nodes);
+	kfree(bc);
+}
+
+static int amdgpu_benchmark_chain_init(struct amdgpu_benchmark_ctx *ctx,
+				       unsigned length)
+{
+	struct amdgpu_benchmark_chain *bc;
+	struct dma_fence *prev = NULL;
+	u64 context;
+
+	bc = kzalloc(sizeof(*bc), GFP_KERNEL);
+	if (!bc)
+		return -ENOMEM;
+
+	bc->nodes = kvzalloc(length * sizeof(*bc->nodes), GFP_KERNEL);
+	if (!bc->nodes) {
+		kfree(bc);
+		return -ENOMEM;
+	}
+	ctx->priv = bc;
+
+	/* all points stay pending, like a timeline the GPU is behind on */
+	context = dma_fence_context_alloc(1);
+	for (; bc->length < length; ++bc->length) {
+		struct dma_fence_chain *chain;
+		struct dma_fence *fence;
+
+		fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+		chain = kzalloc(sizeof(*chain), GFP_KERNEL);
+		if (!fence || !chain) {
+			kfree(chain);
+			kfree(fence);
+			amdgpu_benchmark_chain_fini(ctx);
+			return -ENOMEM;
+		}
+
+		dma_fence_init(fence, &amdgpu_benchmark_fence_ops,
+			       &amdgpu_benchmark_fence_lock, context,
+			       bc->length + 1);
+		dma_fence_chain_init(chain, dma_fence_get(prev), fence,
+				     bc->length + 1);
+		prev = &chain->base;
+		bc->nodes[bc->length] = prev;
+	}
+	return 0;
+}
+
+static int amdgpu_benchmark_chain_init_16(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_chain_init(ctx, 16);
+}
+
+static int amdgpu_benchmark_chain_init_256(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_chain_init(ctx, 256);
+}
+
+static int amdgpu_benchmark_chain_init_4096(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_chain_init(ctx, 4096);
+}
+
+static void amdgpu_benchmark_chain_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_chain *bc = ctx->priv;
+	struct dma_fence *head = bc->nodes[bc->length - 1];
+	unsigned i;
+
+	/* points spread evenly from the oldest to the newest */
+	for (i = 0; i < AMDGPU_BENCHMARK_CHAIN_LOOKUPS; ++i) {
+		u64 seqno = 1 + (u64)i * bc->length /
+			AMDGPU_BENCHMARK_CHAIN_LOOKUPS;
+		struct dma_fence *fence = dma_fence_get(head);
+
+		if (dma_fence_chain_find_seqno(&fence, seqno) ||
+		    !fence || fence->seqno != seqno)
+			bc->mismatches++;
+		dma_fence_put(fence);
+	}
+}
+
+static void amdgpu_benchmark_chain_report(struct amdgpu_benchmark_ctx *ctx,
+					  struct drm_printer *p)
+{
+	struct amdgpu_benchmark_chain *bc = ctx->priv;
+
+	drm_printf(p, ", \"chain_length\": %u, \"mismatches\": %u",
+		   bc->length, bc->mismatches);
+}
+
+/* SA allocation */
+#define AMDGPU_BENCHMARK_SA_SIZE	(1024 * 1024)
+#define AMDGPU_BENCHMARK_SA_ALLOCS	64
+
+struct amdgpu_benchmark_sa {
+	struct amdgpu_sa_manager	manager;
+	struct amdgpu_sa_bo		*bos[AMDGPU_BENCHMARK_SA_ALLOCS];
+	void				*cpu_ptr;
+};
+
+static int amdgpu_benchmark_sa_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sa *sa;
+
+	sa = kzalloc(sizeof(*sa), GFP_KERNEL);
+	if (!sa)
+		return -ENOMEM;
+
+	sa->cpu_ptr = kvzalloc(AMDGPU_BENCHMARK_SA_SIZE, GFP_KERNEL);
+	if (!sa->cpu_ptr) {
+		kfree(sa);
+		return -ENOMEM;
+	}
+
+	amdgpu_sa_bo_manager_init_cpu(&sa->manager, sa->cpu_ptr,
+				      AMDGPU_BENCHMARK_SA_SIZE,
+				      AMDGPU_GPU_PAGE_SIZE);
+	ctx->priv = sa;
+	return 0;
+}
+
+static void amdgpu_benchmark_sa_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sa *sa = ctx->priv;
+	unsigned i;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_SA_ALLOCS; ++i)
+		if (amdgpu_sa_bo_new(&sa->manager, &sa->bos[i], 256, 256))
+			sa->bos[i] = NULL;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_SA_ALLOCS; ++i)
+		amdgpu_sa_bo_free(ctx->adev, &sa->bos[i], NULL);
+}
+
+static void amdgpu_benchmark_sa_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sa *sa = ctx->priv;
+
+	kvfree(sa->cpu_ptr);
+	kfree(sa);
+}
+
+/* VM page table updates with the CPU */
+#define AMDGPU_BENCHMARK_VM_PTES	512
+
+struct amdgpu_benchmark_vm {
+	struct amdgpu_vm_update_params	params;
+	struct amdgpu_bo		bo;
+	uint64_t			ptes[AMDGPU_BENCHMARK_VM_PTES];
+};
+
+static int amdgpu_benchmark_vm_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_vm *vm;
+
+	vm = kzalloc(sizeof(*vm), GFP_KERNEL);
+	if (!vm)
+		return -ENOMEM;
+
+	/* a fake kmapped page table, amdgpu_vm_cpu_update only needs kptr */
+	vm->bo.kmap.virtual = vm->ptes;
+	vm->bo.kmap.bo_kmap_type = ttm_bo_map_kmap;
+	vm->params.adev = ctx->adev;
+	ctx->priv = vm;
+	return 0;
+}
+
+static void amdgpu_benchmark_vm_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_vm *vm = ctx->priv;
+
+	amdgpu_vm_cpu_funcs.update(&vm->params, &vm->bo, 0, 0x100000,
+				   AMDGPU_BENCHMARK_VM_PTES,
+				   AMDGPU_GPU_PAGE_SIZE,
+				   AMDGPU_PTE_VALID | AMDGPU_PTE_READABLE);
+}
+
+static void amdgpu_benchmark_vm_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	kfree(ctx->priv);
+}
+
+/* execbuf reservation of overlapping BO lists from several threads */
+#define AMDGPU_BENCHMARK_EU_THREADS	4
+#define AMDGPU_BENCHMARK_EU_BOS		64
+#define AMDGPU_BENCHMARK_EU_LOOPS	16
+
+struct amdgpu_benchmark_eu;
+
+struct amdgpu_benchmark_eu_worker {
+	struct amdgpu_benchmark_eu	*eu;
+	struct list_head		list;
+	struct ttm_validate_buffer	tv[AMDGPU_BENCHMARK_EU_BOS];
+};
+
+struct amdgpu_benchmark_eu {
+	struct ttm_buffer_object	bos[AMDGPU_BENCHMARK_EU_BOS];
+	struct amdgpu_benchmark_eu_worker workers[AMDGPU_BENCHMARK_EU_THREADS];
+	atomic_t			running;
+	atomic_t			error;
+	struct completion		done;
+	bool				old_sorted;
+	u64				backoffs;
+	u64				contended;
+	u64				backoff_ns;
+};
+
+static int amdgpu_benchmark_eu_thread(void *data)
+{
+	struct amdgpu_benchmark_eu_worker *w = data;
+	struct amdgpu_benchmark_eu *eu = w->eu;
+	struct ttm_validate_buffer *tv;
+	struct ww_acquire_ctx ticket;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_EU_LOOPS; ++i) {
+		/*
+		 * The BOs have no device, so skip the LRU handling and
+		 * unlock by hand instead of ttm_eu_backoff_reservation().
+		 */
+		r = ttm_eu_reserve_buffers(&ticket, &w->list, false, NULL,
+					   false);
+		if (r) {
+			atomic_cmpxchg(&eu->error, 0, r);
+			break;
+		}
+		list_for_each_entry(tv, &w->list, head)
+			reservation_object_unlock(tv->bo->resv);
+		ww_acquire_fini(&ticket);
+	}
+
+	if (atomic_dec_and_test(&eu->running))
+		complete(&eu->done);
+	return 0;
+}
+
+static int amdgpu_benchmark_eu_init(struct amdgpu_benchmark_ctx *ctx,
+				    bool sorted)
+{
+	struct ttm_bo_global *glob = &ttm_bo_glob;
+	struct amdgpu_benchmark_eu *eu;
+	unsigned t, i;
+
+	eu = kvzalloc(sizeof(*eu), GFP_KERNEL);
+	if (!eu)
+		return -ENOMEM;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_EU_BOS; ++i) {
+		reservation_object_init(&eu->bos[i].ttm_resv);
+		eu->bos[i].resv = &eu->bos[i].ttm_resv;
+	}
+
+	/*
+	 * Every thread locks all BOs, starting at a different offset and
+	 * every other thread walking backwards, so that the lists disagree
+	 * about the order as much as possible.
+	 */
+	for (t = 0; t < AMDGPU_BENCHMARK_EU_THREADS; ++t) {
+		struct amdgpu_benchmark_eu_worker *w = &eu->workers[t];
+		unsigned first = t * AMDGPU_BENCHMARK_EU_BOS /
+			AMDGPU_BENCHMARK_EU_THREADS;
+
+		w->eu = eu;
+		INIT_LIST_HEAD(&w->list);
+		for (i = 0; i < AMDGPU_BENCHMARK_EU_BOS; ++i) {
+			unsigned idx = (t & 1) ? first - i : first + i;
+
+			idx %= AMDGPU_BENCHMARK_EU_BOS;
+			w->tv[i].bo = &eu->bos[idx];
+			list_add_tail(&w->tv[i].head, &w->list);
+		}
+	}
+
+	init_completion(&eu->done);
+	eu->old_sorted = READ_ONCE(glob->eu_sorted);
+	WRITE_ONCE(glob->eu_sorted, sorted);
+	eu->backoffs = atomic64_read(&glob->eu_backoffs);
+	eu->contended = atomic64_read(&glob->eu_contended);
+	eu->backoff_ns = atomic64_read(&glob->eu_backoff_ns);
+	ctx->priv = eu;
+	return 0;
+}
+
+static int amdgpu_benchmark_eu_init_caller(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_eu_init(ctx, false);
+}
+
+static int amdgpu_benchmark_eu_init_sorted(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_eu_init(ctx, true);
+}
+
+static void amdgpu_benchmark_eu_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_eu *eu = ctx->priv;
+	unsigned t;
+
+	reinit_completion(&eu->done);
+	atomic_set(&eu->running, AMDGPU_BENCHMARK_EU_THREADS);
+	for (t = 0; t < AMDGPU_BENCHMARK_EU_THREADS; ++t) {
+		struct task_struct *task;
+
+		task = kthread_run(amdgpu_benchmark_eu_thread, &eu->workers[t],
+				   "amdgpu_bench_eu");
+		if (IS_ERR(task))
+			amdgpu_benchmark_eu_thread(&eu->workers[t]);
+	}
+	wait_for_completion(&eu->done);
+}
+
+static void amdgpu_benchmark_eu_report(struct amdgpu_benchmark_ctx *ctx,
+				       struct drm_printer *p)
+{
+	struct ttm_bo_global *glob = &ttm_bo_glob;
+	struct amdgpu_benchmark_eu *eu = ctx->priv;
+
+	drm_printf(p, ", \"threads\": %u, \"error\": %d, \"backoffs\": %llu, "
+		   "\"contended\": %llu, \"backoff_ns\": %llu",
+		   AMDGPU_BENCHMARK_EU_THREADS, atomic_read(&eu->error),
+		   atomic64_read(&glob->eu_backoffs) - eu->backoffs,
+		   atomic64_read(&glob->eu_contended) - eu->contended,
+		   atomic64_read(&glob->eu_backoff_ns) - eu->backoff_ns);
+}
+
+static void amdgpu_benchmark_eu_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_eu *eu = ctx->priv;
+	unsigned i;
+
+	WRITE_ONCE(ttm_bo_glob.eu_sorted, eu->old_sorted);
+	for (i = 0; i < AMDGPU_BENCHMARK_EU_BOS; ++i)
+		reservation_object_fini(&eu->bos[i].ttm_resv);
+	kvfree(eu);
+}
+
+/* TTM zone accounting of single pages from several threads */
+#define AMDGPU_BENCHMARK_MEM_THREADS	4
+#define AMDGPU_BENCHMARK_MEM_LOOPS	1024
+
+struct amdgpu_benchmark_mem {
+	atomic_t		running;
+	atomic_t		error;
+	struct completion	done;
+};
+
+static int amdgpu_benchmark_mem_thread(void *data)
+{
+	struct amdgpu_benchmark_mem *bm = data;
+	struct ttm_operation_ctx ctx = { false, true };
+	unsigned i;
+	int r;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_MEM_LOOPS; ++i) {
+		r = ttm_mem_global_alloc(&ttm_mem_glob, PAGE_SIZE, &ctx);
+		if (r) {
+			atomic_cmpxchg(&bm->error, 0, r);
+			break;
+		}
+		ttm_mem_global_free(&ttm_mem_glob, PAGE_SIZE);
+	}
+
+	if (atomic_dec_and_test(&bm->running))
+		complete(&bm->done);
+	return 0;
+}
+
+static int amdgpu_benchmark_mem_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_mem *bm;
+
+	/* the accounting is only set up once a TTM device exists */
+	if (!ttm_mem_glob.num_zones)
+		return -ENODEV;
+
+	bm = kzalloc(sizeof(*bm), GFP_KERNEL);
+	if (!bm)
+		return -ENOMEM;
+
+	init_completion(&bm->done);
+	ctx->priv = bm;
+	return 0;
+}
+
+static void amdgpu_benchmark_mem_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_mem *bm = ctx->priv;
+	unsigned t;
+
+	reinit_completion(&bm->done);
+	atomic_set(&bm->running, AMDGPU_BENCHMARK_MEM_THREADS);
+	for (t = 0; t < AMDGPU_BENCHMARK_MEM_THREADS; ++t) {
+		struct task_struct *task;
+
+		task = kthread_run(amdgpu_benchmark_mem_thread, bm,
+				   "amdgpu_bench_mem");
+		if (IS_ERR(task))
+			amdgpu_benchmark_mem_thread(bm);
+	}
+	wait_for_completion(&bm->done);
+}
+
+static void amdgpu_benchmark_mem_report(struct amdgpu_benchmark_ctx *ctx,
+					struct drm_printer *p)
+{
+	struct amdgpu_benchmark_mem *bm = ctx->priv;
+
+	drm_printf(p, ", \"threads\": %u, \"error\": %d",
+		   AMDGPU_BENCHMARK_MEM_THREADS, atomic_read(&bm->error));
+}
+
+static void amdgpu_benchmark_mem_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	kfree(ctx->priv);
+}
+
+/* shared fences from several threads on one heavily shared BO */
+#define AMDGPU_BENCHMARK_RESV_THREADS	4
+#define AMDGPU_BENCHMARK_RESV_CONTEXTS	16
+#define AMDGPU_BENCHMARK_RESV_LOOPS	16
+
+struct amdgpu_benchmark_resv;
+
+struct amdgpu_benchmark_resv_worker {
+	struct amdgpu_benchmark_resv	*br;
+	spinlock_t			lock;
+	u64				context;
+	unsigned			seqno;
+	struct dma_fence	*fences[AMDGPU_BENCHMARK_RESV_CONTEXTS];
+};
+
+struct amdgpu_benchmark_resv {
+	struct reservation_object	resv;
+	struct amdgpu_benchmark_resv_worker
+				workers[AMDGPU_BENCHMARK_RESV_THREADS];
+	atomic_t			running;
+	atomic_t			error;
+	struct completion		done;
+};
+
+static int amdgpu_benchmark_resv_add(struct amdgpu_benchmark_resv_worker *w,
+				     struct dma_fence **slot, u64 context)
+{
+	struct reservation_object *resv = &w->br->resv;
+	struct dma_fence *fence;
+	int r;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence)
+		return -ENOMEM;
+	dma_fence_init(fence, &amdgpu_benchmark_fence_ops, &w->lock, context,
+		       ++w->seqno);
+
+	reservation_object_lock(resv, NULL);
+	r = reservation_object_reserve_shared(resv, 1);
+	if (!r)
+		reservation_object_add_shared_fence(resv, fence);
+	reservation_object_unlock(resv);
+
+	/* the previous fence of the context completes, like a ring would */
+	if (*slot) {
+		dma_fence_signal(*slot);
+		dma_fence_put(*slot);
+	}
+	*slot = fence;
+	return r;
+}
+
+static int amdgpu_benchmark_resv_thread(void *data)
+{
+	struct amdgpu_benchmark_resv_worker *w = data;
+	struct amdgpu_benchmark_resv *br = w->br;
+	struct dma_fence *once;
+	unsigned i, c;
+	u64 context;
+	int r = 0;
+
+	for (i = 0; i < AMDGPU_BENCHMARK_RESV_LOOPS && !r; ++i) {
+		for (c = 0; c < AMDGPU_BENCHMARK_RESV_CONTEXTS && !r; ++c)
+			r = amdgpu_benchmark_resv_add(w, &w->fences[c],
+						      w->context + c);
+
+		/*
+		 * A short lived context which is never used again leaves a
+		 * signaled fence behind for the compaction to collect.
+		 */
+		once = NULL;
+		context = dma_fence_context_alloc(1);
+		if (!r)
+			r = amdgpu_benchmark_resv_add(w, &once, context);
+		if (once) {
+			dma_fence_signal(once);
+			dma_fence_put(once);
+		}
+	}
+	if (r)
+		atomic_cmpxchg(&br->error, 0, r);
+
+	if (atomic_dec_and_test(&br->running))
+		complete(&br->done);
+	return 0;
+}
+
+static void amdgpu_benchmark_resv_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_resv *br = ctx->priv;
+	unsigned t, c;
+
+	for (t = 0; t < AMDGPU_BENCHMARK_RESV_THREADS; ++t) {
+		struct amdgpu_benchmark_resv_worker *w = &br->workers[t];
+
+		for (c = 0; c < AMDGPU_BENCHMARK_RESV_CONTEXTS; ++c) {
+			if (!w->fences[c])
+				continue;
+			dma_fence_signal(w->fences[c]);
+			dma_fence_put(w->fences[c]);
+		}
+	}
+	reservation_object_fini(&br->resv);
+	kfree(br);
+}
+
+static int amdgpu_benchmark_resv_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_resv *br;
+	unsigned t;
+
+	br = kzalloc(sizeof(*br), GFP_KERNEL);
+	if (!br)
+		return -ENOMEM;
+
+	reservation_object_init(&br->resv);
+	for (t = 0; t < AMDGPU_BENCHMARK_RESV_THREADS; ++t) {
+		struct amdgpu_benchmark_resv_worker *w = &br->workers[t];
+
+		w->br = br;
+		spin_lock_init(&w->lock);
+		w->context =
+			dma_fence_context_alloc(AMDGPU_BENCHMARK_RESV_CONTEXTS);
+	}
+	init_completion(&br->done);
+	ctx->priv = br;
+	return 0;
+}
+
+static void amdgpu_benchmark_resv_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_resv *br = ctx->priv;
+	unsigned t;
+
+	reinit_completion(&br->done);
+	atomic_set(&br->running, AMDGPU_BENCHMARK_RESV_THREADS);
+	for (t = 0; t < AMDGPU_BENCHMARK_RESV_THREADS; ++t) {
+		struct task_struct *task;
+
+		task = kthread_run(amdgpu_benchmark_resv_thread,
+				   &br->workers[t], "amdgpu_bench_resv");
+		if (IS_ERR(task))
+			amdgpu_benchmark_resv_thread(&br->workers[t]);
+	}
+	wait_for_completion(&br->done);
+}
+
+static void amdgpu_benchmark_resv_report(struct amdgpu_benchmark_ctx *ctx,
+					 struct drm_printer *p)
+{
+	struct amdgpu_benchmark_resv *br = ctx->priv;
+	struct reservation_object_list *list;
+	u32 count = 0, max = 0;
+
+	reservation_object_lock(&br->resv, NULL);
+	list = reservation_object_get_list(&br->resv);
+	if (list) {
+		count = list->shared_count;
+		max = list->shared_max;
+	}
+	reservation_object_unlock(&br->resv);
+
+	drm_printf(p, ", \"threads\": %u, \"contexts\": %u, \"error\": %d, "
+		   "\"shared_count\": %u, \"shared_max\": %u",
+		   AMDGPU_BENCHMARK_RESV_THREADS,
+		   AMDGPU_BENCHMARK_RESV_THREADS *
+		   AMDGPU_BENCHMARK_RESV_CONTEXTS,
+		   atomic_read(&br->error), count, max);
+}
+
+/*
+ * Scheduler fairness, a mock ring which busy waits for the duration of a
+ * job. Half of the entities submit short and half long jobs, a thousand
+ * more have been used once and stay idle on the run queue.
+ */
+#define AMDGPU_BENCHMARK_SCHED_ENTITIES	8
+#define AMDGPU_BENCHMARK_SCHED_IDLE	1024
+#define AMDGPU_BENCHMARK_SCHED_JOBS	16
+#define AMDGPU_BENCHMARK_SCHED_SHORT_NS	5000
+#define AMDGPU_BENCHMARK_SCHED_LONG_NS	50000
+
+struct amdgpu_benchmark_sched;
+
+struct amdgpu_benchmark_sched_job {
+	struct drm_sched_job		base;
+	struct amdgpu_benchmark_sched	*bs;
+	unsigned			entity;
+	unsigned			seq;
+	u64				duration_ns;
+	/* optional, returned as hardware fence to hold the job on the ring */
+	struct dma_fence		*hw;
+};
+
+struct amdgpu_benchmark_sched {
+	struct drm_gpu_scheduler	sched;
+	struct drm_sched_entity		*entities;
+	unsigned			num_entities;
+	atomic_t			pending;
+	struct completion		done;
+	struct completion		started;
+
+	/* filled in by free_job for the current run */
+	ktime_t		finish[AMDGPU_BENCHMARK_SCHED_ENTITIES]
+			      [AMDGPU_BENCHMARK_SCHED_JOBS];
+	u64		exec_ns[AMDGPU_BENCHMARK_SCHED_ENTITIES]
+			       [AMDGPU_BENCHMARK_SCHED_JOBS];
+	u64		latency_ns[AMDGPU_BENCHMARK_SCHED_ENTITIES]
+				  [AMDGPU_BENCHMARK_SCHED_JOBS];
+
+	/* accumulated over all runs */
+	unsigned	runs;
+	u64		fairness;
+	u64		entity_latency_ns[AMDGPU_BENCHMARK_SCHED_ENTITIES];
+	u64		*latencies;
+
+	/* entity charging checks */
+	unsigned	checks;
+	unsigned	failures;
+};
+
+static void amdgpu_benchmark_sched_spin(u64 ns)
+{
+	ktime_t end = ktime_add_ns(ktime_get(), ns);
+
+	while (ktime_before(ktime_get(), end))
+		cpu_relax();
+}
+
+static struct dma_fence *
+amdgpu_benchmark_sched_run_job(struct drm_sched_job *sched_job)
+{
+	struct amdgpu_benchmark_sched_job *job =
+		container_of(sched_job, struct amdgpu_benchmark_sched_job, base);
+
+	if (job->hw) {
+		complete(&job->bs->started);
+		return dma_fence_get(job->hw);
+	}
+
+	amdgpu_benchmark_sched_spin(job->duration_ns);
+
+	/* no hardware fence, the job counts as finished right away */
+	return NULL;
+}
+
+static void amdgpu_benchmark_sched_timedout_job(struct drm_sched_job *sched_job)
+{
+}
+
+static void amdgpu_benchmark_sched_free_job(struct drm_sched_job *sched_job)
+{
+	struct amdgpu_benchmark_sched_job *job =
+		container_of(sched_job, struct amdgpu_benchmark_sched_job, base);
+	struct amdgpu_benchmark_sched *bs = job->bs;
+	ktime_t finish = sched_job->s_fence->finished.timestamp;
+
+	if (job->entity < AMDGPU_BENCHMARK_SCHED_ENTITIES) {
+		bs->finish[job->entity][job->seq] = finish;
+		bs->exec_ns[job->entity][job->seq] = sched_job->exec_ns;
+		bs->latency_ns[job->entity][job->seq] =
+			ktime_to_ns(ktime_sub(finish, sched_job->push_time));
+	}
+
+	drm_sched_job_cleanup(sched_job);
+	kfree(job);
+	if (atomic_dec_and_test(&bs->pending))
+		complete(&bs->done);
+}
+
+static const struct drm_sched_backend_ops amdgpu_benchmark_sched_ops = {
+	.run_job = amdgpu_benchmark_sched_run_job,
+	.timedout_job = amdgpu_benchmark_sched_timedout_job,
+	.free_job = amdgpu_benchmark_sched_free_job,
+};
+
+static int amdgpu_benchmark_sched_push(struct amdgpu_benchmark_sched *bs,
+				       unsigned entity, unsigned seq,
+				       u64 duration_ns, struct dma_fence *hw)
+{
+	struct amdgpu_benchmark_sched_job *job;
+	int r;
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+
+	job->bs = bs;
+	job->entity = entity;
+	job->seq = seq;
+	job->duration_ns = duration_ns;
+	job->hw = hw;
+	r = drm_sched_job_init(&job->base, &bs->entities[entity], bs);
+	if (r) {
+		kfree(job);
+		return r;
+	}
+
+	atomic_inc(&bs->pending);
+	drm_sched_entity_push_job(&job->base, &bs->entities[entity]);
+	return 0;
+}
+
+/* Push jobs and wait until all of them are freed again */
+static int amdgpu_benchmark_sched_submit(struct amdgpu_benchmark_sched *bs,
+					 unsigned first, unsigned count,
+					 unsigned jobs)
+{
+	unsigned i, e;
+	int r = 0;
+
+	reinit_completion(&bs->done);
+	atomic_set(&bs->pending, 1);
+	for (i = 0; i < jobs && !r; ++i) {
+		for (e = first; e < first + count && !r; ++e) {
+			u64 ns = e >= AMDGPU_BENCHMARK_SCHED_ENTITIES ? 0 :
+				(e & 1) ? AMDGPU_BENCHMARK_SCHED_LONG_NS :
+				AMDGPU_BENCHMARK_SCHED_SHORT_NS;
+
+			r = amdgpu_benchmark_sched_push(bs, e, i, ns, NULL);
+		}
+	}
+
+	if (!atomic_dec_and_test(&bs->pending))
+		wait_for_completion(&bs->done);
+	return r;
+}
+
+static void amdgpu_benchmark_sched_fini(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sched *bs = ctx->priv;
+	unsigned i;
+
+	for (i = 0; i < bs->num_entities; ++i)
+		drm_sched_entity_destroy(&bs->entities[i]);
+	drm_sched_fini(&bs->sched);
+	kvfree(bs->latencies);
+	kvfree(bs->entities);
+	kfree(bs);
+}
+
+static int amdgpu_benchmark_sched_init(struct amdgpu_benchmark_ctx *ctx,
+				       enum drm_sched_policy policy)
+{
+	unsigned n = AMDGPU_BENCHMARK_SCHED_ENTITIES +
+		AMDGPU_BENCHMARK_SCHED_IDLE;
+	struct amdgpu_benchmark_sched *bs;
+	struct drm_sched_rq *rq;
+	int r;
+
+	bs = kzalloc(sizeof(*bs), GFP_KERNEL);
+	if (!bs)
+		return -ENOMEM;
+
+	bs->entities = kvzalloc(n * sizeof(*bs->entities), GFP_KERNEL);
+	bs->latencies = kvzalloc(AMDGPU_BENCHMARK_CPU_RUNS *
+				 AMDGPU_BENCHMARK_SCHED_ENTITIES *
+				 AMDGPU_BENCHMARK_SCHED_JOBS *
+				 sizeof(*bs->latencies), GFP_KERNEL);
+	if (!bs->entities || !bs->latencies) {
+		r = -ENOMEM;
+		goto error_free;
+	}
+
+	r = drm_sched_init(&bs->sched, &amdgpu_benchmark_sched_ops, 2, 0,
+			   MAX_SCHEDULE_TIMEOUT, "amdgpu_bench_sched");
+	if (r)
+		goto error_free;
+	bs->sched.policy = policy;
+	init_completion(&bs->done);
+	init_completion(&bs->started);
+	ctx->priv = bs;
+
+	rq = &bs->sched.sched_rq[DRM_SCHED_PRIORITY_NORMAL];
+	for (; bs->num_entities < n; ++bs->num_entities) {
+		r = drm_sched_entity_init(&bs->entities[bs->num_entities],
+					  &rq, 1, NULL);
+		if (r)
+			goto error_fini;
+	}
+
+	/* one job each puts the idle entities on the run queue for good */
+	r = amdgpu_benchmark_sched_submit(bs, AMDGPU_BENCHMARK_SCHED_ENTITIES,
+					  AMDGPU_BENCHMARK_SCHED_IDLE, 1);
+	if (r)
+		goto error_fini;
+	return 0;
+
+error_fini:
+	amdgpu_benchmark_sched_fini(ctx);
+	return r;
+
+error_free:
+	kvfree(bs->latencies);
+	kvfree(bs->entities);
+	kfree(bs);
+	return r;
+}
+
+static int amdgpu_benchmark_sched_init_rr(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_sched_init(ctx, DRM_SCHED_POLICY_RR);
+}
+
+static int amdgpu_benchmark_sched_init_fair(struct amdgpu_benchmark_ctx *ctx)
+{
+	return amdgpu_benchmark_sched_init(ctx, DRM_SCHED_POLICY_FAIR);
+}
+
+static void amdgpu_benchmark_sched_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sched *bs = ctx->priv;
+	u64 share[AMDGPU_BENCHMARK_SCHED_ENTITIES] = {};
+	u64 sum = 0, sum_sq = 0, *lat;
+	ktime_t cutoff;
+	unsigned e, j;
+
+	if (amdgpu_benchmark_sched_submit(bs, 0,
+					  AMDGPU_BENCHMARK_SCHED_ENTITIES,
+					  AMDGPU_BENCHMARK_SCHED_JOBS))
+		return;
+
+	/*
+	 * Only compare the GPU time the entities got while all of them
+	 * were still busy, i.e. until the first one ran out of jobs.
+	 */
+	cutoff = bs->finish[0][AMDGPU_BENCHMARK_SCHED_JOBS - 1];
+	for (e = 1; e < AMDGPU_BENCHMARK_SCHED_ENTITIES; ++e)
+		cutoff = min(cutoff,
+			     bs->finish[e][AMDGPU_BENCHMARK_SCHED_JOBS - 1]);
+
+	lat = &bs->latencies[bs->runs * AMDGPU_BENCHMARK_SCHED_ENTITIES *
+			     AMDGPU_BENCHMARK_SCHED_JOBS];
+	for (e = 0; e < AMDGPU_BENCHMARK_SCHED_ENTITIES; ++e) {
+		for (j = 0; j < AMDGPU_BENCHMARK_SCHED_JOBS; ++j) {
+			if (!ktime_after(bs->finish[e][j], cutoff))
+				share[e] += bs->exec_ns[e][j];
+			bs->entity_latency_ns[e] += bs->latency_ns[e][j];
+			*lat++ = bs->latency_ns[e][j];
+		}
+		sum += share[e];
+		sum_sq += share[e] * share[e];
+	}
+
+	/* Jain's fairness index in permille, 1000 is a perfectly even share */
+	if (sum_sq)
+		bs->fairness += div64_u64(sum * sum * 1000,
+					  AMDGPU_BENCHMARK_SCHED_ENTITIES *
+					  sum_sq);
+	bs->runs++;
+}
+
+static void amdgpu_benchmark_sched_report(struct amdgpu_benchmark_ctx *ctx,
+					  struct drm_printer *p)
+{
+	struct amdgpu_benchmark_sched *bs = ctx->priv;
+	unsigned n = bs->runs * AMDGPU_BENCHMARK_SCHED_ENTITIES *
+		AMDGPU_BENCHMARK_SCHED_JOBS;
+	u64 emin = U64_MAX, emax = 0;
+	unsigned e;
+
+	if (!bs->runs)
+		return;
+
+	for (e = 0; e < AMDGPU_BENCHMARK_SCHED_ENTITIES; ++e) {
+		emin = min(emin, bs->entity_latency_ns[e]);
+		emax = max(emax, bs->entity_latency_ns[e]);
+	}
+	emin = div64_u64(emin, bs->runs * AMDGPU_BENCHMARK_SCHED_JOBS);
+	emax = div64_u64(emax, bs->runs * AMDGPU_BENCHMARK_SCHED_JOBS);
+
+	sort(bs->latencies, n, sizeof(*bs->latencies),
+	     amdgpu_benchmark_cmp_u64, NULL);
+
+	drm_printf(p, ", \"entities\": %u, \"idle_entities\": %u, "
+		   "\"fairness_permille\": %llu, \"latency_ns\": {\"p50\": %llu, "
+		   "\"p90\": %llu, \"p99\": %llu, \"max\": %llu}, "
+		   "\"entity_mean_latency_ns\": {\"min\": %llu, \"max\": %llu}",
+		   AMDGPU_BENCHMARK_SCHED_ENTITIES, AMDGPU_BENCHMARK_SCHED_IDLE,
+		   div64_u64(bs->fairness, bs->runs),
+		   bs->latencies[n * 50 / 100], bs->latencies[n * 90 / 100],
+		   bs->latencies[n * 99 / 100], bs->latencies[n - 1],
+		   emin, emax);
+}
+
+/*
+ * Scheduler charging, the fair share policy charges the execution time of a
+ * finished job through the entity stats. Hold a job on the mock ring while
+ * its entity is moved to another run queue or torn down, then check who got
+ * charged once the job finishes.
+ */
+static int amdgpu_benchmark_sched_charge_init(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sched *bs;
+	int r;
+
+	bs = kzalloc(sizeof(*bs), GFP_KERNEL);
+	if (!bs)
+		return -ENOMEM;
+
+	/* the entities are created and destroyed by each run */
+	bs->entities = kvzalloc(2 * sizeof(*bs->entities), GFP_KERNEL);
+	if (!bs->entities) {
+		kfree(bs);
+		return -ENOMEM;
+	}
+
+	r = drm_sched_init(&bs->sched, &amdgpu_benchmark_sched_ops, 2, 0,
+			   MAX_SCHEDULE_TIMEOUT, "amdgpu_bench_charge");
+	if (r) {
+		kvfree(bs->entities);
+		kfree(bs);
+		return r;
+	}
+	bs->sched.policy = DRM_SCHED_POLICY_FAIR;
+	init_completion(&bs->done);
+	init_completion(&bs->started);
+	ctx->priv = bs;
+	return 0;
+}
+
+/* Push a job which stays on the ring until it is released again */
+static struct dma_fence *
+amdgpu_benchmark_sched_hold(struct amdgpu_benchmark_sched *bs,
+			    unsigned entity)
+{
+	struct dma_fence *hw;
+
+	hw = kzalloc(sizeof(*hw), GFP_KERNEL);
+	if (!hw)
+		return NULL;
+	dma_fence_init(hw, &amdgpu_benchmark_fence_ops,
+		       &amdgpu_benchmark_fence_lock,
+		       dma_fence_context_alloc(1), 1);
+
+	reinit_completion(&bs->done);
+	reinit_completion(&bs->started);
+	atomic_set(&bs->pending, 1);
+	if (amdgpu_benchmark_sched_push(bs, entity, 0, 0, hw)) {
+		dma_fence_put(hw);
+		return NULL;
+	}
+
+	wait_for_completion(&bs->started);
+	return hw;
+}
+
+/* Signal a held job and wait until it is charged and freed */
+static void amdgpu_benchmark_sched_release(struct amdgpu_benchmark_sched *bs,
+					   struct dma_fence *hw)
+{
+	/* make sure the job has a measurable execution time */
+	amdgpu_benchmark_sched_spin(AMDGPU_BENCHMARK_SCHED_SHORT_NS);
+	dma_fence_signal(hw);
+	dma_fence_put(hw);
+
+	if (!atomic_dec_and_test(&bs->pending))
+		wait_for_completion(&bs->done);
+}
+
+static void amdgpu_benchmark_sched_check(struct amdgpu_benchmark_sched *bs,
+					 bool ok, const char *what)
+{
+	bs->checks++;
+	if (!ok && !bs->failures++)
+		DRM_ERROR("sched_charge: %s\n", what);
+}
+
+static unsigned
+amdgpu_benchmark_sched_exec_count(struct drm_sched_entity_stats *stats)
+{
+	atomic_t *buckets = stats->hist.buckets[DRM_SCHED_HIST_EXEC];
+	unsigned i, count = 0;
+
+	for (i = 0; i < DRM_SCHED_HIST_BUCKETS; ++i)
+		count += atomic_read(&buckets[i]);
+	return count;
+}
+
+static void amdgpu_benchmark_sched_charge_run(struct amdgpu_benchmark_ctx *ctx)
+{
+	struct amdgpu_benchmark_sched *bs = ctx->priv;
+	struct drm_sched_entity *a = &bs->entities[0], *b = &bs->entities[1];
+	struct drm_sched_entity_stats *stats;
+	struct drm_sched_rq *rq;
+	struct dma_fence *hw;
+	u64 va, vb, ns;
+	unsigned count;
+
+	rq = &bs->sched.sched_rq[DRM_SCHED_PRIORITY_NORMAL];
+
+	if (drm_sched_entity_init(a, &rq, 1, NULL))
+		return;
+	if (drm_sched_entity_init(b, &rq, 1, NULL)) {
+		drm_sched_entity_destroy(a);
+		return;
+	}
+
+	/* moved to another run queue, still charged to the same entity */
+	hw = amdgpu_benchmark_sched_hold(bs, 0);
+	if (hw) {
+		drm_sched_entity_set_priority(a, DRM_SCHED_PRIORITY_HIGH_SW);
+		va = a->vruntime;
+		vb = b->vruntime;
+		amdgpu_benchmark_sched_release(bs, hw);
+		ns = bs->exec_ns[0][0];
+		amdgpu_benchmark_sched_check(bs, ns && a->vruntime == va + ns &&
+					     b->vruntime == vb,
+					     "moved entity not charged");
+	}
+
+	/* torn down, only the stats which outlive the entity see the job */
+	stats = drm_sched_entity_stats_get(b->stats);
+	count = amdgpu_benchmark_sched_exec_count(stats);
+	hw = amdgpu_benchmark_sched_hold(bs, 1);
+	drm_sched_entity_destroy(b);
+	if (hw) {
+		vb = b->vruntime;
+		amdgpu_benchmark_sched_release(bs, hw);
+		count = amdgpu_benchmark_sched_exec_count(stats) - count;
+		amdgpu_benchmark_sched_check(bs, b->vruntime == vb &&
+					     count == 1,
+					     "destroyed entity charged");
+	}
+	drm_sched_entity_stats_put(stats);
+
+	drm_sched_entity_destroy(a);
+}
+
+static void
+amdgpu_benchmark_sched_charge_report(struct amdgpu_benchmark_ctx *ctx,
+				     struct drm_printer *p)
+{
+	struct amdgpu_benchmark_sched *bs = ctx->priv;
+
+	drm_printf(p, ", \"checks\": %u, \"failures\": %u",
+		   bs->checks, bs->failures);
+}
+
+static const struct amdgpu_benchmark_case amdgpu_benchmark_cases[] = {
+	{
+		.name = "sync_dedup",
+		.ops = AMDGPU_BENCHMARK_SYNC_FENCES,
+		.init = amdgpu_benchmark_sync_init,
+		.run = amdgpu_benchmark_sync_run,
+		.fini = amdgpu_benchmark_sync_fini,
+	},
+	{
+		.name = "fence_chain_find_16",
+		.ops = AMDGPU_BENCHMARK_CHAIN_LOOKUPS,
+		.init = amdgpu_benchmark_chain_init_16,
+		.run = amdgpu_benchmark_chain_run,
+		.report = amdgpu_benchmark_chain_report,
+		.fini = amdgpu_benchmark_chain_fini,
+	},
+	{
+		.name = "fence_chain_find_256",
+		.ops = AMDGPU_BENCHMARK_CHAIN_LOOKUPS,
+		.init = amdgpu_benchmark_chain_init_256,
+		.run = amdgpu_benchmark_chain_run,
+		.report = amdgpu_benchmark_chain_report,
+		.fini = amdgpu_benchmark_chain_fini,
+	},
+	{
+		.name = "fence_chain_find_4096",
+		.ops = AMDGPU_BENCHMARK_CHAIN_LOOKUPS,
+		.init = amdgpu_benchmark_chain_init_4096,
+		.run = amdgpu_benchmark_chain_run,
+		.report = amdgpu_benchmark_chain_report,
+		.fini = amdgpu_benchmark_chain_fini,
+	},
+	{
+		.name = "sa_alloc",
+		.ops = AMDGPU_BENCHMARK_SA_ALLOCS,
+		.init = amdgpu_benchmark_sa_init,
+		.run = amdgpu_benchmark_sa_run,
+		.fini = amdgpu_benchmark_sa_fini,
+	},
+	{
+		.name = "vm_cpu_update",
+		.ops = AMDGPU_BENCHMARK_VM_PTES,
+		.init = amdgpu_benchmark_vm_init,
+		.run = amdgpu_benchmark_vm_run,
+		.fini = amdgpu_benchmark_vm_fini,
+	},
+	{
+		.name = "eu_reserve",
+		.ops = AMDGPU_BENCHMARK_EU_THREADS * AMDGPU_BENCHMARK_EU_LOOPS,
+		.init = amdgpu_benchmark_eu_init_caller,
+		.run = amdgpu_benchmark_eu_run,
+		.report = amdgpu_benchmark_eu_report,
+		.fini = amdgpu_benchmark_eu_fini,
+	},
+	{
+		.name = "eu_reserve_sorted",
+		.ops = AMDGPU_BENCHMARK_EU_THREADS * AMDGPU_BENCHMARK_EU_LOOPS,
+		.init = amdgpu_benchmark_eu_init_sorted,
+		.run = amdgpu_benchmark_eu_run,
+		.report = amdgpu_benchmark_eu_report,
+		.fini = amdgpu_benchmark_eu_fini,
+	},
+	{
+		.name = "ttm_mem_charge",
+		.ops = AMDGPU_BENCHMARK_MEM_THREADS *
+			AMDGPU_BENCHMARK_MEM_LOOPS,
+		.init = amdgpu_benchmark_mem_init,
+		.run = amdgpu_benchmark_mem_run,
+		.report = amdgpu_benchmark_mem_report,
+		.fini = amdgpu_benchmark_mem_fini,
+	},
+	{
+		.name = "resv_add_shared",
+		.ops = AMDGPU_BENCHMARK_RESV_THREADS *
+			AMDGPU_BENCHMARK_RESV_LOOPS *
+			(AMDGPU_BENCHMARK_RESV_CONTEXTS + 1),
+		.init = amdgpu_benchmark_resv_init,
+		.run = amdgpu_benchmark_resv_run,
+		.report = amdgpu_benchmark_resv_report,
+		.fini = amdgpu_benchmark_resv_fini,
+	},
+	{
+		.name = "sched_rr",
+		.ops = AMDGPU_BENCHMARK_SCHED_ENTITIES *
+			AMDGPU_BENCHMARK_SCHED_JOBS,
+		.init = amdgpu_benchmark_sched_init_rr,
+		.run = amdgpu_benchmark_sched_run,
+		.report = amdgpu_benchmark_sched_report,
+		.fini = amdgpu_benchmark_sched_fini,
+	},
+	{
+		.name = "sched_fair",
+		.ops = AMDGPU_BENCHMARK_SCHED_ENTITIES *
+			AMDGPU_BENCHMARK_SCHED_JOBS,
+		.init = amdgpu_benchmark_sched_init_fair,
+		.run = amdgpu_benchmark_sched_run,
+		.report = amdgpu_benchmark_sched_report,
+		.fini = amdgpu_benchmark_sched_fini,
+	},
+	{
+		.name = "sched_charge",
+		.ops = 2,
+		.init = amdgpu_benchmark_sched_charge_init,
+		.run = amdgpu_benchmark_sched_charge_run,
+		.report = amdgpu_benchmark_sched_charge_report,
+		.fini = amdgpu_benchmark_sched_fini,
+	},
+};
+
+static int amdgpu_benchmark_run_case(struct amdgpu_device *adev,
+				     const struct amdgpu_benchmark_case *bc,
+				     struct drm_printer *p, bool last)
+{
+	struct amdgpu_benchmark_ctx ctx = { .adev = adev };
+	unsigned n = AMDGPU_BENCHMARK_CPU_RUNS;
+	u64 *samples, total = 0;
+	unsigned i;
+	int r;
+
+	samples = kcalloc(n, sizeof(*samples), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	r = bc->init(&ctx);
+	if (r)
+		goto out;
+
+	for (i = 0; i < n; ++i) {
+		ktime_t start = ktime_get();
+
+		bc->run(&ctx);
+		samples[i] = ktime_to_ns(ktime_sub(ktime_get(), start));
+		total += samples[i];
+		cond_resched();
+	}
+
+	sort(samples, n, sizeof(*samples), amdgpu_benchmark_cmp_u64, NULL);
+
+	drm_printf(p, "  {\"case\": \"%s\", \"ops\": %u, \"runs\": %u, "
+		   "\"run_ns\": {\"min\": %llu, \"p50\": %llu, \"p90\": %llu, "
+		   "\"p99\": %llu, \"max\": %llu, \"mean\": %llu}",
+		   bc->name, bc->ops, n, samples[0], samples[n * 50 / 100],
+		   samples[n * 90 / 100], samples[n * 99 / 100], samples[n - 1],
+		   div64_u64(total, n));
+	if (bc->report)
+		bc->report(&ctx, p);
+	drm_printf(p, "}%s\n", last ? "" : ",");
+	bc->fini(&ctx);
+
+out:
+	kfree(samples);
+	return r;
+}
+
+/**
+ * amdgpu_benchmark_cpu - run the CPU side benchmarks
+ *
+ * @adev: amdgpu_device pointer, may be a mock device
+ * @p: printer receiving the results as JSON array
+ *
+ * Run all CPU side benchmark cases and report the per run timing
+ * percentiles in nanoseconds.
+ */
+void amdgpu_benchmark_cpu(struct amdgpu_device *adev, struct drm_printer *p)
+{
+	unsigned i, n = ARRAY_SIZE(amdgpu_benchmark_cases);
+	int r;
+
+	drm_printf(p, "[\n");
+	for (i = 0; i < n; ++i) {
+		r = amdgpu_benchmark_run_case(adev, &amdgpu_benchmark_cases[i],
+					      p, i == n - 1);
+		/* -ENODEV: the case needs state a mock device doesn't have */
+		if (r == -ENODEV)
+			DRM_DEBUG_DRIVER("benchmark %s skipped\n",
+					 amdgpu_benchmark_cases[i].name);
+		else if (r)
+			DRM_ERROR("benchmark %s failed (%d)\n",
+				  amdgpu_benchmark_cases[i].name, r);
+	}
+	drm_printf(p, "]\n");
+}
+
+static void amdgpu_benchmark_printfn(struct drm_printer *p,
+				     struct va_format *vaf)
+{
+	pr_info("[" DRM_NAME "] amdgpu: %pV", vaf);
+}
+
+/**
+ * amdgpu_benchmark_mock - run the CPU side benchmarks without a GPU
+ *
+ * Run amdgpu_benchmark_cpu() against a zeroed mock device at module load,
+ * so the CPU only paths can be measured without an AMD GPU.
+ */
+void amdgpu_benchmark_mock(void)
+{
+	struct drm_printer p = { .printfn = amdgpu_benchmark_printfn };
+	struct amdgpu_device *adev;
+
+	adev = kvzalloc(sizeof(*adev), GFP_KERNEL);
+	if (!adev) {
+		DRM_ERROR("failed to allocate mock device for benchmark\n");
+		return;
+	}
+
+	amdgpu_benchmark_cpu(adev, &p);
+	kvfree(adev);
+}
+
 void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
 {
 	int i;
@@ -237,6 +1626,14 @@ void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
 					      AMDGPU_GEM_DOMAIN_VRAM,
 					      AMDGPU_GEM_DOMAIN_VRAM);
 		break;
+	case 9:
+		/* CPU side paths, results as JSON */
+		{
+			struct drm_printer p = drm_info_printer(adev->dev);
+
+			amdgpu_benchmark_cpu(adev, &p);
+		}
+		break;
 
 	default:
 		DRM_ERROR("Unknown benchmark\n");
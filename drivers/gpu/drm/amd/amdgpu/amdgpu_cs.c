@@ -433,6 +433,8 @@ static int amdgpu_cs_bo_validate(struct amdgpu_cs_parser *p,
 		domain = bo->allowed_domains;
 	}
 
+	trace_amdgpu_cs_bo_validate(bo, domain);
+
 retry:
 	amdgpu_bo_placement_from_domain(bo, domain);
 	r = ttm_bo_validate(&bo->tbo, &bo->placement, &ctx);
@@ -1039,8 +1041,8 @@ static int amdgpu_cs_ib_fill(struct amdgpu_device *adev,
 		parser->entity = entity;
 
 		ring = to_amdgpu_ring(entity->rq->sched);
-		r =  amdgpu_ib_get(adev, vm, ring->funcs->parse_cs ?
-				   chunk_ib->ib_bytes : 0, ib);
+		r =  amdgpu_ib_get_ring(adev, vm, ring, ring->funcs->parse_cs ?
+					chunk_ib->ib_bytes : 0, ib);
 		if (r) {
 			DRM_ERROR("Failed to get ib !\n");
 			return r;
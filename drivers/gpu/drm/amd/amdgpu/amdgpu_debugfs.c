@@ -917,11 +917,44 @@ static int amdgpu_debugfs_evict_gtt(struct seq_file *m, void *data)
 	return 0;
 }
 
+static int amdgpu_debugfs_benchmark(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct drm_printer p = drm_seq_file_printer(m);
+
+	amdgpu_benchmark_cpu(adev, &p);
+
+	return 0;
+}
+
+static int amdgpu_debugfs_sched_hist(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct drm_printer p = drm_seq_file_printer(m);
+	int i;
+
+	for (i = 0; i < AMDGPU_MAX_RINGS; i++) {
+		struct amdgpu_ring *ring = adev->rings[i];
+
+		if (!ring || !ring->sched.thread)
+			continue;
+		drm_sched_hist_print(&ring->sched, &p);
+	}
+
+	return 0;
+}
+
 static const struct drm_info_list amdgpu_debugfs_list[] = {
 	{"amdgpu_vbios", amdgpu_debugfs_get_vbios_dump},
 	{"amdgpu_test_ib", &amdgpu_debugfs_test_ib},
+	{"amdgpu_benchmark", &amdgpu_debugfs_benchmark},
 	{"amdgpu_evict_vram", &amdgpu_debugfs_evict_vram},
 	{"amdgpu_evict_gtt", &amdgpu_debugfs_evict_gtt},
+	{"amdgpu_sched_hist", &amdgpu_debugfs_sched_hist},
 };
 
 static void amdgpu_ib_preempt_fences_swap(struct amdgpu_ring *ring,
@@ -1086,6 +1119,25 @@ failure:
 DEFINE_SIMPLE_ATTRIBUTE(fops_ib_preempt, NULL,
 			amdgpu_debugfs_ib_preempt, "%llu\n");
 
+static int amdgpu_debugfs_sched_hist_reset(void *data, u64 val)
+{
+	struct amdgpu_device *adev = (struct amdgpu_device *)data;
+	int i;
+
+	for (i = 0; i < AMDGPU_MAX_RINGS; i++) {
+		struct amdgpu_ring *ring = adev->rings[i];
+
+		if (!ring || !ring->sched.thread)
+			continue;
+		drm_sched_hist_reset(&ring->sched);
+	}
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(fops_sched_hist_reset, NULL,
+			amdgpu_debugfs_sched_hist_reset, "%llu\n");
+
 int amdgpu_debugfs_init(struct amdgpu_device *adev)
 {
 	adev->debugfs_preempt =
@@ -1097,6 +1149,15 @@ int amdgpu_debugfs_init(struct amdgpu_device *adev)
 		return -EIO;
 	}
 
+	adev->debugfs_sched_hist_reset =
+		debugfs_create_file("amdgpu_sched_hist_reset", 0200,
+				    adev->ddev->primary->debugfs_root,
+				    (void *)adev, &fops_sched_hist_reset);
+	if (!(adev->debugfs_sched_hist_reset)) {
+		DRM_ERROR("unable to create amdgpu_sched_hist_reset debugsfs file\n");
+		return -EIO;
+	}
+
 	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_list,
 					ARRAY_SIZE(amdgpu_debugfs_list));
 }
@@ -1105,6 +1166,8 @@ void amdgpu_debugfs_preempt_cleanup(struct amdgpu_device *adev)
 {
 	if (adev->debugfs_preempt)
 		debugfs_remove(adev->debugfs_preempt);
+	if (adev->debugfs_sched_hist_reset)
+		debugfs_remove(adev->debugfs_sched_hist_reset);
 }
 
 #else
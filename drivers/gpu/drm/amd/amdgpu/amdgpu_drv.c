@@ -97,7 +97,9 @@ int amdgpu_vis_vram_limit = 0;
 int amdgpu_gart_size = -1; /* auto */
 int amdgpu_gtt_size = -1; /* auto */
 int amdgpu_moverate = -1; /* auto */
+int amdgpu_vram_evict_policy = 0;
 int amdgpu_benchmarking = 0;
+int amdgpu_benchmarking_mock = 0;
 int amdgpu_testing = 0;
 int amdgpu_audio = -1;
 int amdgpu_disp_priority = 0;
@@ -149,6 +151,9 @@ int amdgpu_mcbp = 0;
 int amdgpu_discovery = -1;
 int amdgpu_mes = 0;
 int amdgpu_noretry;
+uint amdgpu_sa_lane_size = 0;
+uint amdgpu_ih_soft_size = 0;
+int amdgpu_vmid_affinity = 0;
 
 #ifdef __linux__
 struct amdgpu_mgpu_info mgpu_info = {
@@ -198,6 +203,15 @@ module_param_named(gttsize, amdgpu_gtt_size, int, 0600);
 MODULE_PARM_DESC(moverate, "Maximum buffer migration rate in MB/s. (32, 64, etc., -1=auto, 0=1=disabled)");
 module_param_named(moverate, amdgpu_moverate, int, 0600);
 
+/**
+ * DOC: vram_evict_policy (int)
+ * Select how BOs are picked for eviction from VRAM: 0 = least recently used, 1 = prefer the smallest
+ * of the oldest BOs that frees enough space, 2 = CLOCK, giving recently used BOs a second chance.
+ * The default is 0.
+ */
+MODULE_PARM_DESC(vram_evict_policy, "VRAM eviction policy (0 = lru (default), 1 = size, 2 = clock)");
+module_param_named(vram_evict_policy, amdgpu_vram_evict_policy, int, 0444);
+
 /**
  * DOC: benchmark (int)
  * Run benchmarks. The default is 0 (Skip benchmarks).
@@ -205,6 +219,14 @@ module_param_named(moverate, amdgpu_moverate, int, 0600);
 MODULE_PARM_DESC(benchmark, "Run benchmark");
 module_param_named(benchmark, amdgpu_benchmarking, int, 0444);
 
+/**
+ * DOC: benchmark_mock (int)
+ * Run the CPU side benchmarks against a mock device at module load, without
+ * an AMD GPU. Results are logged as JSON. The default is 0 (Skip benchmarks).
+ */
+MODULE_PARM_DESC(benchmark_mock, "Run CPU benchmarks on a mock device");
+module_param_named(benchmark_mock, amdgpu_benchmarking_mock, int, 0444);
+
 /**
  * DOC: test (int)
  * Test BO GTT->VRAM and VRAM->GTT GPU copies. The default is 0 (Skip test, only set 1 to run test).
@@ -627,6 +649,42 @@ MODULE_PARM_DESC(noretry,
 	"Disable retry faults (0 = retry enabled (default), 1 = retry disabled)");
 module_param_named(noretry, amdgpu_noretry, int, 0644);
 
+/**
+ * DOC: sa_lane_size (uint)
+ * Size in KiB of the per ring lock-free IB sub-allocation lanes. IBs for a
+ * known ring are carved out of that ring's lane first and only fall back to
+ * the shared sub-allocator when the lane is exhausted. Rounded down to a
+ * power of two and raised to at least two hw submission windows of pages,
+ * since an IB overtaken by other entities' jobs holds back the space behind
+ * it. The default is 0 (disabled).
+ */
+MODULE_PARM_DESC(sa_lane_size,
+	"Per ring IB sub-allocation lane size in KiB (0 = disabled (default))");
+module_param_named(sa_lane_size, amdgpu_sa_lane_size, uint, 0444);
+
+/**
+ * DOC: ih_soft_size (uint)
+ * Size in KiB of the software IH ring. When enabled the interrupt handler
+ * only copies the raw IVs from the hardware IH ring and they are decoded and
+ * dispatched in batches from a work item, merging redundant fence interrupts.
+ * Rounded down to a power of two and never smaller than the hardware ring.
+ * The default is 0 (disabled).
+ */
+MODULE_PARM_DESC(ih_soft_size,
+	"Software IH ring size in KiB (0 = disabled (default))");
+module_param_named(ih_soft_size, amdgpu_ih_soft_size, uint, 0444);
+
+/**
+ * DOC: vmid_affinity (int)
+ * Try the VMID a VM used for its last submission on a hub first, before
+ * looking for idle or other owned VMIDs. This keeps VMs on their VMID across
+ * rings of the same hub and avoids pipeline flushes.
+ * (0 = disabled (default), 1 = enabled)
+ */
+MODULE_PARM_DESC(vmid_affinity,
+	"Keep VMs on their last VMID (0 = disabled (default), 1 = enabled)");
+module_param_named(vmid_affinity, amdgpu_vmid_affinity, int, 0644);
+
 #ifdef CONFIG_HSA_AMD
 /**
  * DOC: sched_policy (int)
@@ -1459,6 +1517,9 @@ static int __init amdgpu_init(void)
 	if (r)
 		goto error_fence;
 
+	if (amdgpu_benchmarking_mock)
+		amdgpu_benchmark_mock();
+
 	DRM_INFO("amdgpu kernel modesetting enabled.\n");
 	kms_driver.num_ioctls = amdgpu_max_kms_ioctl;
 	amdgpu_register_atpx_handler();
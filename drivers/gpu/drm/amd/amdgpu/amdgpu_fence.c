@@ -406,6 +406,8 @@ int amdgpu_fence_driver_start_ring(struct amdgpu_ring *ring,
 	amdgpu_fence_write(ring, atomic_read(&ring->fence_drv.last_seq));
 	amdgpu_irq_get(adev, irq_src, irq_type);
 
+	/* processing a fence interrupt picks up all signaled fences */
+	irq_src->coalesce = true;
 	ring->fence_drv.irq_src = irq_src;
 	ring->fence_drv.irq_type = irq_type;
 	ring->fence_drv.initialized = true;
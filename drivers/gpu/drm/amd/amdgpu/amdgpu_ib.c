@@ -63,12 +63,34 @@ static int amdgpu_debugfs_sa_init(struct amdgpu_device *adev);
  */
 int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		  unsigned size, struct amdgpu_ib *ib)
+{
+	return amdgpu_ib_get_ring(adev, vm, NULL, size, ib);
+}
+
+/**
+ * amdgpu_ib_get_ring - request an IB for a known ring
+ *
+ * @ring: ring the IB will be scheduled on, or NULL if unknown
+ * @size: requested IB size
+ * @ib: IB object returned
+ *
+ * Like amdgpu_ib_get(), but allocates from the per ring lane of the
+ * suballocator when those are enabled and @ring is known.
+ * Returns 0 on success, error on failure.
+ */
+int amdgpu_ib_get_ring(struct amdgpu_device *adev, struct amdgpu_vm *vm,
+		       struct amdgpu_ring *ring, unsigned size,
+		       struct amdgpu_ib *ib)
 {
 	int r;
 
 	if (size) {
-		r = amdgpu_sa_bo_new(&adev->ring_tmp_bo,
-				      &ib->sa_bo, size, 256);
+		if (ring)
+			r = amdgpu_sa_bo_new_lane(&adev->ring_tmp_bo, ring->idx,
+						  &ib->sa_bo, size, 256);
+		else
+			r = amdgpu_sa_bo_new(&adev->ring_tmp_bo,
+					     &ib->sa_bo, size, 256);
 		if (r) {
 			dev_err(adev->dev, "failed to get a new IB (%d)\n", r);
 			return r;
@@ -293,6 +315,23 @@ int amdgpu_ib_pool_init(struct amdgpu_device *adev)
 		return r;
 	}
 
+	if (amdgpu_sa_lane_size) {
+		unsigned lane_size = rounddown_pow_of_two(amdgpu_sa_lane_size) * 1024;
+		unsigned min_size;
+
+		/* Jobs of other entities can overtake an IB and keep the lane
+		 * tail from moving until it runs, so make room for a full hw
+		 * submission window on top of the one being held back.
+		 */
+		min_size = roundup_pow_of_two(2 * amdgpu_sched_hw_submission *
+					      AMDGPU_GPU_PAGE_SIZE);
+		r = amdgpu_sa_bo_manager_init_lanes(adev, &adev->ring_tmp_bo,
+						    AMDGPU_MAX_RINGS,
+						    max(lane_size, min_size));
+		if (r)
+			dev_warn(adev->dev, "IB lanes disabled (%d)\n", r);
+	}
+
 	adev->ib_pool_ready = true;
 	if (amdgpu_debugfs_sa_init(adev)) {
 		dev_err(adev->dev, "failed to register debugfs file for SA\n");
@@ -414,8 +453,20 @@ static int amdgpu_debugfs_sa_info(struct seq_file *m, void *data)
 
 }
 
+static int amdgpu_debugfs_sa_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+
+	amdgpu_sa_bo_dump_stats(&adev->ring_tmp_bo, m);
+
+	return 0;
+}
+
 static const struct drm_info_list amdgpu_debugfs_sa_list[] = {
 	{"amdgpu_sa_info", &amdgpu_debugfs_sa_info, 0, NULL},
+	{"amdgpu_sa_stats", &amdgpu_debugfs_sa_stats, 0, NULL},
 };
 
 #endif
@@ -423,7 +474,8 @@ static const struct drm_info_list amdgpu_debugfs_sa_list[] = {
 static int amdgpu_debugfs_sa_init(struct amdgpu_device *adev)
 {
 #if defined(CONFIG_DEBUG_FS)
-	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_sa_list, 1);
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_sa_list,
+					ARRAY_SIZE(amdgpu_debugfs_sa_list));
 #else
 	return 0;
 #endif
@@ -26,9 +26,15 @@
 #include <linux/dma-fence-array.h>
 
 
+#include <linux/seq_file.h>
+
+#include <drm/drm_debugfs.h>
+
 #include "amdgpu.h"
 #include "amdgpu_trace.h"
 
+static int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev);
+
 /*
  * PASID manager
  *
@@ -391,6 +397,64 @@ static int amdgpu_vmid_grab_used(struct amdgpu_vm *vm,
 	return 0;
 }
 
+/**
+ * amdgpu_vmid_grab_affine - try the VMID the VM used last on this hub
+ *
+ * @vm: vm to allocate id for
+ * @ring: ring we want to submit job to
+ * @sync: sync object where we add dependencies
+ * @fence: fence protecting ID from reuse
+ * @job: job who wants to use the VMID
+ * @id: resulting VMID
+ *
+ * Fast path for the common case that the VM still owns the VMID it used for
+ * its last submission, no matter on which ring of the hub, and it can be
+ * used without a flush. Skips looking for an idle VMID and walking the LRU.
+ */
+static int amdgpu_vmid_grab_affine(struct amdgpu_vm *vm,
+				   struct amdgpu_ring *ring,
+				   struct amdgpu_sync *sync,
+				   struct dma_fence *fence,
+				   struct amdgpu_job *job,
+				   struct amdgpu_vmid **id)
+{
+	struct amdgpu_device *adev = ring->adev;
+	unsigned vmhub = ring->funcs->vmhub;
+	uint64_t fence_context = adev->fence_context + ring->idx;
+	struct dma_fence *updates = sync->last_vm_update;
+	struct dma_fence *flushed;
+	int r;
+
+	*id = vm->vmid_affinity[vmhub];
+	if (!*id || vm->use_cpu_for_update)
+		goto miss;
+
+	if ((*id)->owner != vm->entity.fence_context ||
+	    (*id)->pd_gpu_addr != job->vm_pd_addr)
+		goto miss;
+
+	if (!(*id)->last_flush ||
+	    ((*id)->last_flush->context != fence_context &&
+	     !dma_fence_is_signaled((*id)->last_flush)))
+		goto miss;
+
+	flushed = (*id)->flushed_updates;
+	if (updates && (!flushed || dma_fence_is_later(updates, flushed)))
+		goto miss;
+
+	/* Good, no flush needed. Remember this submission as user */
+	r = amdgpu_sync_fence(adev, &(*id)->active, fence, false);
+	if (r)
+		return r;
+
+	job->vm_needs_flush = false;
+	return 0;
+
+miss:
+	*id = NULL;
+	return 0;
+}
+
 /**
  * amdgpu_vm_grab_id - allocate the next free VMID
  *
@@ -414,9 +478,28 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 	int r = 0;
 
 	mutex_lock(&id_mgr->lock);
+	atomic64_inc(&id_mgr->grabs);
+
+	if (amdgpu_vmid_affinity && !vm->reserved_vmid[vmhub]) {
+		r = amdgpu_vmid_grab_affine(vm, ring, sync, fence, job, &id);
+		if (r)
+			goto error;
+
+		if (id) {
+			atomic64_inc(&id_mgr->affinity_hits);
+			list_move_tail(&id->list, &id_mgr->ids_lru);
+			goto found;
+		}
+	}
+
 	r = amdgpu_vmid_grab_idle(vm, ring, sync, &idle);
-	if (r || !idle)
+	if (r)
+		goto error;
+
+	if (!idle) {
+		atomic64_inc(&id_mgr->idle_waits);
 		goto error;
+	}
 
 	if (vm->reserved_vmid[vmhub]) {
 		r = amdgpu_vmid_grab_reserved(vm, ring, sync, fence, job, &id);
@@ -427,6 +510,9 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 		if (r)
 			goto error;
 
+		if (id)
+			atomic64_inc(&id_mgr->reuse_hits);
+
 		if (!id) {
 			struct dma_fence *updates = sync->last_vm_update;
 
@@ -447,10 +533,13 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 		list_move_tail(&id->list, &id_mgr->ids_lru);
 	}
 
+found:
 	id->pd_gpu_addr = job->vm_pd_addr;
 	id->owner = vm->entity.fence_context;
+	vm->vmid_affinity[vmhub] = id;
 
 	if (job->vm_needs_flush) {
+		atomic64_inc(&id_mgr->flushes);
 		dma_fence_put(id->last_flush);
 		id->last_flush = NULL;
 	}
@@ -573,6 +662,11 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 		mutex_init(&id_mgr->lock);
 		INIT_LIST_HEAD(&id_mgr->ids_lru);
 		atomic_set(&id_mgr->reserved_vmid_num, 0);
+		atomic64_set(&id_mgr->grabs, 0);
+		atomic64_set(&id_mgr->affinity_hits, 0);
+		atomic64_set(&id_mgr->reuse_hits, 0);
+		atomic64_set(&id_mgr->idle_waits, 0);
+		atomic64_set(&id_mgr->flushes, 0);
 
 		/* skip over VMID 0, since it is the system VM */
 		for (j = 1; j < id_mgr->num_ids; ++j) {
@@ -581,6 +675,9 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 			list_add_tail(&id_mgr->ids[j].list, &id_mgr->ids_lru);
 		}
 	}
+
+	if (amdgpu_debugfs_vmid_init(adev))
+		DRM_ERROR("Failed to register debugfs file for VMIDs\n");
 }
 
 /**
@@ -609,3 +706,56 @@ void amdgpu_vmid_mgr_fini(struct amdgpu_device *adev)
 		}
 	}
 }
+
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_vmid_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	unsigned i, j;
+
+	for (i = 0; i < AMDGPU_MAX_VMHUBS; ++i) {
+		struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[i];
+
+		if (!id_mgr->num_ids)
+			continue;
+
+		seq_printf(m, "vmhub %u: grabs %lld affinity hits %lld "
+			   "reuse hits %lld idle waits %lld flushes %lld\n", i,
+			   (long long)atomic64_read(&id_mgr->grabs),
+			   (long long)atomic64_read(&id_mgr->affinity_hits),
+			   (long long)atomic64_read(&id_mgr->reuse_hits),
+			   (long long)atomic64_read(&id_mgr->idle_waits),
+			   (long long)atomic64_read(&id_mgr->flushes));
+
+		mutex_lock(&id_mgr->lock);
+		for (j = 1; j < id_mgr->num_ids; ++j)
+			seq_printf(m, "\tvmid %2u: owner 0x%016llx pd 0x%010llx\n",
+				   j, id_mgr->ids[j].owner,
+				   id_mgr->ids[j].pd_gpu_addr);
+		mutex_unlock(&id_mgr->lock);
+	}
+
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_vmid_list[] = {
+	{"amdgpu_vmid_info", &amdgpu_debugfs_vmid_info, 0, NULL},
+};
+
+#endif
+
+static int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_vmid_list,
+					ARRAY_SIZE(amdgpu_debugfs_vmid_list));
+#else
+	return 0;
+#endif
+}
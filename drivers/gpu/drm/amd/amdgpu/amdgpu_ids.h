@@ -68,6 +68,13 @@ struct amdgpu_vmid_mgr {
 	struct list_head	ids_lru;
 	struct amdgpu_vmid	ids[AMDGPU_NUM_VMID];
 	atomic_t		reserved_vmid_num;
+
+	/* statistics */
+	atomic64_t		grabs;
+	atomic64_t		affinity_hits;
+	atomic64_t		reuse_hits;
+	atomic64_t		idle_waits;
+	atomic64_t		flushes;
 };
 
 int amdgpu_pasid_alloc(unsigned int bits);
@@ -22,10 +22,15 @@
  */
 
 #include <linux/dma-mapping.h>
+#include <linux/seq_file.h>
+
+#include <drm/drm_debugfs.h>
 
 #include "amdgpu.h"
 #include "amdgpu_ih.h"
 
+static int amdgpu_debugfs_ih_soft_init(struct amdgpu_device *adev);
+
 /**
  * amdgpu_ih_ring_init - initialize the IH state
  *
@@ -178,3 +183,312 @@ restart_ih:
 	return IRQ_HANDLED;
 }
 
+/**
+ * amdgpu_ih_soft_init - initialize a software IH ring
+ *
+ * @adev: amdgpu_device pointer
+ * @soft: software ring to initialize
+ * @hw: hardware ring feeding the software ring
+ * @ring_size: size of the software ring in bytes, must be a power of two
+ *
+ * Allocates the software ring. Returns 0 for success, errors for failure.
+ */
+int amdgpu_ih_soft_init(struct amdgpu_device *adev,
+			struct amdgpu_ih_soft_ring *soft,
+			struct amdgpu_ih_ring *hw, unsigned ring_size)
+{
+	if (WARN_ON(!is_power_of_2(ring_size)))
+		return -EINVAL;
+
+	soft->batch = kcalloc(AMDGPU_IH_SOFT_BATCH, sizeof(*soft->batch),
+			      GFP_KERNEL);
+	if (!soft->batch)
+		return -ENOMEM;
+
+	soft->ring.ring = kvzalloc(ring_size, GFP_KERNEL);
+	if (!soft->ring.ring) {
+		kfree(soft->batch);
+		soft->batch = NULL;
+		return -ENOMEM;
+	}
+
+	soft->ring.ring_size = ring_size;
+	soft->ring.ptr_mask = ring_size - 1;
+	soft->ring.rptr = 0;
+	soft->ring.enabled = true;
+	atomic_set(&soft->ring.lock, 0);
+	soft->hw = hw;
+	soft->wptr = 0;
+	soft->done = 0;
+	soft->flags = 0;
+	soft->max_batch = 0;
+	atomic64_set(&soft->copied, 0);
+	atomic64_set(&soft->batches, 0);
+	atomic64_set(&soft->dispatched, 0);
+	atomic64_set(&soft->coalesced, 0);
+	atomic64_set(&soft->overflows, 0);
+
+	if (amdgpu_debugfs_ih_soft_init(adev))
+		dev_err(adev->dev, "failed to register debugfs file for IH\n");
+
+	return 0;
+}
+
+/**
+ * amdgpu_ih_soft_fini - tear down a software IH ring
+ *
+ * @adev: amdgpu_device pointer
+ * @soft: software ring to tear down
+ *
+ * Waits for pending processing and frees the software ring.
+ */
+void amdgpu_ih_soft_fini(struct amdgpu_device *adev,
+			 struct amdgpu_ih_soft_ring *soft)
+{
+	if (!soft->ring.ring)
+		return;
+
+	soft->ring.enabled = false;
+	cancel_work_sync(&soft->work);
+	kvfree((void *)soft->ring.ring);
+	soft->ring.ring = NULL;
+	kfree(soft->batch);
+	soft->batch = NULL;
+}
+
+/**
+ * amdgpu_ih_soft_copy - interrupt handler for the software IH ring
+ *
+ * @adev: amdgpu_device pointer
+ * @soft: software ring to copy the IVs to
+ *
+ * Copy the pending raw IVs from the hardware ring to the software ring and
+ * kick off their processing. When the software ring is full the remaining
+ * IVs stay in the hardware ring until the work item made room.
+ * Returns irq process return code.
+ */
+int amdgpu_ih_soft_copy(struct amdgpu_device *adev,
+			struct amdgpu_ih_soft_ring *soft)
+{
+	struct amdgpu_ih_ring *ih = soft->hw;
+	u32 wptr, pending, avail, size, chunk;
+	u32 soft_off;
+
+	if (!ih->enabled || adev->shutdown)
+		return IRQ_NONE;
+
+	wptr = amdgpu_ih_get_wptr(adev, ih);
+
+restart_ih:
+	if (atomic_xchg(&ih->lock, 1))
+		return IRQ_NONE;
+
+	/* Order reading of wptr vs. reading of IH ring data */
+	rmb();
+
+	while (ih->rptr != wptr) {
+		pending = (wptr - ih->rptr) & ih->ptr_mask;
+		avail = soft->ring.ring_size - (soft->wptr - READ_ONCE(soft->done));
+		if (!avail) {
+			atomic64_inc(&soft->overflows);
+			set_bit(AMDGPU_IH_SOFT_STALLED, &soft->flags);
+			break;
+		}
+
+		size = min(pending, avail);
+		while (size) {
+			soft_off = soft->wptr & soft->ring.ptr_mask;
+			chunk = min3(size, ih->ring_size - ih->rptr,
+				     soft->ring.ring_size - soft_off);
+
+			memcpy((void *)soft->ring.ring + soft_off,
+			       (const void *)ih->ring + ih->rptr, chunk);
+
+			ih->rptr = (ih->rptr + chunk) & ih->ptr_mask;
+			/* the IV data must be visible before the new wptr */
+			smp_wmb();
+			WRITE_ONCE(soft->wptr, soft->wptr + chunk);
+			atomic64_add(chunk, &soft->copied);
+			size -= chunk;
+		}
+	}
+
+	amdgpu_ih_set_rptr(adev, ih);
+	atomic_set(&ih->lock, 0);
+
+	schedule_work(&soft->work);
+	if (test_bit(AMDGPU_IH_SOFT_STALLED, &soft->flags))
+		return IRQ_HANDLED;
+
+	/* make sure wptr hasn't changed while copying */
+	wptr = amdgpu_ih_get_wptr(adev, ih);
+	if (wptr != ih->rptr)
+		goto restart_ih;
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Returns the index of an earlier IV in the batch that @idx duplicates, or
+ * -1 if @idx has to be dispatched.
+ */
+static int amdgpu_ih_soft_find_duplicate(struct amdgpu_device *adev,
+					 struct amdgpu_iv_entry *batch,
+					 unsigned idx)
+{
+	struct amdgpu_iv_entry *entry = &batch[idx];
+	struct amdgpu_irq_src *src;
+	unsigned i;
+
+	if (entry->client_id >= AMDGPU_IRQ_CLIENTID_MAX ||
+	    entry->src_id >= AMDGPU_MAX_IRQ_SRC_ID ||
+	    !adev->irq.client[entry->client_id].sources)
+		return -1;
+
+	src = adev->irq.client[entry->client_id].sources[entry->src_id];
+	if (!src || !src->coalesce)
+		return -1;
+
+	for (i = 0; i < idx; ++i) {
+		struct amdgpu_iv_entry *prev = &batch[i];
+
+		if (prev->client_id == entry->client_id &&
+		    prev->src_id == entry->src_id &&
+		    prev->ring_id == entry->ring_id &&
+		    prev->vmid == entry->vmid &&
+		    prev->pasid == entry->pasid &&
+		    prev->src_data[0] == entry->src_data[0])
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * amdgpu_ih_soft_process - decode and dispatch the software IH ring
+ *
+ * @adev: amdgpu_device pointer
+ * @soft: software ring to process
+ *
+ * Decodes up to AMDGPU_IH_SOFT_BATCH IVs at once, keeps redundant IVs of
+ * sources which can be coalesced from the IP blocks and dispatches the rest.
+ * amdkfd keeps seeing every IV the IP blocks don't handle. Called from the
+ * work item only, so there is a single consumer.
+ */
+void amdgpu_ih_soft_process(struct amdgpu_device *adev,
+			    struct amdgpu_ih_soft_ring *soft)
+{
+	DECLARE_BITMAP(handled, AMDGPU_IH_SOFT_BATCH);
+	struct amdgpu_ih_ring *ih = &soft->ring;
+	unsigned ih_id = soft->hw - &adev->irq.ih;
+	u32 wptr, consumed, start;
+	unsigned i, count;
+	int dup;
+
+	if (!ih->ring)
+		return;
+
+	wptr = READ_ONCE(soft->wptr);
+	/* Order reading of wptr vs. reading of IH ring data */
+	smp_rmb();
+
+	while (soft->done != wptr) {
+		consumed = 0;
+		for (count = 0; count < AMDGPU_IH_SOFT_BATCH &&
+		     soft->done + consumed != wptr; ++count) {
+			struct amdgpu_iv_entry *entry = &soft->batch[count];
+
+			start = ih->rptr;
+			entry->iv_entry = (const uint32_t *)&ih->ring[start >> 2];
+			amdgpu_ih_decode_iv(adev, entry);
+			consumed += ih->rptr - start;
+			ih->rptr &= ih->ptr_mask;
+		}
+
+		for (i = 0; i < count; ++i) {
+			struct amdgpu_iv_entry *entry = &soft->batch[i];
+			bool done;
+
+			dup = amdgpu_ih_soft_find_duplicate(adev, soft->batch, i);
+			if (dup >= 0) {
+				/* amdkfd gets it if the original wasn't handled */
+				done = test_bit(dup, handled);
+				if (!done)
+					amdgpu_amdkfd_interrupt(adev,
+								entry->iv_entry);
+				atomic64_inc(&soft->coalesced);
+			} else {
+				done = amdgpu_irq_dispatch_entry(adev, ih_id,
+								 entry);
+				atomic64_inc(&soft->dispatched);
+			}
+
+			if (done)
+				__set_bit(i, handled);
+			else
+				__clear_bit(i, handled);
+		}
+
+		atomic64_inc(&soft->batches);
+		if (count > soft->max_batch)
+			soft->max_batch = count;
+
+		/* we are done with the IV data before handing out the space */
+		smp_mb();
+		WRITE_ONCE(soft->done, soft->done + consumed);
+
+		if (soft->done == wptr) {
+			wptr = READ_ONCE(soft->wptr);
+			smp_rmb();
+		}
+	}
+
+	/* pull in what didn't fit into the ring last time */
+	if (test_and_clear_bit(AMDGPU_IH_SOFT_STALLED, &soft->flags))
+		amdgpu_ih_soft_copy(adev, soft);
+}
+
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_ih_soft_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct amdgpu_ih_soft_ring *soft = &adev->irq.ih_soft;
+
+	seq_printf(m, "ring size: %u bytes\n", soft->ring.ring_size);
+	seq_printf(m, "pending: %u bytes\n",
+		   READ_ONCE(soft->wptr) - READ_ONCE(soft->done));
+	seq_printf(m, "copied: %lld bytes\n",
+		   (long long)atomic64_read(&soft->copied));
+	seq_printf(m, "batches: %lld\n",
+		   (long long)atomic64_read(&soft->batches));
+	seq_printf(m, "max batch: %u\n", soft->max_batch);
+	seq_printf(m, "dispatched: %lld\n",
+		   (long long)atomic64_read(&soft->dispatched));
+	seq_printf(m, "coalesced: %lld\n",
+		   (long long)atomic64_read(&soft->coalesced));
+	seq_printf(m, "overflows: %lld\n",
+		   (long long)atomic64_read(&soft->overflows));
+
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_ih_soft_list[] = {
+	{"amdgpu_ih_soft_info", &amdgpu_debugfs_ih_soft_info, 0, NULL},
+};
+
+#endif
+
+static int amdgpu_debugfs_ih_soft_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_ih_soft_list,
+					ARRAY_SIZE(amdgpu_debugfs_ih_soft_list));
+#else
+	return 0;
+#endif
+}
@@ -55,6 +55,37 @@ struct amdgpu_ih_ring {
 	atomic_t		lock;
 };
 
+/* Maximum number of IVs decoded and dispatched as one batch */
+#define AMDGPU_IH_SOFT_BATCH	64
+
+/*
+ * Software IH ring, the interrupt handler only copies the raw IVs from the
+ * hardware ring into it and decoding and dispatching is done from a work
+ * item in batches.
+ */
+struct amdgpu_ih_soft_ring {
+	struct amdgpu_ih_ring	ring;
+	struct amdgpu_ih_ring	*hw;
+	struct work_struct	work;
+
+	/* free running byte counters, producer and consumer side */
+	u32			wptr;
+	u32			done;
+	/* set from the interrupt handler, cleared by the work item */
+	unsigned long		flags;
+#define AMDGPU_IH_SOFT_STALLED	0
+
+	struct amdgpu_iv_entry	*batch;
+
+	/* statistics */
+	atomic64_t		copied;
+	atomic64_t		batches;
+	atomic64_t		dispatched;
+	atomic64_t		coalesced;
+	atomic64_t		overflows;
+	u32			max_batch;
+};
+
 /* provided by the ih block */
 struct amdgpu_ih_funcs {
 	/* ring read/write ptr handling, called from interrupt context */
@@ -73,5 +104,14 @@ int amdgpu_ih_ring_init(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih,
 			unsigned ring_size, bool use_bus_addr);
 void amdgpu_ih_ring_fini(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih);
 int amdgpu_ih_process(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih);
+int amdgpu_ih_soft_init(struct amdgpu_device *adev,
+			struct amdgpu_ih_soft_ring *soft,
+			struct amdgpu_ih_ring *hw, unsigned ring_size);
+void amdgpu_ih_soft_fini(struct amdgpu_device *adev,
+			 struct amdgpu_ih_soft_ring *soft);
+int amdgpu_ih_soft_copy(struct amdgpu_device *adev,
+			struct amdgpu_ih_soft_ring *soft);
+void amdgpu_ih_soft_process(struct amdgpu_device *adev,
+			    struct amdgpu_ih_soft_ring *soft);
 
 #endif
@@ -150,7 +150,10 @@ irqreturn_t amdgpu_irq_handler(int irq, void *arg)
 	struct amdgpu_device *adev = dev->dev_private;
 	irqreturn_t ret;
 
-	ret = amdgpu_ih_process(adev, &adev->irq.ih);
+	if (adev->irq.ih_soft.ring.ring)
+		ret = amdgpu_ih_soft_copy(adev, &adev->irq.ih_soft);
+	else
+		ret = amdgpu_ih_process(adev, &adev->irq.ih);
 	if (ret == IRQ_HANDLED)
 		pm_runtime_mark_last_busy(dev->dev);
 	return ret;
@@ -186,6 +189,21 @@ static void amdgpu_irq_handle_ih2(struct work_struct *work)
 	amdgpu_ih_process(adev, &adev->irq.ih2);
 }
 
+/**
+ * amdgpu_irq_handle_ih_soft - decode and dispatch the software IH ring
+ *
+ * @work: work structure in struct amdgpu_ih_soft_ring
+ *
+ * Process the IVs copied to the software ring by the interrupt handler.
+ */
+static void amdgpu_irq_handle_ih_soft(struct work_struct *work)
+{
+	struct amdgpu_device *adev = container_of(work, struct amdgpu_device,
+						  irq.ih_soft.work);
+
+	amdgpu_ih_soft_process(adev, &adev->irq.ih_soft);
+}
+
 /**
  * amdgpu_msi_ok - check whether MSI functionality is enabled
  *
@@ -254,6 +272,16 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 
 	INIT_WORK(&adev->irq.ih1_work, amdgpu_irq_handle_ih1);
 	INIT_WORK(&adev->irq.ih2_work, amdgpu_irq_handle_ih2);
+	INIT_WORK(&adev->irq.ih_soft.work, amdgpu_irq_handle_ih_soft);
+
+	if (amdgpu_ih_soft_size) {
+		unsigned size = rounddown_pow_of_two(amdgpu_ih_soft_size) * 1024;
+
+		r = amdgpu_ih_soft_init(adev, &adev->irq.ih_soft, &adev->irq.ih,
+					max(size, adev->irq.ih.ring_size));
+		if (r)
+			dev_warn(adev->dev, "software IH ring disabled (%d)\n", r);
+	}
 
 	adev->irq.installed = true;
 	r = drm_irq_install(adev->ddev, adev->ddev->pdev->irq);
@@ -261,6 +289,7 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 		adev->irq.installed = false;
 		if (!amdgpu_device_has_dc_support(adev))
 			flush_work(&adev->hotplug_work);
+		amdgpu_ih_soft_fini(adev, &adev->irq.ih_soft);
 		return r;
 	}
 	adev->ddev->max_vblank_count = 0x00ffffff;
@@ -293,6 +322,8 @@ void amdgpu_irq_fini(struct amdgpu_device *adev)
 			flush_work(&adev->hotplug_work);
 	}
 
+	amdgpu_ih_soft_fini(adev, &adev->irq.ih_soft);
+
 	for (i = 0; i < AMDGPU_IRQ_CLIENTID_MAX; ++i) {
 		if (!adev->irq.client[i].sources)
 			continue;
@@ -382,18 +413,35 @@ void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 {
 	u32 ring_index = ih->rptr >> 2;
 	struct amdgpu_iv_entry entry;
+
+	entry.iv_entry = (const uint32_t *)&ih->ring[ring_index];
+	amdgpu_ih_decode_iv(adev, &entry);
+
+	amdgpu_irq_dispatch_entry(adev, ih - &adev->irq.ih, &entry);
+}
+
+/**
+ * amdgpu_irq_dispatch_entry - dispatch a decoded IV to IP blocks
+ *
+ * @adev: amdgpu device pointer
+ * @ih_id: index of the hardware IH ring the IV was read from
+ * @entry: decoded interrupt vector
+ *
+ * Dispatches an already decoded IRQ to IP blocks, and to amdkfd if none of
+ * them handled it. Returns true if an IP block handled the IV.
+ */
+bool amdgpu_irq_dispatch_entry(struct amdgpu_device *adev, unsigned ih_id,
+			       struct amdgpu_iv_entry *entry)
+{
 	unsigned client_id, src_id;
 	struct amdgpu_irq_src *src;
 	bool handled = false;
 	int r;
 
-	entry.iv_entry = (const uint32_t *)&ih->ring[ring_index];
-	amdgpu_ih_decode_iv(adev, &entry);
-
-	trace_amdgpu_iv(ih - &adev->irq.ih, &entry);
+	trace_amdgpu_iv(ih_id, entry);
 
-	client_id = entry.client_id;
-	src_id = entry.src_id;
+	client_id = entry->client_id;
+	src_id = entry->src_id;
 
 	if (client_id >= AMDGPU_IRQ_CLIENTID_MAX) {
 		DRM_DEBUG("Invalid client_id in IV: %d\n", client_id);
@@ -409,7 +457,7 @@ void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 			  client_id, src_id);
 
 	} else if ((src = adev->irq.client[client_id].sources[src_id])) {
-		r = src->funcs->process(adev, src, &entry);
+		r = src->funcs->process(adev, src, entry);
 		if (r < 0)
 			DRM_ERROR("error processing interrupt (%d)\n", r);
 		else if (r)
@@ -421,7 +469,9 @@ void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 
 	/* Send it to amdkfd as well if it isn't already handled */
 	if (!handled)
-		amdgpu_amdkfd_interrupt(adev, entry.iv_entry);
+		amdgpu_amdkfd_interrupt(adev, entry->iv_entry);
+
+	return handled;
 }
 
 /**
@@ -62,6 +62,14 @@ struct amdgpu_irq_src {
 	atomic_t				*enabled_types;
 	const struct amdgpu_irq_src_funcs	*funcs;
 	void *data;
+	/*
+	 * Identical IVs in one soft IH batch are merged and the handler runs
+	 * only once. IVs are compared by client, source, ring, vmid, pasid and
+	 * src_data[0] only, so a source may only opt in if its handler is
+	 * idempotent for such IVs and doesn't look at the rest of the entry,
+	 * e.g. fence interrupts which just process the ring.
+	 */
+	bool					coalesce;
 };
 
 struct amdgpu_irq_client {
@@ -91,6 +99,7 @@ struct amdgpu_irq {
 	struct amdgpu_ih_ring		ih, ih1, ih2;
 	const struct amdgpu_ih_funcs    *ih_funcs;
 	struct work_struct		ih1_work, ih2_work;
+	struct amdgpu_ih_soft_ring	ih_soft;
 	struct amdgpu_irq_src		self_irq;
 
 	/* gen irq stuff */
@@ -109,6 +118,8 @@ int amdgpu_irq_add_id(struct amdgpu_device *adev,
 		      struct amdgpu_irq_src *source);
 void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 			 struct amdgpu_ih_ring *ih);
+bool amdgpu_irq_dispatch_entry(struct amdgpu_device *adev, unsigned ih_id,
+			       struct amdgpu_iv_entry *entry);
 int amdgpu_irq_update(struct amdgpu_device *adev, struct amdgpu_irq_src *src,
 		      unsigned type);
 int amdgpu_irq_get(struct amdgpu_device *adev, struct amdgpu_irq_src *src,
@@ -195,34 +195,203 @@ static void amdgpu_mn_read_unlock(struct amdgpu_mn *amn)
 }
 
 /**
- * amdgpu_mn_invalidate_node - unmap all BOs of a node
+ * amdgpu_mn_invalidate_bo - unmap a single BO
  *
- * @node: the node with the BOs to unmap
- * @start: start of address range affected
- * @end: end of address range affected
+ * @bo: the BO to unmap
  *
- * Block for operations on BOs to finish and mark pages as accessed and
+ * Block for operations on the BO to finish and mark pages as accessed and
  * potentially dirty.
  */
-static void amdgpu_mn_invalidate_node(struct amdgpu_mn_node *node,
-				      unsigned long start,
-				      unsigned long end)
+static void amdgpu_mn_invalidate_bo(struct amdgpu_bo *bo)
 {
-	struct amdgpu_bo *bo;
 	long r;
 
-	list_for_each_entry(bo, &node->bos, mn_list) {
+	r = reservation_object_wait_timeout_rcu(bo->tbo.resv,
+		true, false, MAX_SCHEDULE_TIMEOUT);
+	if (r <= 0)
+		DRM_ERROR("(%ld) failed to wait for user bo\n", r);
+
+	amdgpu_ttm_tt_mark_user_pages(bo->tbo.ttm);
+}
+
+#define AMDGPU_MN_BATCH	16
+
+/*
+ * Fences and BOs collected for one invalidation. This lives on the stack
+ * because nothing is allowed to allocate memory with the notifier lock held
+ * while the core MM waits for us.
+ */
+struct amdgpu_mn_batch {
+	struct amdgpu_bo	*bos[AMDGPU_MN_BATCH];
+	struct dma_fence	*fences[AMDGPU_MN_BATCH];
+	unsigned		num_bos;
+	unsigned		num_fences;
+};
+
+/**
+ * amdgpu_mn_batch_fence - add a fence reference to the batch
+ *
+ * @batch: the batch collecting the fences
+ * @fence: the fence, the reference is consumed
+ *
+ * Keep only the latest fence of each context. Returns false if the batch
+ * is full, the reference is dropped in any case.
+ */
+static bool amdgpu_mn_batch_fence(struct amdgpu_mn_batch *batch,
+				  struct dma_fence *fence)
+{
+	unsigned i;
+
+	for (i = 0; i < batch->num_fences; ++i) {
+		struct dma_fence *old = batch->fences[i];
+
+		if (old->context != fence->context)
+			continue;
+
+		if (dma_fence_is_later(fence, old)) {
+			batch->fences[i] = fence;
+			dma_fence_put(old);
+		} else {
+			dma_fence_put(fence);
+		}
+		return true;
+	}
+
+	if (batch->num_fences == AMDGPU_MN_BATCH) {
+		dma_fence_put(fence);
+		return false;
+	}
+
+	batch->fences[batch->num_fences++] = fence;
+	return true;
+}
 
-		if (!amdgpu_ttm_tt_affect_userptr(bo->tbo.ttm, start, end))
+/**
+ * amdgpu_mn_batch_bo - add the fences of a BO to the batch
+ *
+ * @batch: the batch collecting the fences
+ * @bo: the BO whose fences should be added
+ *
+ * Walks the reservation object under RCU instead of using
+ * reservation_object_get_fences_rcu(), which allocates. Returns false if
+ * not all unsignaled fences fit into the batch.
+ */
+static bool amdgpu_mn_batch_bo(struct amdgpu_mn_batch *batch,
+			       struct amdgpu_bo *bo)
+{
+	struct reservation_object *resv = bo->tbo.resv;
+	struct reservation_object_list *fobj;
+	struct dma_fence *fence;
+	unsigned seq, i, count;
+	bool ret;
+
+retry:
+	ret = true;
+	seq = read_seqcount_begin(&resv->seq);
+	rcu_read_lock();
+
+	fobj = rcu_dereference(resv->fence);
+	count = fobj ? fobj->shared_count : 0;
+
+	for (i = 0; ret && i <= count; ++i) {
+		if (i == count)
+			fence = rcu_dereference(resv->fence_excl);
+		else
+			fence = rcu_dereference(fobj->shared[i]);
+
+		if (!fence || dma_fence_is_signaled(fence))
 			continue;
 
-		r = reservation_object_wait_timeout_rcu(bo->tbo.resv,
-			true, false, MAX_SCHEDULE_TIMEOUT);
-		if (r <= 0)
-			DRM_ERROR("(%ld) failed to wait for user bo\n", r);
+		fence = dma_fence_get_rcu(fence);
+		if (!fence) {
+			rcu_read_unlock();
+			goto retry;
+		}
+		ret = amdgpu_mn_batch_fence(batch, fence);
+	}
+
+	rcu_read_unlock();
+	if (ret && read_seqcount_retry(&resv->seq, seq))
+		goto retry;
+
+	return ret;
+}
+
+/**
+ * amdgpu_mn_batch_flush - wait for the batch and unmap its BOs
+ *
+ * @batch: the batch to flush
+ *
+ * Block for all collected fences and mark the pages of the collected BOs
+ * as accessed and potentially dirty.
+ */
+static void amdgpu_mn_batch_flush(struct amdgpu_mn_batch *batch)
+{
+	unsigned i;
+	long r;
+
+	for (i = 0; i < batch->num_fences; ++i) {
+		r = dma_fence_wait(batch->fences[i], false);
+		if (r)
+			DRM_ERROR("(%ld) failed to wait for user bos\n", r);
+		dma_fence_put(batch->fences[i]);
+	}
+
+	for (i = 0; i < batch->num_bos; ++i)
+		amdgpu_ttm_tt_mark_user_pages(batch->bos[i]->tbo.ttm);
+
+	batch->num_fences = 0;
+	batch->num_bos = 0;
+}
+
+/**
+ * amdgpu_mn_invalidate_range - unmap all BOs in an address range
+ *
+ * @amn: our notifier
+ * @start: start of address range affected
+ * @end: end of address range affected
+ *
+ * Collect the fences of the affected BOs of all overlapping nodes into a
+ * fixed size batch and wait for them at once, so that a range covering many
+ * BOs only waits once for each fence context instead of once per BO. A full
+ * batch is flushed before collecting more, a BO whose fences don't fit into
+ * an empty batch falls back to the per BO wait.
+ */
+static void amdgpu_mn_invalidate_range(struct amdgpu_mn *amn,
+				       unsigned long start,
+				       unsigned long end)
+{
+	struct amdgpu_mn_batch batch = {};
+	struct interval_tree_node *it;
+
+	it = interval_tree_iter_first(&amn->objects, start, end);
+	while (it) {
+		struct amdgpu_mn_node *node;
+		struct amdgpu_bo *bo;
+
+		node = container_of(it, struct amdgpu_mn_node, it);
+		it = interval_tree_iter_next(it, start, end);
 
-		amdgpu_ttm_tt_mark_user_pages(bo->tbo.ttm);
+		list_for_each_entry(bo, &node->bos, mn_list) {
+			if (!amdgpu_ttm_tt_affect_userptr(bo->tbo.ttm, start, end))
+				continue;
+
+			if (batch.num_bos == AMDGPU_MN_BATCH)
+				amdgpu_mn_batch_flush(&batch);
+
+			if (!amdgpu_mn_batch_bo(&batch, bo)) {
+				amdgpu_mn_batch_flush(&batch);
+				if (!amdgpu_mn_batch_bo(&batch, bo)) {
+					amdgpu_mn_batch_flush(&batch);
+					amdgpu_mn_invalidate_bo(bo);
+					continue;
+				}
+			}
+			batch.bos[batch.num_bos++] = bo;
+		}
 	}
+
+	amdgpu_mn_batch_flush(&batch);
 }
 
 /**
@@ -241,32 +410,23 @@ static int amdgpu_mn_sync_pagetables_gfx(struct hmm_mirror *mirror,
 	unsigned long start = update->start;
 	unsigned long end = update->end;
 	bool blockable = update->blockable;
-	struct interval_tree_node *it;
 
 	/* notification is exclusive, but interval is inclusive */
 	end -= 1;
 
 	/* TODO we should be able to split locking for interval tree and
-	 * amdgpu_mn_invalidate_node
+	 * amdgpu_mn_invalidate_range
 	 */
 	if (amdgpu_mn_read_lock(amn, blockable))
 		return -EAGAIN;
 
-	it = interval_tree_iter_first(&amn->objects, start, end);
-	while (it) {
-		struct amdgpu_mn_node *node;
-
-		if (!blockable) {
-			amdgpu_mn_read_unlock(amn);
-			return -EAGAIN;
-		}
-
-		node = container_of(it, struct amdgpu_mn_node, it);
-		it = interval_tree_iter_next(it, start, end);
-
-		amdgpu_mn_invalidate_node(node, start, end);
+	if (!blockable && interval_tree_iter_first(&amn->objects, start, end)) {
+		amdgpu_mn_read_unlock(amn);
+		return -EAGAIN;
 	}
 
+	amdgpu_mn_invalidate_range(amn, start, end);
+
 	amdgpu_mn_read_unlock(amn);
 
 	return 0;
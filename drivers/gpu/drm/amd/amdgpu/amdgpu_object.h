@@ -282,14 +282,20 @@ uint32_t amdgpu_bo_get_preferred_pin_domain(struct amdgpu_device *adev,
 
 static inline uint64_t amdgpu_sa_bo_gpu_addr(struct amdgpu_sa_bo *sa_bo)
 {
+	if (sa_bo->lane)
+		return sa_bo->manager->lane_gpu_addr + sa_bo->soffset;
 	return sa_bo->manager->gpu_addr + sa_bo->soffset;
 }
 
 static inline void * amdgpu_sa_bo_cpu_addr(struct amdgpu_sa_bo *sa_bo)
 {
+	if (sa_bo->lane)
+		return sa_bo->manager->lane_cpu_ptr + sa_bo->soffset;
 	return sa_bo->manager->cpu_ptr + sa_bo->soffset;
 }
 
+void amdgpu_sa_bo_manager_init_cpu(struct amdgpu_sa_manager *sa_manager,
+				   void *cpu_ptr, unsigned size, u32 align);
 int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
 				     struct amdgpu_sa_manager *sa_manager,
 				     unsigned size, u32 align, u32 domain);
@@ -300,12 +306,20 @@ int amdgpu_sa_bo_manager_start(struct amdgpu_device *adev,
 int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 		     struct amdgpu_sa_bo **sa_bo,
 		     unsigned size, unsigned align);
+int amdgpu_sa_bo_manager_init_lanes(struct amdgpu_device *adev,
+				    struct amdgpu_sa_manager *sa_manager,
+				    unsigned num_lanes, unsigned lane_size);
+int amdgpu_sa_bo_new_lane(struct amdgpu_sa_manager *sa_manager,
+			  unsigned lane, struct amdgpu_sa_bo **sa_bo,
+			  unsigned size, unsigned align);
 void amdgpu_sa_bo_free(struct amdgpu_device *adev,
 			      struct amdgpu_sa_bo **sa_bo,
 			      struct dma_fence *fence);
 #if defined(CONFIG_DEBUG_FS)
 void amdgpu_sa_bo_dump_debug_info(struct amdgpu_sa_manager *sa_manager,
 					 struct seq_file *m);
+void amdgpu_sa_bo_dump_stats(struct amdgpu_sa_manager *sa_manager,
+			     struct seq_file *m);
 #endif
 
 
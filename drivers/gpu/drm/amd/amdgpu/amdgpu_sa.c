@@ -46,22 +46,55 @@
 
 static void amdgpu_sa_bo_remove_locked(struct amdgpu_sa_bo *sa_bo);
 static void amdgpu_sa_bo_try_free(struct amdgpu_sa_manager *sa_manager);
+static void amdgpu_sa_lane_fini(struct amdgpu_sa_manager *sa_manager,
+				struct amdgpu_sa_lane *lane);
 
-int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
-			      struct amdgpu_sa_manager *sa_manager,
-			      unsigned size, u32 align, u32 domain)
+/**
+ * amdgpu_sa_bo_manager_init_cpu - init a manager backed by kernel memory
+ *
+ * @sa_manager: manager to initialize
+ * @cpu_ptr: memory to sub-allocate from
+ * @size: size of @cpu_ptr in bytes
+ * @align: maximum alignment of the allocations
+ *
+ * Initialize the manager state without allocating a BO. Used to exercise
+ * the allocator without a device, e.g. by the CPU benchmarks.
+ */
+void amdgpu_sa_bo_manager_init_cpu(struct amdgpu_sa_manager *sa_manager,
+				   void *cpu_ptr, unsigned size, u32 align)
 {
-	int i, r;
+	int i;
 
 	init_waitqueue_head(&sa_manager->wq);
 	sa_manager->bo = NULL;
 	sa_manager->size = size;
-	sa_manager->domain = domain;
+	sa_manager->domain = AMDGPU_GEM_DOMAIN_CPU;
 	sa_manager->align = align;
+	sa_manager->gpu_addr = 0;
+	sa_manager->cpu_ptr = cpu_ptr;
 	sa_manager->hole = &sa_manager->olist;
 	INIT_LIST_HEAD(&sa_manager->olist);
 	for (i = 0; i < AMDGPU_SA_NUM_FENCE_LISTS; ++i)
 		INIT_LIST_HEAD(&sa_manager->flist[i]);
+	sa_manager->lanes = NULL;
+	sa_manager->num_lanes = 0;
+	sa_manager->lane_size = 0;
+	sa_manager->lane_bo = NULL;
+	atomic64_set(&sa_manager->allocs, 0);
+	atomic64_set(&sa_manager->contended, 0);
+	atomic64_set(&sa_manager->lock_wait_ns, 0);
+	atomic64_set(&sa_manager->waits, 0);
+	atomic64_set(&sa_manager->wait_ns, 0);
+}
+
+int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
+			      struct amdgpu_sa_manager *sa_manager,
+			      unsigned size, u32 align, u32 domain)
+{
+	int r;
+
+	amdgpu_sa_bo_manager_init_cpu(sa_manager, NULL, size, align);
+	sa_manager->domain = domain;
 
 	r = amdgpu_bo_create_kernel(adev, size, align, domain, &sa_manager->bo,
 				&sa_manager->gpu_addr, &sa_manager->cpu_ptr);
@@ -74,6 +107,65 @@ int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
 	return r;
 }
 
+/**
+ * amdgpu_sa_bo_manager_init_lanes - add per ring lanes to a manager
+ *
+ * @adev: amdgpu_device pointer
+ * @sa_manager: manager to add the lanes to
+ * @num_lanes: number of lanes, usually one per ring
+ * @lane_size: size of each lane in bytes, must be a power of two
+ *
+ * Allocate one additional BO split into @num_lanes ring buffers which
+ * are used by amdgpu_sa_bo_new_lane() before falling back to the shared
+ * manager. Returns 0 on success, error on failure; the manager keeps
+ * working without lanes in the later case.
+ */
+int amdgpu_sa_bo_manager_init_lanes(struct amdgpu_device *adev,
+				    struct amdgpu_sa_manager *sa_manager,
+				    unsigned num_lanes, unsigned lane_size)
+{
+	unsigned i;
+	int r;
+
+	if (WARN_ON(!is_power_of_2(lane_size) || lane_size < sa_manager->align))
+		return -EINVAL;
+
+	sa_manager->lanes = kcalloc(num_lanes, sizeof(*sa_manager->lanes),
+				    GFP_KERNEL);
+	if (!sa_manager->lanes)
+		return -ENOMEM;
+
+	r = amdgpu_bo_create_kernel(adev, num_lanes * lane_size,
+				    sa_manager->align, sa_manager->domain,
+				    &sa_manager->lane_bo,
+				    &sa_manager->lane_gpu_addr,
+				    &sa_manager->lane_cpu_ptr);
+	if (r) {
+		dev_err(adev->dev, "(%d) failed to allocate bo for lanes\n", r);
+		kfree(sa_manager->lanes);
+		sa_manager->lanes = NULL;
+		return r;
+	}
+	memset(sa_manager->lane_cpu_ptr, 0, num_lanes * lane_size);
+
+	for (i = 0; i < num_lanes; ++i) {
+		struct amdgpu_sa_lane *lane = &sa_manager->lanes[i];
+
+		spin_lock_init(&lane->lock);
+		atomic64_set(&lane->head, 0);
+		atomic64_set(&lane->tail, 0);
+		lane->offset = i * lane_size;
+		atomic64_set(&lane->allocs, 0);
+		atomic64_set(&lane->retries, 0);
+		atomic64_set(&lane->reclaims, 0);
+		atomic64_set(&lane->blocked, 0);
+		atomic64_set(&lane->full, 0);
+	}
+	sa_manager->lane_size = lane_size;
+	sa_manager->num_lanes = num_lanes;
+	return 0;
+}
+
 void amdgpu_sa_bo_manager_fini(struct amdgpu_device *adev,
                               struct amdgpu_sa_manager *sa_manager)
 {
@@ -97,6 +189,20 @@ void amdgpu_sa_bo_manager_fini(struct amdgpu_device *adev,
 
 	amdgpu_bo_free_kernel(&sa_manager->bo, &sa_manager->gpu_addr, &sa_manager->cpu_ptr);
 	sa_manager->size = 0;
+
+	if (sa_manager->lanes) {
+		unsigned i;
+
+		for (i = 0; i < sa_manager->num_lanes; ++i)
+			amdgpu_sa_lane_fini(sa_manager, &sa_manager->lanes[i]);
+
+		amdgpu_bo_free_kernel(&sa_manager->lane_bo,
+				      &sa_manager->lane_gpu_addr,
+				      &sa_manager->lane_cpu_ptr);
+		kfree(sa_manager->lanes);
+		sa_manager->lanes = NULL;
+		sa_manager->num_lanes = 0;
+	}
 }
 
 static void amdgpu_sa_bo_remove_locked(struct amdgpu_sa_bo *sa_bo)
@@ -272,6 +378,20 @@ static bool amdgpu_sa_bo_next_hole(struct amdgpu_sa_manager *sa_manager,
 	return false;
 }
 
+static void amdgpu_sa_manager_lock(struct amdgpu_sa_manager *sa_manager)
+{
+	ktime_t start;
+
+	if (spin_trylock(&sa_manager->wq.lock))
+		return;
+
+	start = ktime_get();
+	spin_lock(&sa_manager->wq.lock);
+	atomic64_inc(&sa_manager->contended);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &sa_manager->lock_wait_ns);
+}
+
 int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 		     struct amdgpu_sa_bo **sa_bo,
 		     unsigned size, unsigned align)
@@ -279,6 +399,7 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 	struct dma_fence *fences[AMDGPU_SA_NUM_FENCE_LISTS];
 	unsigned tries[AMDGPU_SA_NUM_FENCE_LISTS];
 	unsigned count;
+	ktime_t start;
 	int i, r;
 	signed long t;
 
@@ -292,11 +413,13 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 	if (!(*sa_bo))
 		return -ENOMEM;
 	(*sa_bo)->manager = sa_manager;
+	(*sa_bo)->lane = NULL;
 	(*sa_bo)->fence = NULL;
 	INIT_LIST_HEAD(&(*sa_bo)->olist);
 	INIT_LIST_HEAD(&(*sa_bo)->flist);
 
-	spin_lock(&sa_manager->wq.lock);
+	atomic64_inc(&sa_manager->allocs);
+	amdgpu_sa_manager_lock(sa_manager);
 	do {
 		for (i = 0; i < AMDGPU_SA_NUM_FENCE_LISTS; ++i)
 			tries[i] = 0;
@@ -317,6 +440,7 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 			if (fences[i])
 				fences[count++] = dma_fence_get(fences[i]);
 
+		start = ktime_get();
 		if (count) {
 			spin_unlock(&sa_manager->wq.lock);
 			t = dma_fence_wait_any_timeout(fences, count, false,
@@ -326,7 +450,7 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 				dma_fence_put(fences[i]);
 
 			r = (t > 0) ? 0 : t;
-			spin_lock(&sa_manager->wq.lock);
+			amdgpu_sa_manager_lock(sa_manager);
 		} else {
 			/* if we have nothing to wait for block */
 			r = wait_event_interruptible_locked(
@@ -334,6 +458,9 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 				amdgpu_sa_event(sa_manager, size, align)
 			);
 		}
+		atomic64_inc(&sa_manager->waits);
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &sa_manager->wait_ns);
 
 	} while (!r);
 
@@ -343,6 +470,183 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 	return r;
 }
 
+/**
+ * amdgpu_sa_lane_reclaim - advance the tail of a lane
+ *
+ * @lane: the lane to reclaim space from
+ *
+ * Release all the allocations at the tail of the lane which are freed and
+ * whose fence has signaled. Space can only be given back contiguously, so
+ * this stops at the first allocation which is still in use even if newer
+ * ones have already signaled. Returns true if any space was reclaimed.
+ */
+static bool amdgpu_sa_lane_reclaim(struct amdgpu_sa_lane *lane)
+{
+	uint32_t seq, pos, head_seq;
+	bool progress = false;
+	uint64_t tail;
+
+	spin_lock(&lane->lock);
+	tail = atomic64_read(&lane->tail);
+	seq = upper_32_bits(tail);
+	pos = lower_32_bits(tail);
+	head_seq = upper_32_bits(atomic64_read(&lane->head));
+
+	while (seq != head_seq) {
+		unsigned idx = seq % AMDGPU_SA_LANE_ENTRIES;
+		struct amdgpu_sa_bo *sa_bo;
+
+		sa_bo = smp_load_acquire(&lane->entries[idx]);
+		if (!sa_bo || !smp_load_acquire(&sa_bo->lane_freed))
+			break;
+
+		if (sa_bo->fence && !dma_fence_is_signaled(sa_bo->fence)) {
+			atomic64_inc(&lane->blocked);
+			break;
+		}
+
+		pos = sa_bo->lane_end;
+		WRITE_ONCE(lane->entries[idx], NULL);
+		dma_fence_put(sa_bo->fence);
+		kfree(sa_bo);
+		++seq;
+		progress = true;
+	}
+
+	if (progress) {
+		/* entries must be cleared before the slots are handed out */
+		smp_wmb();
+		atomic64_set(&lane->tail, ((uint64_t)seq << 32) | pos);
+		atomic64_inc(&lane->reclaims);
+	}
+	spin_unlock(&lane->lock);
+
+	return progress;
+}
+
+static bool amdgpu_sa_lane_try_alloc(struct amdgpu_sa_manager *sa_manager,
+				     struct amdgpu_sa_lane *lane,
+				     struct amdgpu_sa_bo *sa_bo,
+				     unsigned size, unsigned align)
+{
+	uint32_t mask = sa_manager->lane_size - 1;
+	uint32_t seq, pos, start, tail_seq, tail_pos;
+	uint64_t head, tail, new_head;
+	bool reclaimed = false;
+
+	while (true) {
+		head = atomic64_read(&lane->head);
+		tail = atomic64_read(&lane->tail);
+		seq = upper_32_bits(head);
+		pos = lower_32_bits(head);
+		tail_seq = upper_32_bits(tail);
+		tail_pos = lower_32_bits(tail);
+
+		start = pos + (align - ((pos & mask) % align)) % align;
+		/* never straddle the end of the lane, skip to its beginning */
+		if ((start & mask) + size > sa_manager->lane_size)
+			start = (pos | mask) + 1;
+
+		if ((seq - tail_seq) >= AMDGPU_SA_LANE_ENTRIES ||
+		    (start + size - tail_pos) > sa_manager->lane_size) {
+			if (reclaimed || !amdgpu_sa_lane_reclaim(lane)) {
+				atomic64_inc(&lane->full);
+				return false;
+			}
+			reclaimed = true;
+			continue;
+		}
+
+		new_head = ((uint64_t)(seq + 1) << 32) | (start + size);
+		if (atomic64_cmpxchg(&lane->head, head, new_head) == head)
+			break;
+
+		atomic64_inc(&lane->retries);
+	}
+
+	sa_bo->manager = sa_manager;
+	sa_bo->lane = lane;
+	sa_bo->soffset = lane->offset + (start & mask);
+	sa_bo->eoffset = sa_bo->soffset + size;
+	sa_bo->lane_end = start + size;
+	sa_bo->lane_freed = false;
+	sa_bo->fence = NULL;
+	INIT_LIST_HEAD(&sa_bo->olist);
+	INIT_LIST_HEAD(&sa_bo->flist);
+
+	/* publish the entry only after it is fully initialized */
+	smp_store_release(&lane->entries[seq % AMDGPU_SA_LANE_ENTRIES], sa_bo);
+	atomic64_inc(&lane->allocs);
+	return true;
+}
+
+/**
+ * amdgpu_sa_bo_new_lane - sub-allocate from a per ring lane
+ *
+ * @sa_manager: manager to allocate from
+ * @lane: index of the lane, usually the ring index
+ * @sa_bo: resulting sub allocation
+ * @size: number of bytes to allocate
+ * @align: alignment of the allocation
+ *
+ * Try the lock-free lane first and fall back to amdgpu_sa_bo_new() when
+ * lanes are disabled or the lane is exhausted. Space from a lane must only
+ * be freed with a fence of the ring the lane belongs to.
+ */
+int amdgpu_sa_bo_new_lane(struct amdgpu_sa_manager *sa_manager,
+			  unsigned lane, struct amdgpu_sa_bo **sa_bo,
+			  unsigned size, unsigned align)
+{
+	if (!sa_manager->lanes || lane >= sa_manager->num_lanes ||
+	    size > sa_manager->lane_size)
+		return amdgpu_sa_bo_new(sa_manager, sa_bo, size, align);
+
+	if (WARN_ON_ONCE(align > sa_manager->align))
+		return -EINVAL;
+
+	*sa_bo = kmalloc(sizeof(struct amdgpu_sa_bo), GFP_KERNEL);
+	if (!(*sa_bo))
+		return -ENOMEM;
+
+	if (amdgpu_sa_lane_try_alloc(sa_manager, &sa_manager->lanes[lane],
+				     *sa_bo, size, align))
+		return 0;
+
+	kfree(*sa_bo);
+	return amdgpu_sa_bo_new(sa_manager, sa_bo, size, align);
+}
+
+static void amdgpu_sa_lane_free(struct amdgpu_sa_bo *sa_bo,
+				struct dma_fence *fence)
+{
+	if (fence && !dma_fence_is_signaled(fence))
+		sa_bo->fence = dma_fence_get(fence);
+
+	/* the reclaim runs lazily from the next allocation on the lane */
+	smp_store_release(&sa_bo->lane_freed, true);
+}
+
+static void amdgpu_sa_lane_fini(struct amdgpu_sa_manager *sa_manager,
+				struct amdgpu_sa_lane *lane)
+{
+	unsigned i;
+
+	amdgpu_sa_lane_reclaim(lane);
+	if (atomic64_read(&lane->tail) != atomic64_read(&lane->head))
+		DRM_ERROR("sa_manager lane is not empty, clearing anyway\n");
+
+	for (i = 0; i < AMDGPU_SA_LANE_ENTRIES; ++i) {
+		struct amdgpu_sa_bo *sa_bo = lane->entries[i];
+
+		if (!sa_bo)
+			continue;
+
+		dma_fence_put(sa_bo->fence);
+		kfree(sa_bo);
+		lane->entries[i] = NULL;
+	}
+}
+
 void amdgpu_sa_bo_free(struct amdgpu_device *adev, struct amdgpu_sa_bo **sa_bo,
 		       struct dma_fence *fence)
 {
@@ -352,8 +656,14 @@ void amdgpu_sa_bo_free(struct amdgpu_device *adev, struct amdgpu_sa_bo **sa_bo,
 		return;
 	}
 
+	if ((*sa_bo)->lane) {
+		amdgpu_sa_lane_free(*sa_bo, fence);
+		*sa_bo = NULL;
+		return;
+	}
+
 	sa_manager = (*sa_bo)->manager;
-	spin_lock(&sa_manager->wq.lock);
+	amdgpu_sa_manager_lock(sa_manager);
 	if (fence && !dma_fence_is_signaled(fence)) {
 		uint32_t idx;
 
@@ -395,4 +705,34 @@ void amdgpu_sa_bo_dump_debug_info(struct amdgpu_sa_manager *sa_manager,
 	}
 	spin_unlock(&sa_manager->wq.lock);
 }
+
+void amdgpu_sa_bo_dump_stats(struct amdgpu_sa_manager *sa_manager,
+			     struct seq_file *m)
+{
+	unsigned i;
+
+	seq_printf(m, "shared: allocs %lld contended %lld lock wait %lld us "
+		   "waits %lld wait %lld us\n",
+		   (long long)atomic64_read(&sa_manager->allocs),
+		   (long long)atomic64_read(&sa_manager->contended),
+		   (long long)atomic64_read(&sa_manager->lock_wait_ns) / 1000,
+		   (long long)atomic64_read(&sa_manager->waits),
+		   (long long)atomic64_read(&sa_manager->wait_ns) / 1000);
+
+	for (i = 0; i < sa_manager->num_lanes; ++i) {
+		struct amdgpu_sa_lane *lane = &sa_manager->lanes[i];
+
+		if (!atomic64_read(&lane->allocs) &&
+		    !atomic64_read(&lane->full))
+			continue;
+
+		seq_printf(m, "lane %2u: allocs %lld retries %lld reclaims %lld "
+			   "blocked %lld full %lld\n", i,
+			   (long long)atomic64_read(&lane->allocs),
+			   (long long)atomic64_read(&lane->retries),
+			   (long long)atomic64_read(&lane->reclaims),
+			   (long long)atomic64_read(&lane->blocked),
+			   (long long)atomic64_read(&lane->full));
+	}
+}
 #endif
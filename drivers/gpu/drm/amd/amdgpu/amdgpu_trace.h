@@ -444,6 +444,24 @@ TRACE_EVENT(amdgpu_cs_bo_status,
 			__entry->total_bo, __entry->total_size)
 );
 
+TRACE_EVENT(amdgpu_cs_bo_validate,
+	    TP_PROTO(struct amdgpu_bo *bo, uint32_t domain),
+	    TP_ARGS(bo, domain),
+	    TP_STRUCT__entry(
+			__field(struct amdgpu_bo *, bo)
+			__field(u32, pages)
+			__field(u32, domain)
+			),
+
+	    TP_fast_assign(
+			__entry->bo = bo;
+			__entry->pages = bo->tbo.num_pages;
+			__entry->domain = domain;
+			),
+	    TP_printk("bo=%p, pages=%u, domain=0x%x",
+			__entry->bo, __entry->pages, __entry->domain)
+);
+
 TRACE_EVENT(amdgpu_bo_move,
 	    TP_PROTO(struct amdgpu_bo* bo, uint32_t new_placement, uint32_t old_placement),
 	    TP_ARGS(bo, new_placement, old_placement),
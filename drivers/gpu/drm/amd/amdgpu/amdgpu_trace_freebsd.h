@@ -36,6 +36,13 @@ trace_amdgpu_bo_move(struct amdgpu_bo* bo, uint32_t new, uint32_t old)
 	CTR3(KTR_DRM, "amdgpu_bo_move %p %u %u", bo, new, old);
 }
 
+static inline void
+trace_amdgpu_cs_bo_validate(struct amdgpu_bo *bo, uint32_t domain)
+{
+	CTR3(KTR_DRM, "amdgpu_cs_bo_validate bo=%p pages=%u domain=0x%x", bo,
+	    (u_int)bo->tbo.num_pages, domain);
+}
+
 static inline void
 trace_amdgpu_bo_list_set(void *a, void *b) {
 	CTR2(KTR_DRM, "amdgpu_bo_list_set %p %p", a, b);
@@ -115,6 +115,17 @@ static int amdgpu_init_mem_type(struct ttm_bo_device *bdev, uint32_t type,
 			     TTM_MEMTYPE_FLAG_MAPPABLE;
 		man->available_caching = TTM_PL_FLAG_UNCACHED | TTM_PL_FLAG_WC;
 		man->default_caching = TTM_PL_FLAG_WC;
+		switch (amdgpu_vram_evict_policy) {
+		case 1:
+			man->evict_policy = &ttm_evict_policy_size;
+			break;
+		case 2:
+			man->evict_policy = &ttm_evict_policy_clock;
+			break;
+		default:
+			man->evict_policy = &ttm_evict_policy_lru;
+			break;
+		}
 		break;
 	case AMDGPU_PL_GDS:
 	case AMDGPU_PL_GWS:
@@ -2175,12 +2186,24 @@ static int amdgpu_mm_dump_table(struct seq_file *m, void *data)
 	return 0;
 }
 
+static int amdgpu_ttm_lru_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct drm_printer p = drm_seq_file_printer(m);
+
+	ttm_bo_lru_debug(&adev->mman.bdev, &p);
+	return 0;
+}
+
 static const struct drm_info_list amdgpu_ttm_debugfs_list[] = {
 	{"amdgpu_vram_mm", amdgpu_mm_dump_table, 0, (void *)TTM_PL_VRAM},
 	{"amdgpu_gtt_mm", amdgpu_mm_dump_table, 0, (void *)TTM_PL_TT},
 	{"amdgpu_gds_mm", amdgpu_mm_dump_table, 0, (void *)AMDGPU_PL_GDS},
 	{"amdgpu_gws_mm", amdgpu_mm_dump_table, 0, (void *)AMDGPU_PL_GWS},
 	{"amdgpu_oa_mm", amdgpu_mm_dump_table, 0, (void *)AMDGPU_PL_OA},
+	{"amdgpu_ttm_lru", amdgpu_ttm_lru_info, 0, NULL},
 	{"ttm_page_pool", ttm_page_alloc_debugfs, 0, NULL},
 #ifdef CONFIG_SWIOTLB
 	{"ttm_dma_page_pool", ttm_dma_page_alloc_debugfs, 0, NULL}
@@ -600,21 +600,21 @@ void amdgpu_vm_del_from_lru_notify(struct ttm_buffer_object *bo)
 void amdgpu_vm_move_to_lru_tail(struct amdgpu_device *adev,
 				struct amdgpu_vm *vm)
 {
-	struct ttm_bo_global *glob = adev->mman.bdev.glob;
+	struct ttm_bo_device *bdev = &adev->mman.bdev;
 	struct amdgpu_vm_bo_base *bo_base;
 
 #if 0
 	if (vm->bulk_moveable) {
-		spin_lock(&glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 		ttm_bo_bulk_move_lru_tail(&vm->lru_bulk_move);
-		spin_unlock(&glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 		return;
 	}
 #endif
 
 	memset(&vm->lru_bulk_move, 0, sizeof(vm->lru_bulk_move));
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	list_for_each_entry(bo_base, &vm->idle, vm_status) {
 		struct amdgpu_bo *bo = bo_base->bo;
 
@@ -626,7 +626,7 @@ void amdgpu_vm_move_to_lru_tail(struct amdgpu_device *adev,
 			ttm_bo_move_to_lru_tail(&bo->shadow->tbo,
 						&vm->lru_bulk_move);
 	}
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	vm->bulk_moveable = true;
 }
@@ -2673,8 +2673,10 @@ int amdgpu_vm_init(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	int r, i;
 
 	vm->va = RB_ROOT_CACHED;
-	for (i = 0; i < AMDGPU_MAX_VMHUBS; i++)
+	for (i = 0; i < AMDGPU_MAX_VMHUBS; i++) {
 		vm->reserved_vmid[i] = NULL;
+		vm->vmid_affinity[i] = NULL;
+	}
 	INIT_LIST_HEAD(&vm->evicted);
 	INIT_LIST_HEAD(&vm->relocated);
 	INIT_LIST_HEAD(&vm->moved);
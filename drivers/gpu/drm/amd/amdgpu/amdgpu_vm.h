@@ -259,6 +259,8 @@ struct amdgpu_vm {
 	unsigned int		pasid;
 	/* dedicated to vm */
 	struct amdgpu_vmid	*reserved_vmid[AMDGPU_MAX_VMHUBS];
+	/* VMID used by the last submission on each hub */
+	struct amdgpu_vmid	*vmid_affinity[AMDGPU_MAX_VMHUBS];
 
 	/* Flag to indicate if VM tables are updated by CPU or GPU (SDMA) */
 	bool					use_cpu_for_update;
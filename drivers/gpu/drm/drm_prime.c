@@ -28,7 +28,8 @@
 
 #include <linux/export.h>
 #include <linux/dma-buf.h>
-#include <linux/rbtree.h>
+#include <linux/hash.h>
+#include <linux/mm.h>
 
 #include <drm/drm_drv.h>
 #include <drm/drm_file.h>
@@ -85,15 +86,92 @@ struct drm_prime_member {
 	struct dma_buf *dma_buf;
 	uint32_t handle;
 
-	struct rb_node dmabuf_rb;
-	struct rb_node handle_rb;
+	struct hlist_node dmabuf_node;
+	struct hlist_node handle_node;
 };
 
+/*
+ * Both caches are chained hash tables of 1 << bits buckets, allocated on
+ * first use and doubled whenever they would exceed one member per bucket,
+ * so that lookups stay O(1) for files holding thousands of buffers.
+ */
+#define DRM_PRIME_HASH_MIN_BITS	4
+
+static struct hlist_head *
+drm_prime_dmabuf_bucket(struct drm_prime_file_private *prime_fpriv,
+			struct dma_buf *dma_buf)
+{
+	return &prime_fpriv->dmabufs[hash_long((unsigned long)dma_buf,
+					       prime_fpriv->bits)];
+}
+
+static struct hlist_head *
+drm_prime_handle_bucket(struct drm_prime_file_private *prime_fpriv,
+			uint32_t handle)
+{
+	return &prime_fpriv->handles[hash_32(handle, prime_fpriv->bits)];
+}
+
+static int drm_prime_hash_grow(struct drm_prime_file_private *prime_fpriv)
+{
+	struct hlist_head *dmabufs, *handles, *old_dmabufs;
+	struct drm_prime_member *member;
+	struct hlist_node *tmp;
+	unsigned int bits, i, old_size;
+
+	if (prime_fpriv->dmabufs &&
+	    prime_fpriv->count < (1U << prime_fpriv->bits))
+		return 0;
+
+	bits = prime_fpriv->dmabufs ? prime_fpriv->bits + 1 :
+				      DRM_PRIME_HASH_MIN_BITS;
+	dmabufs = kvmalloc_array(1U << bits, sizeof(*dmabufs), GFP_KERNEL);
+	handles = kvmalloc_array(1U << bits, sizeof(*handles), GFP_KERNEL);
+	if (!dmabufs || !handles) {
+		kvfree(dmabufs);
+		kvfree(handles);
+		/* Longer chains are fine, only the first table is required */
+		return prime_fpriv->dmabufs ? 0 : -ENOMEM;
+	}
+
+	for (i = 0; i < (1U << bits); i++) {
+		INIT_HLIST_HEAD(&dmabufs[i]);
+		INIT_HLIST_HEAD(&handles[i]);
+	}
+
+	old_dmabufs = prime_fpriv->dmabufs;
+	old_size = old_dmabufs ? 1U << prime_fpriv->bits : 0;
+	kvfree(prime_fpriv->handles);
+	prime_fpriv->dmabufs = dmabufs;
+	prime_fpriv->handles = handles;
+	prime_fpriv->bits = bits;
+
+	/* Every member sits on exactly one dma_buf chain */
+	for (i = 0; i < old_size; i++) {
+		hlist_for_each_entry_safe(member, tmp, &old_dmabufs[i],
+					  dmabuf_node) {
+			hlist_add_head(&member->dmabuf_node,
+				       drm_prime_dmabuf_bucket(prime_fpriv,
+							       member->dma_buf));
+			hlist_add_head(&member->handle_node,
+				       drm_prime_handle_bucket(prime_fpriv,
+							       member->handle));
+		}
+	}
+	kvfree(old_dmabufs);
+
+	return 0;
+}
+
 static int drm_prime_add_buf_handle(struct drm_prime_file_private *prime_fpriv,
 				    struct dma_buf *dma_buf, uint32_t handle)
 {
 	struct drm_prime_member *member;
-	struct rb_node **p, *rb;
+	int ret;
+
+	ret = drm_prime_hash_grow(prime_fpriv);
+	if (ret)
+		return ret;
 
 	member = kmalloc(sizeof(*member), GFP_KERNEL);
 	if (!member)
@@ -103,35 +181,11 @@ static int drm_prime_add_buf_handle(struct drm_prime_file_private *prime_fpriv,
 	member->dma_buf = dma_buf;
 	member->handle = handle;
 
-	rb = NULL;
-	p = &prime_fpriv->dmabufs.rb_node;
-	while (*p) {
-		struct drm_prime_member *pos;
-
-		rb = *p;
-		pos = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
-		if (dma_buf > pos->dma_buf)
-			p = &rb->rb_right;
-		else
-			p = &rb->rb_left;
-	}
-	rb_link_node(&member->dmabuf_rb, rb, p);
-	rb_insert_color(&member->dmabuf_rb, &prime_fpriv->dmabufs);
-
-	rb = NULL;
-	p = &prime_fpriv->handles.rb_node;
-	while (*p) {
-		struct drm_prime_member *pos;
-
-		rb = *p;
-		pos = rb_entry(rb, struct drm_prime_member, handle_rb);
-		if (handle > pos->handle)
-			p = &rb->rb_right;
-		else
-			p = &rb->rb_left;
-	}
-	rb_link_node(&member->handle_rb, rb, p);
-	rb_insert_color(&member->handle_rb, &prime_fpriv->handles);
+	hlist_add_head(&member->dmabuf_node,
+		       drm_prime_dmabuf_bucket(prime_fpriv, dma_buf));
+	hlist_add_head(&member->handle_node,
+		       drm_prime_handle_bucket(prime_fpriv, handle));
+	prime_fpriv->count++;
 
 	return 0;
 }
@@ -139,19 +193,15 @@ static int drm_prime_add_buf_handle(struct drm_prime_file_private *prime_fpriv,
 static struct dma_buf *drm_prime_lookup_buf_by_handle(struct drm_prime_file_private *prime_fpriv,
 						      uint32_t handle)
 {
-	struct rb_node *rb;
+	struct drm_prime_member *member;
 
-	rb = prime_fpriv->handles.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	if (!prime_fpriv->handles)
+		return NULL;
 
-		member = rb_entry(rb, struct drm_prime_member, handle_rb);
+	hlist_for_each_entry(member, drm_prime_handle_bucket(prime_fpriv, handle),
+			     handle_node) {
 		if (member->handle == handle)
 			return member->dma_buf;
-		else if (member->handle < handle)
-			rb = rb->rb_right;
-		else
-			rb = rb->rb_left;
 	}
 
 	return NULL;
@@ -161,20 +211,16 @@ static int drm_prime_lookup_buf_handle(struct drm_prime_file_private *prime_fpri
 				       struct dma_buf *dma_buf,
 				       uint32_t *handle)
 {
-	struct rb_node *rb;
+	struct drm_prime_member *member;
 
-	rb = prime_fpriv->dmabufs.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	if (!prime_fpriv->dmabufs)
+		return -ENOENT;
 
-		member = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
+	hlist_for_each_entry(member, drm_prime_dmabuf_bucket(prime_fpriv, dma_buf),
+			     dmabuf_node) {
 		if (member->dma_buf == dma_buf) {
 			*handle = member->handle;
 			return 0;
-		} else if (member->dma_buf < dma_buf) {
-			rb = rb->rb_right;
-		} else {
-			rb = rb->rb_left;
 		}
 	}
 
@@ -220,24 +266,21 @@ EXPORT_SYMBOL(drm_gem_map_detach);
 void drm_prime_remove_buf_handle_locked(struct drm_prime_file_private *prime_fpriv,
 					struct dma_buf *dma_buf)
 {
-	struct rb_node *rb;
+	struct drm_prime_member *member;
 
-	rb = prime_fpriv->dmabufs.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	if (!prime_fpriv->dmabufs)
+		return;
 
-		member = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
+	hlist_for_each_entry(member, drm_prime_dmabuf_bucket(prime_fpriv, dma_buf),
+			     dmabuf_node) {
 		if (member->dma_buf == dma_buf) {
-			rb_erase(&member->handle_rb, &prime_fpriv->handles);
-			rb_erase(&member->dmabuf_rb, &prime_fpriv->dmabufs);
+			hlist_del(&member->handle_node);
+			hlist_del(&member->dmabuf_node);
+			prime_fpriv->count--;
 
 			dma_buf_put(dma_buf);
 			kfree(member);
 			return;
-		} else if (member->dma_buf < dma_buf) {
-			rb = rb->rb_right;
-		} else {
-			rb = rb->rb_left;
 		}
 	}
 }
@@ -421,9 +464,7 @@ int drm_gem_dmabuf_mmap(struct dma_buf *dma_buf, struct vm_area_struct *vma)
 EXPORT_SYMBOL(drm_gem_dmabuf_mmap);
 
 static const struct dma_buf_ops drm_gem_prime_dmabuf_ops =  {
-#ifdef __linux__
 	.cache_sgt_mapping = true,
-#endif
 	.attach = drm_gem_map_attach,
 	.detach = drm_gem_map_detach,
 	.map_dma_buf = drm_gem_map_dma_buf,
@@ -965,8 +1006,10 @@ EXPORT_SYMBOL(drm_prime_gem_destroy);
 void drm_prime_init_file_private(struct drm_prime_file_private *prime_fpriv)
 {
 	mutex_init(&prime_fpriv->lock);
-	prime_fpriv->dmabufs = RB_ROOT;
-	prime_fpriv->handles = RB_ROOT;
+	prime_fpriv->dmabufs = NULL;
+	prime_fpriv->handles = NULL;
+	prime_fpriv->bits = 0;
+	prime_fpriv->count = 0;
 }
 
 void drm_prime_destroy_file_private(struct drm_prime_file_private *prime_fpriv)
@@ -975,5 +1018,7 @@ void drm_prime_destroy_file_private(struct drm_prime_file_private *prime_fpriv)
 	mutex_destroy(&prime_fpriv->lock);
 #endif
 	/* by now drm_gem_release should've made sure the list is empty */
-	WARN_ON(!RB_EMPTY_ROOT(&prime_fpriv->dmabufs));
+	WARN_ON(prime_fpriv->count != 0);
+	kvfree(prime_fpriv->dmabufs);
+	kvfree(prime_fpriv->handles);
 }
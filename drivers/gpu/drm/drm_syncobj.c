@@ -49,9 +49,11 @@
 #include <linux/anon_inodes.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/poll.h>
 #include <linux/sched/signal.h>
 #include <linux/sync_file.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
 
 #include <drm/drm_drv.h>
 #include <drm/drm_file.h>
@@ -64,13 +66,36 @@
 struct syncobj_wait_entry {
 	struct list_head node;
 	struct task_struct *task;
+	struct syncobj_wait_file *file;
 	struct dma_fence *fence;
 	struct dma_fence_cb fence_cb;
 	u64    point;
 };
 
+/*
+ * Backing state of a DRM_IOCTL_SYNCOBJ_WAIT_FD file descriptor.  The
+ * entries use the same callbacks as drm_syncobj_array_wait_timeout(), but
+ * instead of waking a sleeping task they count signaled entries and wake
+ * pollers once @needed of them have signaled.
+ */
+struct syncobj_wait_file {
+	struct drm_syncobj **syncobjs;
+	struct syncobj_wait_entry *entries;
+	unsigned long *armed;		/* entries past fence lookup */
+	uint32_t count;
+	uint32_t flags;
+	uint32_t needed;
+	atomic_t signaled;
+	uint32_t first_signaled;
+	struct mutex lock;		/* serializes arming */
+	struct work_struct work;	/* arms entries that got a fence */
+	wait_queue_head_t wq;
+};
+
 static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 				      struct syncobj_wait_entry *wait);
+static void syncobj_wait_file_signal(struct syncobj_wait_file *wf,
+				     struct syncobj_wait_entry *wait);
 
 /**
  * drm_syncobj_find - lookup and reference a sync object.
@@ -768,7 +793,10 @@ static void syncobj_wait_fence_func(struct dma_fence *fence,
 	struct syncobj_wait_entry *wait =
 		container_of(cb, struct syncobj_wait_entry, fence_cb);
 
-	wake_up_process(wait->task);
+	if (wait->file)
+		syncobj_wait_file_signal(wait->file, wait);
+	else
+		wake_up_process(wait->task);
 }
 
 static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
@@ -789,7 +817,10 @@ static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 		wait->fence = fence;
 	}
 
-	wake_up_process(wait->task);
+	if (wait->file)
+		schedule_work(&wait->file->work);
+	else
+		wake_up_process(wait->task);
 	list_del_init(&wait->node);
 }
 
@@ -1326,3 +1357,284 @@ int drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
 
 	return ret;
 }
+
+static bool syncobj_wait_file_ready(struct syncobj_wait_file *wf)
+{
+	return atomic_read(&wf->signaled) >= wf->needed;
+}
+
+/* Called once per entry, possibly from the fence signaling irq. */
+static void syncobj_wait_file_signal(struct syncobj_wait_file *wf,
+				     struct syncobj_wait_entry *wait)
+{
+	cmpxchg(&wf->first_signaled, ~0u, (uint32_t)(wait - wf->entries));
+	if (atomic_inc_return(&wf->signaled) == wf->needed)
+		wake_up_all(&wf->wq);
+}
+
+/*
+ * Install fence callbacks on all entries that have a fence and were not
+ * handled yet.  Entries without a fence only exist with WAIT_FOR_SUBMIT,
+ * syncobj_wait_syncobj_func() queues wf->work once they get one.
+ */
+static void syncobj_wait_file_arm(struct syncobj_wait_file *wf)
+{
+	struct syncobj_wait_entry *wait;
+	uint32_t i;
+
+	mutex_lock(&wf->lock);
+	for (i = 0; i < wf->count; ++i) {
+		wait = &wf->entries[i];
+		if (test_bit(i, wf->armed) || !READ_ONCE(wait->fence))
+			continue;
+
+		__set_bit(i, wf->armed);
+		if ((wf->flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
+		    dma_fence_add_callback(wait->fence, &wait->fence_cb,
+					   syncobj_wait_fence_func))
+			syncobj_wait_file_signal(wf, wait);
+	}
+	mutex_unlock(&wf->lock);
+}
+
+static void syncobj_wait_file_work(struct work_struct *work)
+{
+	struct syncobj_wait_file *wf =
+		container_of(work, struct syncobj_wait_file, work);
+
+	syncobj_wait_file_arm(wf);
+}
+
+static void syncobj_wait_file_free(struct syncobj_wait_file *wf)
+{
+	uint32_t i;
+
+	if (!wf->entries || !wf->armed)
+		goto out;
+
+	/* Once off the syncobj lists nothing queues the work anymore. */
+	for (i = 0; i < wf->count; ++i)
+		drm_syncobj_remove_wait(wf->syncobjs[i], &wf->entries[i]);
+	cancel_work_sync(&wf->work);
+
+	for (i = 0; i < wf->count; ++i) {
+		if (test_bit(i, wf->armed) && wf->entries[i].fence_cb.func)
+			dma_fence_remove_callback(wf->entries[i].fence,
+						  &wf->entries[i].fence_cb);
+		dma_fence_put(wf->entries[i].fence);
+	}
+
+out:
+	drm_syncobj_array_free(wf->syncobjs, wf->count);
+	mutex_destroy(&wf->lock);
+	kfree(wf->armed);
+	kvfree(wf->entries);
+	kfree(wf);
+}
+
+static int drm_syncobj_wait_file_release(struct inode *inode,
+					 struct file *file)
+{
+	syncobj_wait_file_free(file->private_data);
+	return 0;
+}
+
+static __poll_t drm_syncobj_wait_file_poll(struct file *file,
+					   struct poll_table_struct *wait)
+{
+	struct syncobj_wait_file *wf = file->private_data;
+
+	poll_wait(file, &wf->wq, wait);
+	if (syncobj_wait_file_ready(wf))
+#ifdef __linux__
+		return EPOLLIN | EPOLLRDNORM;
+#elif defined(__FreeBSD__)
+		return POLLIN | POLLRDNORM;
+#endif
+
+	return 0;
+}
+
+static ssize_t drm_syncobj_wait_file_read(struct file *file, char __user *buf,
+					  size_t count, loff_t *offset)
+{
+	struct syncobj_wait_file *wf = file->private_data;
+	uint32_t first;
+	int ret;
+
+	if (count < sizeof(first))
+		return -EINVAL;
+
+	if (!syncobj_wait_file_ready(wf)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(wf->wq,
+					       syncobj_wait_file_ready(wf));
+		if (ret)
+			return ret;
+	}
+
+	first = READ_ONCE(wf->first_signaled);
+	if (copy_to_user(buf, &first, sizeof(first)))
+		return -EFAULT;
+
+	return sizeof(first);
+}
+
+static const struct file_operations drm_syncobj_wait_file_fops = {
+	.release = drm_syncobj_wait_file_release,
+	.poll = drm_syncobj_wait_file_poll,
+	.read = drm_syncobj_wait_file_read,
+};
+
+static int drm_syncobj_wait_file_create(struct drm_syncobj **syncobjs,
+					void __user *user_points,
+					uint32_t count, uint32_t flags,
+					int *p_fd)
+{
+	struct syncobj_wait_file *wf;
+	struct file *file;
+	uint64_t *points;
+	uint32_t i;
+	int fd, ret;
+
+	wf = kzalloc(sizeof(*wf), GFP_KERNEL);
+	if (!wf) {
+		drm_syncobj_array_free(syncobjs, count);
+		return -ENOMEM;
+	}
+
+	wf->syncobjs = syncobjs;
+	wf->count = count;
+	wf->flags = flags;
+	wf->needed = (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL) ? count : 1;
+	wf->first_signaled = ~0u;
+	atomic_set(&wf->signaled, 0);
+	mutex_init(&wf->lock);
+	INIT_WORK(&wf->work, syncobj_wait_file_work);
+	init_waitqueue_head(&wf->wq);
+
+	wf->entries = kvmalloc_array(count, sizeof(*wf->entries),
+				     GFP_KERNEL | __GFP_ZERO);
+	wf->armed = kcalloc(BITS_TO_LONGS(count), sizeof(unsigned long),
+			    GFP_KERNEL);
+	points = kvmalloc_array(count, sizeof(*points),
+				GFP_KERNEL | __GFP_ZERO);
+	if (!wf->entries || !wf->armed || !points) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	if (user_points &&
+	    copy_from_user(points, user_points, sizeof(uint64_t) * count)) {
+		ret = -EFAULT;
+		goto err_free;
+	}
+
+	/* Same lookup rules as drm_syncobj_array_wait_timeout(). */
+	for (i = 0; i < count; ++i) {
+		struct dma_fence *fence;
+
+		wf->entries[i].file = wf;
+		wf->entries[i].point = points[i];
+		fence = drm_syncobj_fence_get(syncobjs[i]);
+		if (!fence || dma_fence_chain_find_seqno(&fence, points[i])) {
+			dma_fence_put(fence);
+			if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
+				continue;
+			} else {
+				ret = -EINVAL;
+				goto err_free;
+			}
+		}
+
+		if (fence)
+			wf->entries[i].fence = fence;
+		else
+			wf->entries[i].fence = dma_fence_get_stub();
+	}
+
+	if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
+		for (i = 0; i < count; ++i)
+			drm_syncobj_fence_add_wait(syncobjs[i], &wf->entries[i]);
+	}
+
+	syncobj_wait_file_arm(wf);
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0) {
+		ret = fd;
+		goto err_free;
+	}
+
+	file = anon_inode_getfile("syncobj_wait_file",
+				  &drm_syncobj_wait_file_fops,
+				  wf, O_RDONLY);
+	if (IS_ERR(file)) {
+		put_unused_fd(fd);
+		ret = PTR_ERR(file);
+		goto err_free;
+	}
+
+	fd_install(fd, file);
+	kvfree(points);
+
+	*p_fd = fd;
+	return 0;
+
+err_free:
+	kvfree(points);
+	syncobj_wait_file_free(wf);
+	return ret;
+}
+
+/**
+ * drm_syncobj_wait_fd_ioctl - wait on a syncobj array through a file
+ * @dev: drm device
+ * @data: &struct drm_syncobj_wait_fd
+ * @file_private: drm file the handles belong to
+ *
+ * Like DRM_IOCTL_SYNCOBJ_TIMELINE_WAIT, but instead of blocking this returns
+ * a file descriptor that becomes readable once the wait completes, so that
+ * userspace can multiplex syncobj waits with other I/O in an event loop.
+ * The file keeps references to the syncobjs, not to their handles.
+ */
+int
+drm_syncobj_wait_fd_ioctl(struct drm_device *dev, void *data,
+			  struct drm_file *file_private)
+{
+	struct drm_syncobj_wait_fd *args = data;
+	struct drm_syncobj **syncobjs;
+	int ret;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -EOPNOTSUPP;
+
+	if (args->points &&
+	    !drm_core_check_feature(dev, DRIVER_SYNCOBJ_TIMELINE))
+		return -EOPNOTSUPP;
+
+	if (args->flags & ~(DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL |
+			    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT |
+			    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE))
+		return -EINVAL;
+
+	if (args->pad != 0)
+		return -EINVAL;
+
+	if (args->count_handles == 0)
+		return -EINVAL;
+
+	ret = drm_syncobj_array_find(file_private,
+				     u64_to_user_ptr(args->handles),
+				     args->count_handles,
+				     &syncobjs);
+	if (ret < 0)
+		return ret;
+
+	/* On success and failure alike syncobjs is owned by the file now. */
+	return drm_syncobj_wait_file_create(syncobjs,
+					    u64_to_user_ptr(args->points),
+					    args->count_handles, args->flags,
+					    &args->fd);
+}
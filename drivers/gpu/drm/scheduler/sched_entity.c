@@ -57,6 +57,9 @@ int drm_sched_entity_init(struct drm_sched_entity *entity,
 
 	memset(entity, 0, sizeof(struct drm_sched_entity));
 	INIT_LIST_HEAD(&entity->list);
+	INIT_LIST_HEAD(&entity->ready_list);
+	RB_CLEAR_NODE(&entity->ready_node);
+	entity->weight = DRM_SCHED_WEIGHT_DEFAULT;
 	entity->rq = NULL;
 	entity->guilty = guilty;
 	entity->num_rq_list = num_rq_list;
@@ -65,6 +68,15 @@ int drm_sched_entity_init(struct drm_sched_entity *entity,
 	if (!entity->rq_list)
 		return -ENOMEM;
 
+	entity->stats = kzalloc(sizeof(*entity->stats), GFP_KERNEL);
+	if (!entity->stats) {
+		kfree(entity->rq_list);
+		return -ENOMEM;
+	}
+	kref_init(&entity->stats->refcount);
+	spin_lock_init(&entity->stats->lock);
+	entity->stats->entity = entity;
+
 	for (i = 0; i < num_rq_list; ++i)
 		entity->rq_list[i] = rq_list[i];
 
@@ -278,6 +290,57 @@ static void drm_sched_entity_kill_jobs(struct drm_sched_entity *entity)
 	}
 }
 
+static void drm_sched_entity_stats_release(struct kref *kref)
+{
+	struct drm_sched_entity_stats *stats =
+		container_of(kref, struct drm_sched_entity_stats, refcount);
+
+	kfree(stats);
+}
+
+/**
+ * drm_sched_entity_stats_get - take a reference to entity stats
+ *
+ * @stats: stats of an entity
+ */
+struct drm_sched_entity_stats *
+drm_sched_entity_stats_get(struct drm_sched_entity_stats *stats)
+{
+	kref_get(&stats->refcount);
+	return stats;
+}
+
+/**
+ * drm_sched_entity_stats_put - drop a reference to entity stats
+ *
+ * @stats: stats of an entity
+ */
+void drm_sched_entity_stats_put(struct drm_sched_entity_stats *stats)
+{
+	kref_put(&stats->refcount, drm_sched_entity_stats_release);
+}
+
+/**
+ * drm_sched_entity_stats_detach - stop accounting to a destroyed entity
+ *
+ * @entity: entity which is cleaned up
+ *
+ * Jobs still in flight keep their reference to the stats, but won't charge
+ * the entity any more once this returned.
+ */
+static void drm_sched_entity_stats_detach(struct drm_sched_entity *entity)
+{
+	struct drm_sched_entity_stats *stats = entity->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->entity = NULL;
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	drm_sched_entity_stats_put(stats);
+	entity->stats = NULL;
+}
+
 /**
  * drm_sched_entity_cleanup - Destroy a context entity
  *
@@ -320,6 +383,7 @@ void drm_sched_entity_fini(struct drm_sched_entity *entity)
 	dma_fence_put(entity->last_scheduled);
 	entity->last_scheduled = NULL;
 	kfree(entity->rq_list);
+	drm_sched_entity_stats_detach(entity);
 }
 EXPORT_SYMBOL(drm_sched_entity_fini);
 
@@ -348,6 +412,7 @@ static void drm_sched_entity_clear_dep(struct dma_fence *f,
 
 	entity->dependency = NULL;
 	dma_fence_put(f);
+	drm_sched_rq_update_ready(entity);
 }
 
 /**
@@ -401,6 +466,22 @@ void drm_sched_entity_set_priority(struct drm_sched_entity *entity,
 }
 EXPORT_SYMBOL(drm_sched_entity_set_priority);
 
+/**
+ * drm_sched_entity_set_weight - Sets the fair share weight of the entity
+ *
+ * @entity: scheduler entity
+ * @weight: share of the GPU time relative to DRM_SCHED_WEIGHT_DEFAULT
+ *
+ * Only used by the fair share policy, an entity with twice the weight gets
+ * twice the GPU time of its competitors. Takes effect with the next charge.
+ */
+void drm_sched_entity_set_weight(struct drm_sched_entity *entity,
+				 unsigned int weight)
+{
+	WRITE_ONCE(entity->weight, max(weight, 1U));
+}
+EXPORT_SYMBOL(drm_sched_entity_set_weight);
+
 /**
  * drm_sched_entity_add_dependency_cb - add callback for the entities dependency
  *
@@ -464,6 +545,8 @@ struct drm_sched_job *drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 {
 	struct drm_gpu_scheduler *sched = entity->rq->sched;
 	struct drm_sched_job *sched_job;
+	u64 queue_ns, dep_ns = 0;
+	ktime_t now;
 
 	sched_job = to_drm_sched_job(spsc_queue_peek(&entity->job_queue));
 	if (!sched_job)
@@ -473,10 +556,22 @@ struct drm_sched_job *drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 			sched->ops->dependency(sched_job, entity))) {
 		trace_drm_sched_job_wait_dep(sched_job, entity->dependency);
 
-		if (drm_sched_entity_add_dependency_cb(entity))
+		if (drm_sched_entity_add_dependency_cb(entity)) {
+			if (!sched_job->dep_time)
+				sched_job->dep_time = ktime_get();
 			return NULL;
+		}
 	}
 
+	now = ktime_get();
+	if (sched_job->dep_time)
+		dep_ns = ktime_to_ns(ktime_sub(now, sched_job->dep_time));
+	queue_ns = ktime_to_ns(ktime_sub(now, sched_job->push_time)) - dep_ns;
+	drm_sched_hist_add(&sched->hist, DRM_SCHED_HIST_QUEUE, queue_ns);
+	drm_sched_hist_add(&sched->hist, DRM_SCHED_HIST_DEP, dep_ns);
+	drm_sched_hist_add(&entity->stats->hist, DRM_SCHED_HIST_QUEUE, queue_ns);
+	drm_sched_hist_add(&entity->stats->hist, DRM_SCHED_HIST_DEP, dep_ns);
+
 	/* skip jobs from entity that marked guilty */
 	if (entity->guilty && atomic_read(entity->guilty))
 		dma_fence_set_error(&sched_job->s_fence->finished, -ECANCELED);
@@ -485,6 +580,9 @@ struct drm_sched_job *drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 	entity->last_scheduled = dma_fence_get(&sched_job->s_fence->finished);
 
 	spsc_queue_pop(&entity->job_queue);
+
+	/* Requeue at the tail if there is more work for us */
+	drm_sched_rq_update_ready(entity);
 	return sched_job;
 }
 
@@ -536,6 +634,8 @@ void drm_sched_entity_push_job(struct drm_sched_job *sched_job,
 	bool first;
 
 	trace_drm_sched_job(sched_job, entity);
+	sched_job->push_time = ktime_get();
+	sched_job->dep_time = 0;
 	atomic_inc(&entity->rq->sched->num_jobs);
 	WRITE_ONCE(entity->last_user, current->group_leader);
 	first = spsc_queue_push(&entity->job_queue, &sched_job->queue_node);
@@ -552,6 +652,7 @@ void drm_sched_entity_push_job(struct drm_sched_job *sched_job,
 		}
 		drm_sched_rq_add_entity(entity->rq, entity);
 		spin_unlock(&entity->rq_lock);
+		drm_sched_rq_update_ready(entity);
 		drm_sched_wakeup(entity->rq->sched);
 	}
 }
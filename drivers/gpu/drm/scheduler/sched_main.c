@@ -60,6 +60,16 @@
 
 static void drm_sched_process_job(struct dma_fence *f, struct dma_fence_cb *cb);
 
+static int drm_sched_policy_default = DRM_SCHED_POLICY_RR;
+
+/**
+ * DOC: sched_policy (int)
+ * How the scheduler picks between entities of the same priority.
+ * 0 = round robin (default), 1 = weighted fair share of the GPU time.
+ */
+MODULE_PARM_DESC(sched_policy, "Entity selection policy (0 = round robin (default), 1 = weighted fair share)");
+module_param_named(sched_policy, drm_sched_policy_default, int, 0444);
+
 /**
  * drm_sched_rq_init - initialize a given run queue struct
  *
@@ -72,10 +82,110 @@ static void drm_sched_rq_init(struct drm_gpu_scheduler *sched,
 {
 	spin_lock_init(&rq->lock);
 	INIT_LIST_HEAD(&rq->entities);
+	INIT_LIST_HEAD(&rq->ready);
+	rq->ready_tree = RB_ROOT_CACHED;
+	rq->min_vruntime = 0;
 	rq->current_entity = NULL;
 	rq->sched = sched;
 }
 
+/**
+ * drm_sched_rq_enqueue_locked - put an entity on the ready list or tree
+ *
+ * @rq: scheduler run queue
+ * @entity: scheduler entity, must not be queued already
+ */
+static void drm_sched_rq_enqueue_locked(struct drm_sched_rq *rq,
+					struct drm_sched_entity *entity)
+{
+	struct rb_node **link = &rq->ready_tree.rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	bool leftmost = true;
+
+	if (rq->sched->policy != DRM_SCHED_POLICY_FAIR) {
+		list_add_tail(&entity->ready_list, &rq->ready);
+		return;
+	}
+
+	if (entity->vruntime < rq->min_vruntime)
+		entity->vruntime = rq->min_vruntime;
+
+	/* Equal keys go to the right to keep FIFO order between them */
+	while (*link) {
+		struct drm_sched_entity *e;
+
+		parent = *link;
+		e = rb_entry(parent, struct drm_sched_entity, ready_node);
+		if (entity->vruntime < e->vruntime) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = false;
+		}
+	}
+	rb_link_node(&entity->ready_node, parent, link);
+	rb_insert_color_cached(&entity->ready_node, &rq->ready_tree, leftmost);
+}
+
+/**
+ * drm_sched_rq_dequeue_locked - take an entity off the ready list or tree
+ *
+ * @rq: scheduler run queue
+ * @entity: scheduler entity
+ *
+ * Returns true if the entity was queued.
+ */
+static bool drm_sched_rq_dequeue_locked(struct drm_sched_rq *rq,
+					struct drm_sched_entity *entity)
+{
+	if (!RB_EMPTY_NODE(&entity->ready_node)) {
+		rb_erase_cached(&entity->ready_node, &rq->ready_tree);
+		RB_CLEAR_NODE(&entity->ready_node);
+		return true;
+	}
+	if (!list_empty(&entity->ready_list)) {
+		list_del_init(&entity->ready_list);
+		return true;
+	}
+	return false;
+}
+
+static bool drm_sched_entity_is_queued(struct drm_sched_entity *entity)
+{
+	return !list_empty(&entity->ready_list) ||
+		!RB_EMPTY_NODE(&entity->ready_node);
+}
+
+/**
+ * drm_sched_entity_lock_rq - lock the run queue an entity is on
+ *
+ * @entity: scheduler entity
+ * @flags: irq flags for spin_unlock_irqrestore()
+ *
+ * This can be called from fence callbacks, so entity->rq_lock can't be taken.
+ * Instead recheck entity->rq under the run queue lock to not race with
+ * drm_sched_entity_set_priority() moving the entity around.
+ *
+ * Returns the locked run queue or NULL if the entity has none.
+ */
+static struct drm_sched_rq *
+drm_sched_entity_lock_rq(struct drm_sched_entity *entity, unsigned long *flags)
+{
+	struct drm_sched_rq *rq;
+
+retry:
+	rq = READ_ONCE(entity->rq);
+	if (!rq)
+		return NULL;
+
+	spin_lock_irqsave(&rq->lock, *flags);
+	if (READ_ONCE(entity->rq) != rq) {
+		spin_unlock_irqrestore(&rq->lock, *flags);
+		goto retry;
+	}
+	return rq;
+}
+
 /**
  * drm_sched_rq_add_entity - add an entity
  *
@@ -87,11 +197,15 @@ static void drm_sched_rq_init(struct drm_gpu_scheduler *sched,
 void drm_sched_rq_add_entity(struct drm_sched_rq *rq,
 			     struct drm_sched_entity *entity)
 {
+	unsigned long flags;
+
 	if (!list_empty(&entity->list))
 		return;
-	spin_lock(&rq->lock);
+	spin_lock_irqsave(&rq->lock, flags);
 	list_add_tail(&entity->list, &rq->entities);
-	spin_unlock(&rq->lock);
+	if (drm_sched_entity_is_ready(entity))
+		drm_sched_rq_enqueue_locked(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
 }
 
 /**
@@ -105,13 +219,91 @@ void drm_sched_rq_add_entity(struct drm_sched_rq *rq,
 void drm_sched_rq_remove_entity(struct drm_sched_rq *rq,
 				struct drm_sched_entity *entity)
 {
+	unsigned long flags;
+
 	if (list_empty(&entity->list))
 		return;
-	spin_lock(&rq->lock);
+	spin_lock_irqsave(&rq->lock, flags);
 	list_del_init(&entity->list);
+	drm_sched_rq_dequeue_locked(rq, entity);
 	if (rq->current_entity == entity)
 		rq->current_entity = NULL;
-	spin_unlock(&rq->lock);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/**
+ * drm_sched_rq_update_ready - queue an entity which became ready
+ *
+ * @entity: scheduler entity
+ *
+ * Called whenever an entity might have become able to provide a job: when it
+ * gets its first job queued, when its dependency signals and after a job was
+ * taken from it. With the round robin policy ready entities are appended to
+ * the tail of the ready list of their run queue, which gives the same order
+ * the old linear scan had. The fair share policy sorts them by vruntime.
+ */
+void drm_sched_rq_update_ready(struct drm_sched_entity *entity)
+{
+	struct drm_sched_rq *rq;
+	unsigned long flags;
+
+	if (!drm_sched_entity_is_ready(entity))
+		return;
+
+	rq = drm_sched_entity_lock_rq(entity, &flags);
+	if (!rq)
+		return;
+
+	/* Only entities still on the rq can be picked */
+	if (!list_empty(&entity->list) && !drm_sched_entity_is_queued(entity))
+		drm_sched_rq_enqueue_locked(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/**
+ * drm_sched_entity_charge - account GPU time to an entity
+ *
+ * @entity: scheduler entity
+ * @ns: execution time of the entity's job
+ *
+ * Advances the vruntime of @entity and resorts it if it is queued.
+ */
+static void drm_sched_entity_charge(struct drm_sched_entity *entity, u64 ns)
+{
+	struct drm_sched_rq *rq;
+	unsigned long flags;
+	bool queued;
+
+	rq = drm_sched_entity_lock_rq(entity, &flags);
+	if (!rq)
+		return;
+
+	queued = drm_sched_rq_dequeue_locked(rq, entity);
+	entity->vruntime += div_u64(ns * DRM_SCHED_WEIGHT_DEFAULT,
+				    READ_ONCE(entity->weight));
+	if (queued)
+		drm_sched_rq_enqueue_locked(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/**
+ * drm_sched_rq_first_locked - peek at the entity to be scheduled next
+ *
+ * @rq: scheduler run queue
+ */
+static struct drm_sched_entity *
+drm_sched_rq_first_locked(struct drm_sched_rq *rq)
+{
+	struct rb_node *node;
+
+	if (rq->sched->policy != DRM_SCHED_POLICY_FAIR)
+		return list_first_entry_or_null(&rq->ready,
+						struct drm_sched_entity,
+						ready_list);
+
+	node = rb_first_cached(&rq->ready_tree);
+	return node ? rb_entry(node, struct drm_sched_entity, ready_node) :
+		NULL;
 }
 
 /**
@@ -119,41 +311,31 @@ void drm_sched_rq_remove_entity(struct drm_sched_rq *rq,
  *
  * @rq: scheduler run queue to check.
  *
- * Try to find a ready entity, returns NULL if none found.
+ * Take the first ready entity off the ready list, returns NULL if none found.
+ * The entity is queued again by drm_sched_rq_update_ready() once its job was
+ * taken, so only entries which went stale in the meantime are ever skipped.
  */
 static struct drm_sched_entity *
 drm_sched_rq_select_entity(struct drm_sched_rq *rq)
 {
 	struct drm_sched_entity *entity;
+	unsigned long flags;
 
-	spin_lock(&rq->lock);
-
-	entity = rq->current_entity;
-	if (entity) {
-		list_for_each_entry_continue(entity, &rq->entities, list) {
-			if (drm_sched_entity_is_ready(entity)) {
-				rq->current_entity = entity;
-				spin_unlock(&rq->lock);
-				return entity;
-			}
-		}
-	}
-
-	list_for_each_entry(entity, &rq->entities, list) {
+	spin_lock_irqsave(&rq->lock, flags);
 
+	while ((entity = drm_sched_rq_first_locked(rq))) {
+		drm_sched_rq_dequeue_locked(rq, entity);
 		if (drm_sched_entity_is_ready(entity)) {
 			rq->current_entity = entity;
-			spin_unlock(&rq->lock);
-			return entity;
-		}
-
-		if (entity == rq->current_entity)
+			if (entity->vruntime > rq->min_vruntime)
+				rq->min_vruntime = entity->vruntime;
 			break;
+		}
 	}
 
-	spin_unlock(&rq->lock);
+	spin_unlock_irqrestore(&rq->lock, flags);
 
-	return NULL;
+	return entity;
 }
 
 /**
@@ -319,6 +501,7 @@ void drm_sched_increase_karma(struct drm_sched_job *bad)
 	struct drm_sched_entity *tmp;
 	struct drm_sched_entity *entity;
 	struct drm_gpu_scheduler *sched = bad->sched;
+	unsigned long flags;
 
 	/* don't increase @bad's karma if it's from KERNEL RQ,
 	 * because sometimes GPU hang would cause kernel jobs (like VM updating jobs)
@@ -330,7 +513,7 @@ void drm_sched_increase_karma(struct drm_sched_job *bad)
 		     i++) {
 			struct drm_sched_rq *rq = &sched->sched_rq[i];
 
-			spin_lock(&rq->lock);
+			spin_lock_irqsave(&rq->lock, flags);
 			list_for_each_entry_safe(entity, tmp, &rq->entities, list) {
 				if (bad->s_fence->scheduled.context ==
 				    entity->fence_context) {
@@ -341,7 +524,7 @@ void drm_sched_increase_karma(struct drm_sched_job *bad)
 					break;
 				}
 			}
-			spin_unlock(&rq->lock);
+			spin_unlock_irqrestore(&rq->lock, flags);
 			if (&entity->list != &rq->entities)
 				break;
 		}
@@ -526,6 +709,7 @@ int drm_sched_job_init(struct drm_sched_job *job,
 	job->s_fence = drm_sched_fence_create(entity, owner);
 	if (!job->s_fence)
 		return -ENOMEM;
+	job->stats = drm_sched_entity_stats_get(entity->stats);
 	job->id = atomic64_inc_return(&sched->job_id_count);
 
 	INIT_LIST_HEAD(&job->node);
@@ -543,6 +727,10 @@ void drm_sched_job_cleanup(struct drm_sched_job *job)
 {
 	dma_fence_put(&job->s_fence->finished);
 	job->s_fence = NULL;
+	if (job->stats) {
+		drm_sched_entity_stats_put(job->stats);
+		job->stats = NULL;
+	}
 }
 EXPORT_SYMBOL(drm_sched_job_cleanup);
 
@@ -559,6 +747,124 @@ static bool drm_sched_ready(struct drm_gpu_scheduler *sched)
 		sched->hw_submission_limit;
 }
 
+/**
+ * drm_sched_hist_add - account a latency to a histogram
+ *
+ * @hist: the histogram
+ * @type: which job phase the latency belongs to
+ * @ns: the latency
+ */
+void drm_sched_hist_add(struct drm_sched_hist *hist,
+			enum drm_sched_hist_type type, u64 ns)
+{
+	unsigned int bucket = fls64(ns >> 10);
+
+	if (bucket >= DRM_SCHED_HIST_BUCKETS)
+		bucket = DRM_SCHED_HIST_BUCKETS - 1;
+	atomic_inc(&hist->buckets[type][bucket]);
+}
+EXPORT_SYMBOL(drm_sched_hist_add);
+
+static void drm_sched_hist_clear(struct drm_sched_hist *hist)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < DRM_SCHED_HIST_COUNT; i++)
+		for (j = 0; j < DRM_SCHED_HIST_BUCKETS; j++)
+			atomic_set(&hist->buckets[i][j], 0);
+}
+
+/**
+ * drm_sched_hist_reset - clear the latency histograms
+ *
+ * @sched: scheduler instance
+ *
+ * Clears the histograms of the scheduler and all entities on its run queues.
+ */
+void drm_sched_hist_reset(struct drm_gpu_scheduler *sched)
+{
+	struct drm_sched_entity *entity;
+	unsigned long flags;
+	int i;
+
+	drm_sched_hist_clear(&sched->hist);
+	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_MAX; i++) {
+		struct drm_sched_rq *rq = &sched->sched_rq[i];
+
+		spin_lock_irqsave(&rq->lock, flags);
+		list_for_each_entry(entity, &rq->entities, list)
+			drm_sched_hist_clear(&entity->stats->hist);
+		spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+EXPORT_SYMBOL(drm_sched_hist_reset);
+
+static void drm_sched_hist_print_one(struct drm_sched_hist *hist,
+				     struct drm_printer *p)
+{
+	static const char * const names[] = {
+		[DRM_SCHED_HIST_QUEUE] = "queue",
+		[DRM_SCHED_HIST_DEP] = "dep",
+		[DRM_SCHED_HIST_EXEC] = "exec",
+	};
+	unsigned int i, j;
+
+	for (i = 0; i < DRM_SCHED_HIST_COUNT; i++) {
+		drm_printf(p, "  %-5s", names[i]);
+		for (j = 0; j < DRM_SCHED_HIST_BUCKETS; j++)
+			drm_printf(p, " %u",
+				   atomic_read(&hist->buckets[i][j]));
+		drm_printf(p, "\n");
+	}
+}
+
+static bool drm_sched_hist_empty(struct drm_sched_hist *hist)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < DRM_SCHED_HIST_COUNT; i++)
+		for (j = 0; j < DRM_SCHED_HIST_BUCKETS; j++)
+			if (atomic_read(&hist->buckets[i][j]))
+				return false;
+	return true;
+}
+
+/**
+ * drm_sched_hist_print - dump the latency histograms
+ *
+ * @sched: scheduler instance
+ * @p: where to print to
+ *
+ * Prints the histograms of the scheduler followed by the ones of each entity
+ * on its run queues which ran jobs since the last reset. Entities are named
+ * by their fence context. Column n counts latencies of [2^(n-1), 2^n) * 1024ns.
+ */
+void drm_sched_hist_print(struct drm_gpu_scheduler *sched,
+			  struct drm_printer *p)
+{
+	struct drm_sched_entity *entity;
+	unsigned long flags;
+	int i;
+
+	drm_printf(p, "%s:\n", sched->name);
+	drm_sched_hist_print_one(&sched->hist, p);
+	for (i = DRM_SCHED_PRIORITY_MAX - 1; i >= DRM_SCHED_PRIORITY_MIN; i--) {
+		struct drm_sched_rq *rq = &sched->sched_rq[i];
+
+		spin_lock_irqsave(&rq->lock, flags);
+		list_for_each_entry(entity, &rq->entities, list) {
+			if (drm_sched_hist_empty(&entity->stats->hist))
+				continue;
+			drm_printf(p, " entity %llu prio %d:\n",
+				   (unsigned long long)entity->fence_context,
+				   i);
+			drm_sched_hist_print_one(&entity->stats->hist, p);
+		}
+		spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+EXPORT_SYMBOL(drm_sched_hist_print);
+
 /**
  * drm_sched_wakeup - Wake up the scheduler when it is ready
  *
@@ -597,6 +903,62 @@ drm_sched_select_entity(struct drm_gpu_scheduler *sched)
 	return entity;
 }
 
+/**
+ * drm_sched_job_exec_time - measure the execution time of a job
+ *
+ * @s_job: the finished job
+ * @f: the hardware fence of the job, if any
+ *
+ * Jobs on a ring execute back to back, so the execution time is measured
+ * from when the job was handed to the hardware or the previous job finished,
+ * whichever came last, up to the signal timestamp of the hardware fence.
+ *
+ * Returns the execution time in ns.
+ */
+static u64 drm_sched_job_exec_time(struct drm_sched_job *s_job,
+				   struct dma_fence *f)
+{
+	struct drm_gpu_scheduler *sched = s_job->sched;
+	ktime_t start, end, last_done;
+
+	if (f && test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &f->flags))
+		end = f->timestamp;
+	else
+		end = ktime_get();
+
+	/* Hardware fences of a ring signal in order, no need for a lock */
+	last_done = READ_ONCE(sched->last_done);
+	start = ktime_after(last_done, s_job->start_time) ?
+		last_done : s_job->start_time;
+	if (ktime_after(end, last_done))
+		WRITE_ONCE(sched->last_done, end);
+
+	return ktime_after(end, start) ? ktime_to_ns(ktime_sub(end, start)) : 0;
+}
+
+/**
+ * drm_sched_job_charge - charge the execution time of a job to its entity
+ *
+ * @s_job: the finished job
+ *
+ * Must be called before the finished fence signals, after that the job can
+ * be freed by drm_sched_cleanup_jobs() at any time.
+ */
+static void drm_sched_job_charge(struct drm_sched_job *s_job)
+{
+	struct drm_sched_entity_stats *stats = s_job->stats;
+	unsigned long flags;
+
+	if (!s_job->exec_ns || !stats)
+		return;
+
+	/* stats->lock keeps drm_sched_entity_fini() from freeing the entity */
+	spin_lock_irqsave(&stats->lock, flags);
+	if (stats->entity)
+		drm_sched_entity_charge(stats->entity, s_job->exec_ns);
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
 /**
  * drm_sched_process_job - process a job
  *
@@ -616,6 +978,14 @@ static void drm_sched_process_job(struct dma_fence *f, struct dma_fence_cb *cb)
 
 	trace_drm_sched_process_job(s_fence);
 
+	s_job->exec_ns = drm_sched_job_exec_time(s_job, f);
+	drm_sched_hist_add(&sched->hist, DRM_SCHED_HIST_EXEC, s_job->exec_ns);
+	if (s_job->stats)
+		drm_sched_hist_add(&s_job->stats->hist, DRM_SCHED_HIST_EXEC,
+				   s_job->exec_ns);
+	if (sched->policy == DRM_SCHED_POLICY_FAIR)
+		drm_sched_job_charge(s_job);
+
 	drm_sched_fence_finished(s_fence);
 	wake_up_interruptible(&sched->wake_up_worker);
 }
@@ -716,6 +1086,7 @@ static int drm_sched_main(void *param)
 		atomic_inc(&sched->hw_rq_count);
 		drm_sched_job_begin(sched_job);
 
+		sched_job->start_time = ktime_get();
 		fence = sched->ops->run_job(sched_job);
 		drm_sched_fence_scheduled(s_fence);
 
@@ -762,6 +1133,12 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 	sched->name = name;
 	sched->timeout = timeout;
 	sched->hang_limit = hang_limit;
+	sched->policy = DRM_SCHED_POLICY_RR;
+	if (drm_sched_policy_default >= 0 &&
+	    drm_sched_policy_default < DRM_SCHED_POLICY_COUNT)
+		sched->policy = drm_sched_policy_default;
+	sched->last_done = 0;
+	drm_sched_hist_clear(&sched->hist);
 	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_MAX; i++)
 		drm_sched_rq_init(sched, &sched->sched_rq[i]);
 
@@ -51,12 +51,133 @@ static void ttm_bo_global_kobj_release(struct kobject *kobj);
 DEFINE_MUTEX(ttm_global_mutex);
 unsigned ttm_bo_glob_use_count;
 struct ttm_bo_global ttm_bo_glob;
+EXPORT_SYMBOL(ttm_bo_glob);
+
+/* Upper bound of candidates an eviction policy returns from one LRU list */
+#define TTM_EVICT_POLICY_WINDOW	16
+/* Saturation of the CLOCK eviction policy reference count */
+#define TTM_EVICT_CLOCK_MAX_REF	3
 
 static struct attribute ttm_bo_count = {
 	.name = "bo_count",
 	.mode = S_IRUGO
 };
 
+static struct attribute ttm_bo_vm_faults = {
+	.name = "vm_faults",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_vm_huge_faults = {
+	.name = "vm_huge_faults",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_vm_window_faults = {
+	.name = "vm_window_faults",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_vm_fault_pages = {
+	.name = "vm_fault_pages",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_memcpy_moves = {
+	.name = "memcpy_moves",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_memcpy_bytes = {
+	.name = "memcpy_bytes",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_memcpy_gbps = {
+	.name = "memcpy_gbps",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_eu_sorted = {
+	.name = "eu_sorted",
+	.mode = S_IRUGO | S_IWUSR
+};
+
+static struct attribute ttm_bo_eu_reserves = {
+	.name = "eu_reserves",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_eu_backoffs = {
+	.name = "eu_backoffs",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_eu_contended = {
+	.name = "eu_contended",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_eu_backoff_ns = {
+	.name = "eu_backoff_ns",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swap_compress = {
+	.name = "swap_compress",
+	.mode = S_IRUGO | S_IWUSR
+};
+
+static struct attribute ttm_bo_swap_compress_limit_kb = {
+	.name = "swap_compress_limit_kb",
+	.mode = S_IRUGO | S_IWUSR
+};
+
+static struct attribute ttm_bo_swap_comp_orig_bytes = {
+	.name = "swap_comp_orig_bytes",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swap_comp_stored_bytes = {
+	.name = "swap_comp_stored_bytes",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swap_comp_ratio = {
+	.name = "swap_comp_ratio",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swap_comp_zero_pages = {
+	.name = "swap_comp_zero_pages",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swap_comp_rejects = {
+	.name = "swap_comp_rejects",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swapin_comp = {
+	.name = "swapin_comp",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swapin_comp_ns = {
+	.name = "swapin_comp_ns",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swapin_shmem = {
+	.name = "swapin_shmem",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_swapin_shmem_ns = {
+	.name = "swapin_shmem_ns",
+	.mode = S_IRUGO
+};
+
 /* default destructor */
 static void ttm_bo_default_destroy(struct ttm_buffer_object *bo)
 {
@@ -123,18 +244,142 @@ static ssize_t ttm_bo_global_show(struct kobject *kobj,
 {
 	struct ttm_bo_global *glob =
 		container_of(kobj, struct ttm_bo_global, kobj);
+	atomic64_t *counter;
+
+	if (attr == &ttm_bo_memcpy_gbps) {
+		u64 bytes = atomic64_read(&glob->memcpy_bytes);
+		u64 ns = atomic64_read(&glob->memcpy_ns);
+		u64 milli = ns ? div64_u64(bytes * 1000, ns) : 0;
 
-	return snprintf(buffer, PAGE_SIZE, "%d\n",
+		/* bytes per ns == GB/s, printed with three decimals */
+		return snprintf(buffer, PAGE_SIZE, "%llu.%03llu\n",
+				(unsigned long long)(milli / 1000),
+				(unsigned long long)(milli % 1000));
+	}
+
+	if (attr == &ttm_bo_eu_sorted)
+		return snprintf(buffer, PAGE_SIZE, "%d\n",
+				READ_ONCE(glob->eu_sorted) ? 1 : 0);
+
+	if (attr == &ttm_bo_swap_compress)
+		return snprintf(buffer, PAGE_SIZE, "%d\n",
+				READ_ONCE(glob->swap_compress) ? 1 : 0);
+
+	if (attr == &ttm_bo_swap_compress_limit_kb)
+		return snprintf(buffer, PAGE_SIZE, "%llu\n",
+				(unsigned long long)
+				READ_ONCE(glob->swap_compress_limit) >> 10);
+
+	if (attr == &ttm_bo_swap_comp_ratio) {
+		u64 orig = atomic64_read(&glob->swap_comp_orig);
+		u64 stored = atomic64_read(&glob->swap_comp_stored);
+
+		/* Original size per stored byte, in percent */
+		return snprintf(buffer, PAGE_SIZE, "%llu\n",
+				stored ? (unsigned long long)
+				div64_u64(orig * 100, stored) : 0ULL);
+	}
+
+	if (attr == &ttm_bo_vm_faults)
+		counter = &glob->vm_faults;
+	else if (attr == &ttm_bo_vm_huge_faults)
+		counter = &glob->vm_huge_faults;
+	else if (attr == &ttm_bo_vm_window_faults)
+		counter = &glob->vm_window_faults;
+	else if (attr == &ttm_bo_vm_fault_pages)
+		counter = &glob->vm_fault_pages;
+	else if (attr == &ttm_bo_memcpy_moves)
+		counter = &glob->memcpy_moves;
+	else if (attr == &ttm_bo_memcpy_bytes)
+		counter = &glob->memcpy_bytes;
+	else if (attr == &ttm_bo_eu_reserves)
+		counter = &glob->eu_reserves;
+	else if (attr == &ttm_bo_eu_backoffs)
+		counter = &glob->eu_backoffs;
+	else if (attr == &ttm_bo_eu_contended)
+		counter = &glob->eu_contended;
+	else if (attr == &ttm_bo_eu_backoff_ns)
+		counter = &glob->eu_backoff_ns;
+	else if (attr == &ttm_bo_swap_comp_orig_bytes)
+		counter = &glob->swap_comp_orig;
+	else if (attr == &ttm_bo_swap_comp_stored_bytes)
+		counter = &glob->swap_comp_stored;
+	else if (attr == &ttm_bo_swap_comp_zero_pages)
+		counter = &glob->swap_comp_zero;
+	else if (attr == &ttm_bo_swap_comp_rejects)
+		counter = &glob->swap_comp_rejects;
+	else if (attr == &ttm_bo_swapin_comp)
+		counter = &glob->swapin_comp;
+	else if (attr == &ttm_bo_swapin_comp_ns)
+		counter = &glob->swapin_comp_ns;
+	else if (attr == &ttm_bo_swapin_shmem)
+		counter = &glob->swapin_shmem;
+	else if (attr == &ttm_bo_swapin_shmem_ns)
+		counter = &glob->swapin_shmem_ns;
+	else
+		return snprintf(buffer, PAGE_SIZE, "%d\n",
 				atomic_read(&glob->bo_count));
+
+	return snprintf(buffer, PAGE_SIZE, "%lld\n",
+			(long long)atomic64_read(counter));
 }
 
 static struct attribute *ttm_bo_global_attrs[] = {
 	&ttm_bo_count,
+	&ttm_bo_vm_faults,
+	&ttm_bo_vm_huge_faults,
+	&ttm_bo_vm_window_faults,
+	&ttm_bo_vm_fault_pages,
+	&ttm_bo_memcpy_moves,
+	&ttm_bo_memcpy_bytes,
+	&ttm_bo_memcpy_gbps,
+	&ttm_bo_eu_sorted,
+	&ttm_bo_eu_reserves,
+	&ttm_bo_eu_backoffs,
+	&ttm_bo_eu_contended,
+	&ttm_bo_eu_backoff_ns,
+	&ttm_bo_swap_compress,
+	&ttm_bo_swap_compress_limit_kb,
+	&ttm_bo_swap_comp_orig_bytes,
+	&ttm_bo_swap_comp_stored_bytes,
+	&ttm_bo_swap_comp_ratio,
+	&ttm_bo_swap_comp_zero_pages,
+	&ttm_bo_swap_comp_rejects,
+	&ttm_bo_swapin_comp,
+	&ttm_bo_swapin_comp_ns,
+	&ttm_bo_swapin_shmem,
+	&ttm_bo_swapin_shmem_ns,
 	NULL
 };
 
+static ssize_t ttm_bo_global_store(struct kobject *kobj,
+				   struct attribute *attr,
+				   const char *buffer,
+				   size_t size)
+{
+	struct ttm_bo_global *glob =
+		container_of(kobj, struct ttm_bo_global, kobj);
+	int chars;
+	unsigned long val;
+
+	chars = sscanf(buffer, "%lu", &val);
+	if (chars == 0)
+		return size;
+
+	if (attr == &ttm_bo_eu_sorted)
+		WRITE_ONCE(glob->eu_sorted, val != 0);
+	else if (attr == &ttm_bo_swap_compress)
+		WRITE_ONCE(glob->swap_compress, val != 0);
+	else if (attr == &ttm_bo_swap_compress_limit_kb)
+		/* convert from KB to bytes */
+		WRITE_ONCE(glob->swap_compress_limit, (uint64_t)val << 10);
+
+	return size;
+}
+
 static const struct sysfs_ops ttm_bo_global_ops = {
-	.show = &ttm_bo_global_show
+	.show = &ttm_bo_global_show,
+	.store = &ttm_bo_global_store,
 };
 
 static struct kobj_type ttm_bo_glob_kobj_type  = {
@@ -191,8 +436,10 @@ static void ttm_bo_add_mem_to_lru(struct ttm_buffer_object *bo,
 
 	if (bo->ttm && !(bo->ttm->page_flags &
 			 (TTM_PAGE_FLAG_SG | TTM_PAGE_FLAG_SWAPPED))) {
+		spin_lock(&bdev->glob->swap_lock);
 		list_add_tail(&bo->swap, &bdev->glob->swap_lru[bo->priority]);
 		kref_get(&bo->list_kref);
+		spin_unlock(&bdev->glob->swap_lock);
 	}
 }
 
@@ -212,11 +459,13 @@ void ttm_bo_del_from_lru(struct ttm_buffer_object *bo)
 	struct ttm_bo_device *bdev = bo->bdev;
 	bool notify = false;
 
+	spin_lock(&bdev->glob->swap_lock);
 	if (!list_empty(&bo->swap)) {
 		list_del_init(&bo->swap);
 		kref_put(&bo->list_kref, ttm_bo_ref_bug);
 		notify = true;
 	}
+	spin_unlock(&bdev->glob->swap_lock);
 	if (!list_empty(&bo->lru)) {
 		list_del_init(&bo->lru);
 		kref_put(&bo->list_kref, ttm_bo_ref_bug);
@@ -229,11 +478,9 @@ void ttm_bo_del_from_lru(struct ttm_buffer_object *bo)
 
 void ttm_bo_del_sub_from_lru(struct ttm_buffer_object *bo)
 {
-	struct ttm_bo_global *glob = bo->bdev->glob;
-
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bo->bdev);
 	ttm_bo_del_from_lru(bo);
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bo->bdev);
 }
 EXPORT_SYMBOL(ttm_bo_del_sub_from_lru);
 
@@ -252,6 +499,8 @@ void ttm_bo_move_to_lru_tail(struct ttm_buffer_object *bo,
 
 	ttm_bo_del_from_lru(bo);
 	ttm_bo_add_to_lru(bo);
+	if (bo->evict_ref < TTM_EVICT_CLOCK_MAX_REF)
+		bo->evict_ref++;
 
 	if (bulk && !(bo->mem.placement & TTM_PL_FLAG_NO_EVICT)) {
 		switch (bo->mem.mem_type) {
@@ -306,7 +555,7 @@ void ttm_bo_bulk_move_lru_tail(struct ttm_lru_bulk_move *bulk)
 
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
 		struct ttm_lru_bulk_move_pos *pos = &bulk->swap[i];
-		struct list_head *lru;
+		struct ttm_bo_global *glob;
 
 		if (!pos->first)
 			continue;
@@ -314,8 +563,11 @@ void ttm_bo_bulk_move_lru_tail(struct ttm_lru_bulk_move *bulk)
 		reservation_object_assert_held(pos->first->resv);
 		reservation_object_assert_held(pos->last->resv);
 
-		lru = &pos->first->bdev->glob->swap_lru[i];
-		list_bulk_move_tail(lru, &pos->first->swap, &pos->last->swap);
+		glob = pos->first->bdev->glob;
+		spin_lock(&glob->swap_lock);
+		list_bulk_move_tail(&glob->swap_lru[i], &pos->first->swap,
+				    &pos->last->swap);
+		spin_unlock(&glob->swap_lock);
 	}
 }
 EXPORT_SYMBOL(ttm_bo_bulk_move_lru_tail);
@@ -478,7 +730,6 @@ static void ttm_bo_flush_all_fences(struct ttm_buffer_object *bo)
 static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 {
 	struct ttm_bo_device *bdev = bo->bdev;
-	struct ttm_bo_global *glob = bdev->glob;
 	int ret;
 
 	ret = ttm_bo_individualize_resv(bo);
@@ -488,16 +739,16 @@ static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 		 */
 		reservation_object_wait_timeout_rcu(bo->resv, true, false,
 						    30 * HZ);
-		spin_lock(&glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 		goto error;
 	}
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	ret = reservation_object_trylock(bo->resv) ? 0 : -EBUSY;
 	if (!ret) {
 		if (reservation_object_test_signaled_rcu(&bo->ttm_resv, true)) {
 			ttm_bo_del_from_lru(bo);
-			spin_unlock(&glob->lru_lock);
+			ttm_bo_lru_unlock(bdev);
 			if (bo->resv != &bo->ttm_resv)
 				reservation_object_unlock(&bo->ttm_resv);
 
@@ -526,7 +777,7 @@ static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 error:
 	kref_get(&bo->list_kref);
 	list_add_tail(&bo->ddestroy, &bdev->ddestroy);
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	schedule_delayed_work(&bdev->wq,
 			      ((HZ / 100) < 1) ? 1 : HZ / 100);
@@ -537,7 +788,7 @@ error:
  * If bo idle, remove from delayed- and lru lists, and unref.
  * If not idle, do nothing.
  *
- * Must be called with lru_lock and reservation held, this function
+ * Must be called with bdev lru_lock and reservation held, this function
  * will drop the lru lock and optionally the reservation lock before returning.
  *
  * @interruptible         Any sleeps should occur interruptibly.
@@ -549,7 +800,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 			       bool interruptible, bool no_wait_gpu,
 			       bool unlock_resv)
 {
-	struct ttm_bo_global *glob = bo->bdev->glob;
+	struct ttm_bo_device *bdev = bo->bdev;
 	struct reservation_object *resv;
 	int ret;
 
@@ -568,7 +819,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 
 		if (unlock_resv)
 			reservation_object_unlock(bo->resv);
-		spin_unlock(&glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 
 		lret = reservation_object_wait_timeout_rcu(resv, true,
 							   interruptible,
@@ -579,7 +830,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 		else if (lret == 0)
 			return -EBUSY;
 
-		spin_lock(&glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 		if (unlock_resv && !reservation_object_trylock(bo->resv)) {
 			/*
 			 * We raced, and lost, someone else holds the reservation now,
@@ -589,7 +840,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 			 * delayed destruction would succeed, so just return success
 			 * here.
 			 */
-			spin_unlock(&glob->lru_lock);
+			ttm_bo_lru_unlock(bdev);
 			return 0;
 		}
 		ret = 0;
@@ -598,7 +849,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 	if (ret || unlikely(list_empty(&bo->ddestroy))) {
 		if (unlock_resv)
 			reservation_object_unlock(bo->resv);
-		spin_unlock(&glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 		return ret;
 	}
 
@@ -606,7 +857,7 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
 	list_del_init(&bo->ddestroy);
 	kref_put(&bo->list_kref, ttm_bo_ref_bug);
 
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 	ttm_bo_cleanup_memtype_use(bo);
 
 	if (unlock_resv)
@@ -621,13 +872,12 @@ static int ttm_bo_cleanup_refs(struct ttm_buffer_object *bo,
  */
 static bool ttm_bo_delayed_delete(struct ttm_bo_device *bdev, bool remove_all)
 {
-	struct ttm_bo_global *glob = bdev->glob;
 	struct list_head removed;
 	bool empty;
 
 	INIT_LIST_HEAD(&removed);
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	while (!list_empty(&bdev->ddestroy)) {
 		struct ttm_buffer_object *bo;
 
@@ -637,24 +887,24 @@ static bool ttm_bo_delayed_delete(struct ttm_bo_device *bdev, bool remove_all)
 		list_move_tail(&bo->ddestroy, &removed);
 
 		if (remove_all || bo->resv != &bo->ttm_resv) {
-			spin_unlock(&glob->lru_lock);
+			ttm_bo_lru_unlock(bdev);
 			reservation_object_lock(bo->resv, NULL);
 
-			spin_lock(&glob->lru_lock);
+			ttm_bo_lru_lock(bdev);
 			ttm_bo_cleanup_refs(bo, false, !remove_all, true);
 
 		} else if (reservation_object_trylock(bo->resv)) {
 			ttm_bo_cleanup_refs(bo, false, !remove_all, true);
 		} else {
-			spin_unlock(&glob->lru_lock);
+			ttm_bo_lru_unlock(bdev);
 		}
 
 		kref_put(&bo->list_kref, ttm_bo_release_list);
-		spin_lock(&glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 	}
 	list_splice_tail(&removed, &bdev->ddestroy);
 	empty = list_empty(&bdev->ddestroy);
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	return empty;
 }
@@ -835,52 +1085,208 @@ static int ttm_mem_evict_wait_busy(struct ttm_buffer_object *busy_bo,
 	return r == -EDEADLK ? -EBUSY : r;
 }
 
+const struct ttm_evict_policy ttm_evict_policy_lru = {
+	.name = "lru",
+};
+EXPORT_SYMBOL(ttm_evict_policy_lru);
+
+/*
+ * Large enough BOs first, smaller ones before bigger ones. BOs too small to
+ * make room on their own keep their LRU order behind them.
+ */
+static bool ttm_evict_size_before(struct ttm_buffer_object *a,
+				  struct ttm_buffer_object *b,
+				  unsigned long num_pages)
+{
+	bool a_fits = a->num_pages >= num_pages;
+	bool b_fits = b->num_pages >= num_pages;
+
+	if (a_fits != b_fits)
+		return a_fits;
+	return a_fits && a->num_pages < b->num_pages;
+}
+
+static unsigned ttm_evict_size_select(struct ttm_mem_type_manager *man,
+				      struct list_head *lru,
+				      unsigned long num_pages,
+				      struct ttm_buffer_object **cand,
+				      unsigned max)
+{
+	struct ttm_buffer_object *bo;
+	unsigned n = 0, i;
+
+	list_for_each_entry(bo, lru, lru) {
+		if (n == max)
+			break;
+
+		for (i = n; i > 0 &&
+		     ttm_evict_size_before(bo, cand[i - 1], num_pages); --i)
+			cand[i] = cand[i - 1];
+		cand[i] = bo;
+		++n;
+	}
+
+	return n;
+}
+
+const struct ttm_evict_policy ttm_evict_policy_size = {
+	.name = "size",
+	.select = ttm_evict_size_select,
+};
+EXPORT_SYMBOL(ttm_evict_policy_size);
+
+/*
+ * The LRU head is the clock hand. ttm_bo_move_to_lru_tail() bumps the
+ * reference count of a BO, the hand decrements it and moves referenced BOs
+ * to the tail instead of evicting them.
+ */
+static unsigned ttm_evict_clock_select(struct ttm_mem_type_manager *man,
+				       struct list_head *lru,
+				       unsigned long num_pages,
+				       struct ttm_buffer_object **cand,
+				       unsigned max)
+{
+	struct ttm_bo_driver *driver = man->bdev->driver;
+	struct ttm_buffer_object *bo, *tmp;
+	unsigned n = 0, scanned = 0;
+
+	list_for_each_entry_safe(bo, tmp, lru, lru) {
+		if (n == max || scanned++ == 4 * max)
+			break;
+
+		if (bo->evict_ref) {
+			bo->evict_ref--;
+			list_move_tail(&bo->lru, lru);
+			/* Drivers tracking LRU positions need to know */
+			if (driver->del_from_lru_notify)
+				driver->del_from_lru_notify(bo);
+			continue;
+		}
+		cand[n++] = bo;
+	}
+
+	return n;
+}
+
+const struct ttm_evict_policy ttm_evict_policy_clock = {
+	.name = "clock",
+	.select = ttm_evict_clock_select,
+};
+EXPORT_SYMBOL(ttm_evict_policy_clock);
+
+const struct ttm_evict_policy *ttm_evict_policy_find(const char *name)
+{
+	static const struct ttm_evict_policy *policies[] = {
+		&ttm_evict_policy_lru,
+		&ttm_evict_policy_size,
+		&ttm_evict_policy_clock,
+	};
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(policies); ++i)
+		if (name && !strcmp(name, policies[i]->name))
+			return policies[i];
+
+	return NULL;
+}
+EXPORT_SYMBOL(ttm_evict_policy_find);
+
+/*
+ * Check if @bo can be evicted to make room for @place, locking it if needed.
+ * Remembers the first BO that was only busy in @busy_bo.
+ */
+static bool ttm_mem_evict_try(struct ttm_buffer_object *bo,
+			      const struct ttm_place *place,
+			      struct ttm_operation_ctx *ctx,
+			      struct ww_acquire_ctx *ticket, bool *locked,
+			      struct ttm_buffer_object **busy_bo)
+{
+	bool busy;
+
+	if (!ttm_bo_evict_swapout_allowable(bo, ctx, locked, &busy)) {
+		if (busy && !*busy_bo && bo->resv->lock.ctx != ticket)
+			*busy_bo = bo;
+		return false;
+	}
+
+	if (place && !bo->bdev->driver->eviction_valuable(bo, place)) {
+		if (*locked)
+			reservation_object_unlock(bo->resv);
+		return false;
+	}
+
+	return true;
+}
+
+static bool ttm_mem_evict_tried(struct ttm_buffer_object *bo,
+				struct ttm_buffer_object **cand, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; ++i)
+		if (cand[i] == bo)
+			return true;
+	return false;
+}
+
+static struct ttm_buffer_object *
+ttm_mem_evict_pick(struct ttm_mem_type_manager *man, struct list_head *lru,
+		   unsigned long num_pages, const struct ttm_place *place,
+		   struct ttm_operation_ctx *ctx, struct ww_acquire_ctx *ticket,
+		   bool *locked, struct ttm_buffer_object **busy_bo)
+{
+	const struct ttm_evict_policy *policy = man->evict_policy;
+	struct ttm_buffer_object *cand[TTM_EVICT_POLICY_WINDOW];
+	struct ttm_buffer_object *bo;
+	unsigned i, n = 0;
+
+	if (policy && policy->select) {
+		n = policy->select(man, lru, num_pages, cand,
+				   ARRAY_SIZE(cand));
+		for (i = 0; i < n; ++i)
+			if (ttm_mem_evict_try(cand[i], place, ctx, ticket,
+					      locked, busy_bo))
+				return cand[i];
+	}
+
+	/* Fall back to the rest of the LRU, skipping what already failed */
+	list_for_each_entry(bo, lru, lru) {
+		if (n && ttm_mem_evict_tried(bo, cand, n))
+			continue;
+
+		if (ttm_mem_evict_try(bo, place, ctx, ticket, locked,
+				      busy_bo))
+			return bo;
+	}
+
+	return NULL;
+}
+
 static int ttm_mem_evict_first(struct ttm_bo_device *bdev,
 			       uint32_t mem_type,
 			       const struct ttm_place *place,
+			       unsigned long num_pages,
 			       struct ttm_operation_ctx *ctx,
 			       struct ww_acquire_ctx *ticket)
 {
 	struct ttm_buffer_object *bo = NULL, *busy_bo = NULL;
-	struct ttm_bo_global *glob = bdev->glob;
 	struct ttm_mem_type_manager *man = &bdev->man[mem_type];
 	bool locked = false;
 	unsigned i;
 	int ret;
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
-		list_for_each_entry(bo, &man->lru[i], lru) {
-			bool busy;
-
-			if (!ttm_bo_evict_swapout_allowable(bo, ctx, &locked,
-							    &busy)) {
-				if (busy && !busy_bo &&
-				    bo->resv->lock.ctx != ticket)
-					busy_bo = bo;
-				continue;
-			}
-
-			if (place && !bdev->driver->eviction_valuable(bo,
-								      place)) {
-				if (locked)
-					reservation_object_unlock(bo->resv);
-				continue;
-			}
+		bo = ttm_mem_evict_pick(man, &man->lru[i], num_pages, place,
+					ctx, ticket, &locked, &busy_bo);
+		if (bo)
 			break;
-		}
-
-		/* If the inner loop terminated early, we have our candidate */
-		if (&bo->lru != &man->lru[i])
-			break;
-
-		bo = NULL;
 	}
 
 	if (!bo) {
 		if (busy_bo)
 			ttm_bo_get(busy_bo);
-		spin_unlock(&glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 		ret = ttm_mem_evict_wait_busy(busy_bo, ctx, ticket);
 		if (busy_bo)
 			ttm_bo_put(busy_bo);
@@ -897,15 +1303,17 @@ static int ttm_mem_evict_first(struct ttm_bo_device *bdev,
 	}
 
 	ttm_bo_del_from_lru(bo);
-	spin_unlock(&glob->lru_lock);
+	man->evictions++;
+	man->evicted_bytes += (u64)bo->num_pages << PAGE_SHIFT;
+	ttm_bo_lru_unlock(bdev);
 
 	ret = ttm_bo_evict(bo, ctx);
 	if (locked) {
 		ttm_bo_unreserve(bo);
 	} else {
-		spin_lock(&glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 		ttm_bo_add_to_lru(bo);
-		spin_unlock(&glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 	}
 
 	kref_put(&bo->list_kref, ttm_bo_release_list);
@@ -970,7 +1378,8 @@ static int ttm_bo_mem_force_space(struct ttm_buffer_object *bo,
 			return ret;
 		if (mem->mm_node)
 			break;
-		ret = ttm_mem_evict_first(bdev, mem->mem_type, place, ctx,
+		ret = ttm_mem_evict_first(bdev, mem->mem_type, place,
+					  mem->num_pages, ctx,
 					  bo->resv->lock.ctx);
 		if (unlikely(ret != 0))
 			return ret;
@@ -1067,10 +1476,10 @@ static int ttm_bo_mem_placement(struct ttm_buffer_object *bo,
 	mem->placement = cur_flags;
 
 	if (bo->mem.mem_type < mem_type && !list_empty(&bo->lru)) {
-		spin_lock(&bo->bdev->glob->lru_lock);
+		ttm_bo_lru_lock(bo->bdev);
 		ttm_bo_del_from_lru(bo);
 		ttm_bo_add_mem_to_lru(bo, mem);
-		spin_unlock(&bo->bdev->glob->lru_lock);
+		ttm_bo_lru_unlock(bo->bdev);
 	}
 
 	return 0;
@@ -1158,9 +1567,9 @@ int ttm_bo_mem_space(struct ttm_buffer_object *bo,
 
 error:
 	if (bo->mem.mem_type == TTM_PL_SYSTEM && !list_empty(&bo->lru)) {
-		spin_lock(&bo->bdev->glob->lru_lock);
+		ttm_bo_lru_lock(bo->bdev);
 		ttm_bo_move_to_lru_tail(bo, NULL);
-		spin_unlock(&bo->bdev->glob->lru_lock);
+		ttm_bo_lru_unlock(bo->bdev);
 	}
 
 	return ret;
@@ -1318,6 +1727,7 @@ int ttm_bo_init_reserved(struct ttm_bo_device *bdev,
 	INIT_LIST_HEAD(&bo->ddestroy);
 	INIT_LIST_HEAD(&bo->swap);
 	INIT_LIST_HEAD(&bo->io_reserve_lru);
+	bo->evict_ref = 0;
 	mutex_init(&bo->wu_mutex);
 	bo->bdev = bdev;
 	bo->type = type;
@@ -1372,9 +1782,9 @@ int ttm_bo_init_reserved(struct ttm_bo_device *bdev,
 	}
 
 	if (resv && !(bo->mem.placement & TTM_PL_FLAG_NO_EVICT)) {
-		spin_lock(&bdev->glob->lru_lock);
+		ttm_bo_lru_lock(bdev);
 		ttm_bo_add_to_lru(bo);
-		spin_unlock(&bdev->glob->lru_lock);
+		ttm_bo_lru_unlock(bdev);
 	}
 
 	return ret;
@@ -1473,7 +1883,6 @@ static int ttm_bo_force_list_clean(struct ttm_bo_device *bdev,
 		.flags = TTM_OPT_FLAG_FORCE_ALLOC
 	};
 	struct ttm_mem_type_manager *man = &bdev->man[mem_type];
-	struct ttm_bo_global *glob = bdev->glob;
 	struct dma_fence *fence;
 	int ret;
 	unsigned i;
@@ -1482,18 +1891,18 @@ static int ttm_bo_force_list_clean(struct ttm_bo_device *bdev,
 	 * Can't use standard list traversal since we're unlocking.
 	 */
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
 		while (!list_empty(&man->lru[i])) {
-			spin_unlock(&glob->lru_lock);
-			ret = ttm_mem_evict_first(bdev, mem_type, NULL, &ctx,
-						  NULL);
+			ttm_bo_lru_unlock(bdev);
+			ret = ttm_mem_evict_first(bdev, mem_type, NULL, 0,
+						  &ctx, NULL);
 			if (ret)
 				return ret;
-			spin_lock(&glob->lru_lock);
+			ttm_bo_lru_lock(bdev);
 		}
 	}
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	spin_lock(&man->move_lock);
 	fence = dma_fence_get(man->move);
@@ -1641,7 +2050,7 @@ static int ttm_bo_global_init(void)
 	if (ret)
 		goto out;
 
-	spin_lock_init(&glob->lru_lock);
+	spin_lock_init(&glob->swap_lock);
 	glob->mem_glob = &ttm_mem_glob;
 	glob->mem_glob->bo_glob = glob;
 	glob->dummy_read_page = alloc_page(__GFP_ZERO | GFP_DMA32);
@@ -1655,6 +2064,28 @@ static int ttm_bo_global_init(void)
 		INIT_LIST_HEAD(&glob->swap_lru[i]);
 	INIT_LIST_HEAD(&glob->device_list);
 	atomic_set(&glob->bo_count, 0);
+	atomic64_set(&glob->vm_faults, 0);
+	atomic64_set(&glob->vm_huge_faults, 0);
+	atomic64_set(&glob->vm_window_faults, 0);
+	atomic64_set(&glob->vm_fault_pages, 0);
+	atomic64_set(&glob->memcpy_moves, 0);
+	atomic64_set(&glob->memcpy_bytes, 0);
+	atomic64_set(&glob->memcpy_ns, 0);
+	glob->eu_sorted = false;
+	atomic64_set(&glob->eu_reserves, 0);
+	atomic64_set(&glob->eu_backoffs, 0);
+	atomic64_set(&glob->eu_contended, 0);
+	atomic64_set(&glob->eu_backoff_ns, 0);
+	glob->swap_compress = false;
+	glob->swap_compress_limit = TTM_SWAP_COMPRESS_DEFAULT_LIMIT;
+	atomic64_set(&glob->swap_comp_orig, 0);
+	atomic64_set(&glob->swap_comp_stored, 0);
+	atomic64_set(&glob->swap_comp_zero, 0);
+	atomic64_set(&glob->swap_comp_rejects, 0);
+	atomic64_set(&glob->swapin_comp, 0);
+	atomic64_set(&glob->swapin_comp_ns, 0);
+	atomic64_set(&glob->swapin_shmem, 0);
+	atomic64_set(&glob->swapin_shmem_ns, 0);
 
 	ret = kobject_init_and_add(
 		&glob->kobj, &ttm_bo_glob_kobj_type, ttm_get_kobj(), "buffer_objects");
@@ -1670,7 +2101,6 @@ int ttm_bo_device_release(struct ttm_bo_device *bdev)
 	int ret = 0;
 	unsigned i = TTM_NUM_MEM_TYPES;
 	struct ttm_mem_type_manager *man;
-	struct ttm_bo_global *glob = bdev->glob;
 
 	while (i--) {
 		man = &bdev->man[i];
@@ -1694,11 +2124,11 @@ int ttm_bo_device_release(struct ttm_bo_device *bdev)
 	if (ttm_bo_delayed_delete(bdev, true))
 		pr_debug("Delayed destroy list was clean\n");
 
-	spin_lock(&glob->lru_lock);
+	ttm_bo_lru_lock(bdev);
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i)
 		if (list_empty(&bdev->man[0].lru[0]))
 			pr_debug("Swap list %d was clean\n", i);
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	drm_vma_offset_manager_destroy(&bdev->vma_manager);
 
@@ -1728,6 +2158,8 @@ int ttm_bo_device_init(struct ttm_bo_device *bdev,
 	bdev->driver = driver;
 
 	memset(bdev->man, 0, sizeof(bdev->man));
+	spin_lock_init(&bdev->lru_lock);
+	memset(&bdev->lru_stats, 0, sizeof(bdev->lru_stats));
 
 	/*
 	 * Initialize the system memory buffer type.
@@ -1857,15 +2289,21 @@ EXPORT_SYMBOL(ttm_bo_synccpu_write_release);
 /**
  * A buffer object shrink method that tries to swap out the first
  * buffer object on the bo_global::swap_lru list.
+ *
+ * The swap lists span all devices while the LRU lock is per device, so the
+ * candidate is picked under the swap lock only and the device LRU lock is
+ * taken after dropping it, keeping the lru_lock -> swap_lock ordering.
+ * The reservation and list reference keep the BO stable in between.
  */
 int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
 {
 	struct ttm_buffer_object *bo;
+	struct ttm_bo_device *bdev;
 	int ret = -EBUSY;
 	bool locked;
 	unsigned i;
 
-	spin_lock(&glob->lru_lock);
+	spin_lock(&glob->swap_lock);
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
 		list_for_each_entry(bo, &glob->swap_lru[i], swap) {
 			if (ttm_bo_evict_swapout_allowable(bo, ctx, &locked,
@@ -1879,11 +2317,15 @@ int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
 	}
 
 	if (ret) {
-		spin_unlock(&glob->lru_lock);
+		spin_unlock(&glob->swap_lock);
 		return ret;
 	}
 
 	kref_get(&bo->list_kref);
+	spin_unlock(&glob->swap_lock);
+
+	bdev = bo->bdev;
+	ttm_bo_lru_lock(bdev);
 
 	if (!list_empty(&bo->ddestroy)) {
 		ret = ttm_bo_cleanup_refs(bo, false, false, locked);
@@ -1892,7 +2334,7 @@ int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
 	}
 
 	ttm_bo_del_from_lru(bo);
-	spin_unlock(&glob->lru_lock);
+	ttm_bo_lru_unlock(bdev);
 
 	/**
 	 * Move to system cached
@@ -1946,6 +2388,50 @@ out:
 }
 EXPORT_SYMBOL(ttm_bo_swapout);
 
+/**
+ * ttm_bo_lru_debug - print LRU lock statistics of a device
+ *
+ * @bdev: The buffer object device.
+ * @p: The printer to print to.
+ */
+void ttm_bo_lru_debug(struct ttm_bo_device *bdev, struct drm_printer *p)
+{
+	u64 count, contended, hold_ns, hold_max_ns;
+	unsigned i;
+
+	ttm_bo_lru_lock(bdev);
+	count = bdev->lru_stats.count;
+	contended = bdev->lru_stats.contended;
+	hold_ns = bdev->lru_stats.hold_ns;
+	hold_max_ns = bdev->lru_stats.hold_max_ns;
+	ttm_bo_lru_unlock(bdev);
+
+	drm_printf(p, "lru lock acquisitions: %llu\n", count);
+	drm_printf(p, "lru lock contended: %llu\n", contended);
+	drm_printf(p, "lru lock hold total: %llu ns\n", hold_ns);
+	drm_printf(p, "lru lock hold avg: %llu ns\n",
+		   count ? div64_u64(hold_ns, count) : 0);
+	drm_printf(p, "lru lock hold max: %llu ns\n", hold_max_ns);
+
+	for (i = 0; i < TTM_NUM_MEM_TYPES; ++i) {
+		struct ttm_mem_type_manager *man = &bdev->man[i];
+		u64 evictions, evicted_bytes;
+
+		if (!man->has_type)
+			continue;
+
+		ttm_bo_lru_lock(bdev);
+		evictions = man->evictions;
+		evicted_bytes = man->evicted_bytes;
+		ttm_bo_lru_unlock(bdev);
+
+		drm_printf(p, "mem type %u: policy %s, evictions %llu, evicted %llu bytes\n",
+			   i, man->evict_policy ? man->evict_policy->name :
+			   ttm_evict_policy_lru.name, evictions, evicted_bytes);
+	}
+}
+EXPORT_SYMBOL(ttm_bo_lru_debug);
+
 void ttm_bo_swapout_all(struct ttm_bo_device *bdev)
 {
 	struct ttm_operation_ctx ctx = {
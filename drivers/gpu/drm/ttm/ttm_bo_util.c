@@ -39,6 +39,25 @@
 #include <linux/vmalloc.h>
 #include <linux/module.h>
 #include <linux/reservation.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#ifdef CONFIG_AS_MOVNTDQA
+#ifdef __linux__
+#include <asm/fpu/api.h>
+#include <asm/cpufeature.h>
+#elif defined(__FreeBSD__)
+#include <x86/x86_var.h>
+#endif
+#include "ttm_memcpy_stream.h"
+#endif
+
+/*
+ * ttm_bo_move_memcpy() splits moves of at least two chunks across
+ * worker threads, capped at TTM_MEMCPY_MAX_WORKERS.
+ */
+#define TTM_MEMCPY_CHUNK_PAGES	256
+#define TTM_MEMCPY_MAX_WORKERS	8
 
 struct ttm_transfer_obj {
 	struct ttm_buffer_object base;
@@ -248,7 +267,69 @@ static void ttm_mem_reg_iounmap(struct ttm_bo_device *bdev, struct ttm_mem_reg *
 	ttm_mem_io_unlock(man);
 }
 
-static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
+#ifdef CONFIG_AS_MOVNTDQA
+static void __ttm_memcpy_stream(void *dst, const void *src, unsigned long len)
+{
+#ifdef __linux__
+	kernel_fpu_begin();
+#elif defined(__FreeBSD__)
+	/*
+	 * kernel_fpu_begin() shares one context per compilation unit, which
+	 * the copy workers would race on. A NOCTX section is fine for the
+	 * single page copied here.
+	 */
+	fpu_kern_enter(curthread, NULL, FPU_KERN_NOCTX);
+#endif
+
+	ttm_memcpy_stream_loop(dst, src, len);
+
+#ifdef __linux__
+	kernel_fpu_end();
+#elif defined(__FreeBSD__)
+	fpu_kern_leave(curthread, NULL);
+#endif
+}
+#endif
+
+/**
+ * ttm_memcpy_stream - Copy using non-temporal loads and stores.
+ *
+ * @dst: Destination, 64 byte aligned.
+ * @src: Source, 64 byte aligned.
+ * @len: Number of bytes, a multiple of 64.
+ *
+ * Streaming loads are the only way to read write-combined memory at
+ * reasonable speed, and streaming stores avoid pulling the destination
+ * into the cache. Returns false if the CPU lacks SSE4.1 or the
+ * arguments are misaligned, in which case the caller must fall back to
+ * a regular copy.
+ */
+static bool ttm_memcpy_stream(void *dst, const void *src, unsigned long len)
+{
+	if (((unsigned long)dst | (unsigned long)src | len) & 63)
+		return false;
+
+#ifdef CONFIG_AS_MOVNTDQA
+#ifdef __linux__
+	/*
+	 * Some hypervisors don't emulate VEX-prefix instructions, so stay
+	 * away from movntdqa in guests like i915 does.
+	 */
+	if (static_cpu_has(X86_FEATURE_XMM4_1) &&
+	    !boot_cpu_has(X86_FEATURE_HYPERVISOR)) {
+#elif defined(__FreeBSD__)
+	if ((cpu_feature2 & CPUID2_SSE41) && vm_guest == VM_GUEST_NO) {
+#endif
+		__ttm_memcpy_stream(dst, src, len);
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+static int ttm_copy_io_page(void *dst, void *src, unsigned long page,
+			    bool stream)
 {
 	uint32_t *dstP =
 	    (uint32_t *) ((unsigned long)dst + (page << PAGE_SHIFT));
@@ -256,6 +337,10 @@ static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
 	    (uint32_t *) ((unsigned long)src + (page << PAGE_SHIFT));
 
 	int i;
+
+	if (stream && ttm_memcpy_stream(dstP, srcP, PAGE_SIZE))
+		return 0;
+
 	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); ++i)
 		iowrite32(ioread32(srcP++), dstP++);
 	return 0;
@@ -311,7 +396,7 @@ EXPORT_SYMBOL(ttm_kunmap_atomic_prot);
 
 static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
 				unsigned long page,
-				pgprot_t prot)
+				pgprot_t prot, bool stream)
 {
 	struct page *d = ttm->pages[page];
 	void *dst;
@@ -324,7 +409,8 @@ static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
 	if (!dst)
 		return -ENOMEM;
 
-	memcpy_fromio(dst, src, PAGE_SIZE);
+	if (!stream || !ttm_memcpy_stream(dst, src, PAGE_SIZE))
+		memcpy_fromio(dst, src, PAGE_SIZE);
 
 	ttm_kunmap_atomic_prot(dst, prot);
 
@@ -333,7 +419,7 @@ static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
 
 static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
 				unsigned long page,
-				pgprot_t prot)
+				pgprot_t prot, bool stream)
 {
 	struct page *s = ttm->pages[page];
 	void *src;
@@ -346,13 +432,121 @@ static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
 	if (!src)
 		return -ENOMEM;
 
-	memcpy_toio(dst, src, PAGE_SIZE);
+	if (!stream || !ttm_memcpy_stream(dst, src, PAGE_SIZE))
+		memcpy_toio(dst, src, PAGE_SIZE);
 
 	ttm_kunmap_atomic_prot(src, prot);
 
 	return 0;
 }
 
+/**
+ * struct ttm_copy_job - State shared by the workers of one memcpy move.
+ *
+ * Pages are handed out in TTM_MEMCPY_CHUNK_PAGES sized chunks through
+ * @next, so workers that get scheduled late simply pick up less work.
+ */
+struct ttm_copy_job {
+	struct ttm_tt *ttm;
+	void *old_iomap;
+	void *new_iomap;
+	pgprot_t old_prot;
+	pgprot_t new_prot;
+	bool stream;
+	unsigned long num_pages;
+	atomic_t next;
+	atomic_t error;
+};
+
+struct ttm_copy_work {
+	struct work_struct work;
+	struct ttm_copy_job *job;
+};
+
+static int ttm_copy_page(struct ttm_copy_job *job, unsigned long page)
+{
+	if (job->old_iomap == NULL)
+		return ttm_copy_ttm_io_page(job->ttm, job->new_iomap, page,
+					    job->old_prot, job->stream);
+	else if (job->new_iomap == NULL)
+		return ttm_copy_io_ttm_page(job->ttm, job->old_iomap, page,
+					    job->new_prot, job->stream);
+	else
+		return ttm_copy_io_page(job->new_iomap, job->old_iomap, page,
+					job->stream);
+}
+
+static void ttm_copy_job_run(struct ttm_copy_job *job)
+{
+	unsigned long start, end, page;
+	int ret;
+
+	while (!atomic_read(&job->error)) {
+		start = atomic_add_return(TTM_MEMCPY_CHUNK_PAGES,
+					  &job->next) -
+			TTM_MEMCPY_CHUNK_PAGES;
+		if (start >= job->num_pages)
+			break;
+		end = min(start + TTM_MEMCPY_CHUNK_PAGES, job->num_pages);
+
+		for (page = start; page < end; ++page) {
+			ret = ttm_copy_page(job, page);
+			if (ret) {
+				atomic_cmpxchg(&job->error, 0, ret);
+				break;
+			}
+		}
+		cond_resched();
+	}
+}
+
+static void ttm_copy_work_func(struct work_struct *work)
+{
+	struct ttm_copy_work *cw = container_of(work, struct ttm_copy_work,
+						work);
+
+	ttm_copy_job_run(cw->job);
+}
+
+/*
+ * Copy all pages of a non-overlapping move. The calling thread works on
+ * the job as well, so a failed allocation or a busy workqueue only
+ * costs parallelism. Once the caller runs out of chunks, work items
+ * that haven't started yet are cancelled instead of waited for; with
+ * system_unbound_wq saturated, e.g. under reclaim, they might otherwise
+ * never get to run.
+ */
+static int ttm_copy_parallel(struct ttm_copy_job *job)
+{
+	struct ttm_copy_work *works = NULL;
+	unsigned nworkers, i;
+
+	nworkers = min_t(unsigned long, num_online_cpus(),
+			 job->num_pages / TTM_MEMCPY_CHUNK_PAGES);
+	nworkers = min_t(unsigned, nworkers, TTM_MEMCPY_MAX_WORKERS);
+	if (nworkers > 1)
+		works = kcalloc(nworkers - 1, sizeof(*works),
+				GFP_KERNEL | __GFP_NOWARN);
+	if (!works)
+		nworkers = 1;
+
+	atomic_set(&job->next, 0);
+	atomic_set(&job->error, 0);
+
+	for (i = 0; i < nworkers - 1; ++i) {
+		works[i].job = job;
+		INIT_WORK(&works[i].work, ttm_copy_work_func);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+
+	ttm_copy_job_run(job);
+	for (i = 0; i < nworkers - 1; ++i)
+		cancel_work_sync(&works[i].work);
+	kfree(works);
+
+	return atomic_read(&job->error);
+}
+
 int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		       struct ttm_operation_ctx *ctx,
 		       struct ttm_mem_reg *new_mem)
@@ -369,6 +563,8 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 	unsigned long page;
 	unsigned long add = 0;
 	int dir;
+	struct ttm_copy_job job;
+	ktime_t start;
 
 	ret = ttm_bo_wait(bo, ctx->interruptible, ctx->no_wait_gpu);
 	if (ret)
@@ -415,24 +611,40 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		add = new_mem->num_pages - 1;
 	}
 
-	for (i = 0; i < new_mem->num_pages; ++i) {
-		page = i * dir + add;
-		if (old_iomap == NULL) {
-			pgprot_t prot = ttm_io_prot(old_mem->placement,
-						    PAGE_KERNEL);
-			ret = ttm_copy_ttm_io_page(ttm, new_iomap, page,
-						   prot);
-		} else if (new_iomap == NULL) {
-			pgprot_t prot = ttm_io_prot(new_mem->placement,
-						    PAGE_KERNEL);
-			ret = ttm_copy_io_ttm_page(ttm, old_iomap, page,
-						   prot);
-		} else {
-			ret = ttm_copy_io_page(new_iomap, old_iomap, page);
+	job.ttm = ttm;
+	job.old_iomap = old_iomap;
+	job.new_iomap = new_iomap;
+	job.old_prot = ttm_io_prot(old_mem->placement, PAGE_KERNEL);
+	job.new_prot = ttm_io_prot(new_mem->placement, PAGE_KERNEL);
+	job.num_pages = new_mem->num_pages;
+	/*
+	 * Stream whenever one side is not cached: loads from WC are only
+	 * fast with movntdqa and stores to WC/iomem gain nothing from
+	 * going through the cache.
+	 */
+	job.stream = !(old_mem->placement & TTM_PL_FLAG_CACHED) ||
+		     !(new_mem->placement & TTM_PL_FLAG_CACHED);
+
+	start = ktime_get();
+	if (dir == 1) {
+		/* No overlap, the pages can be copied in any order. */
+		ret = ttm_copy_parallel(&job);
+	} else {
+		for (i = 0; i < new_mem->num_pages; ++i) {
+			page = i * dir + add;
+			ret = ttm_copy_page(&job, page);
+			if (ret)
+				break;
 		}
-		if (ret)
-			goto out1;
 	}
+	if (ret)
+		goto out1;
+
+	atomic64_inc(&ttm_bo_glob.memcpy_moves);
+	atomic64_add((u64)new_mem->num_pages << PAGE_SHIFT,
+		     &ttm_bo_glob.memcpy_bytes);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &ttm_bo_glob.memcpy_ns);
 	mb();
 out2:
 	old_copy = *old_mem;
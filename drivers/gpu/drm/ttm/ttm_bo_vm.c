@@ -106,11 +106,105 @@ static unsigned long ttm_bo_io_mem_pfn(struct ttm_buffer_object *bo,
 		+ page_offset;
 }
 
-#ifdef __linux__
-static vm_fault_t ttm_bo_vm_fault(struct vm_fault *vmf)
-#elif defined(__FreeBSD__)
-static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault *vmf)
+/*
+ * Check whether the @nr pages starting at @page_offset are backed by
+ * physically contiguous memory, aligned to @nr pages, so they can be mapped
+ * with a single huge page table entry.
+ */
+static bool ttm_bo_vm_contiguous(struct ttm_buffer_object *bo,
+				 unsigned long page_offset,
+				 unsigned long page_last,
+				 unsigned long nr)
+{
+	struct ttm_tt *ttm = bo->ttm;
+	unsigned long pfn, i;
+
+	if (page_offset + nr > page_last || page_offset + nr > bo->num_pages)
+		return false;
+
+	if (bo->mem.bus.is_iomem) {
+		pfn = ttm_bo_io_mem_pfn(bo, page_offset);
+	} else {
+		if (!ttm->pages[page_offset])
+			return false;
+		pfn = page_to_pfn(ttm->pages[page_offset]);
+	}
+
+	if (pfn & (nr - 1))
+		return false;
+
+	/* Without a driver callback the aperture is linear */
+	if (bo->mem.bus.is_iomem && !bo->bdev->driver->io_mem_pfn)
+		return true;
+
+	for (i = 1; i < nr; ++i) {
+		if (bo->mem.bus.is_iomem) {
+			if (ttm_bo_io_mem_pfn(bo, page_offset + i) != pfn + i)
+				return false;
+		} else {
+			struct page *page = ttm->pages[page_offset + i];
+
+			if (!page || page_to_pfn(page) != pfn + i)
+				return false;
+		}
+	}
+	return true;
+}
+
+#if defined(__linux__) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+/*
+ * Map the whole PMD around the fault address, return VM_FAULT_FALLBACK
+ * to let the core retry with normal sized pages if that isn't possible.
+ */
+static vm_fault_t ttm_bo_vm_insert_huge(struct vm_fault *vmf,
+					struct vm_area_struct *cvma,
+					struct ttm_buffer_object *bo,
+					unsigned long page_offset,
+					unsigned long page_last)
+{
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	unsigned long delta = (vmf->address - haddr) >> PAGE_SHIFT;
+	unsigned long pfn, i;
+	vm_fault_t ret;
+
+	if (haddr < cvma->vm_start || haddr + HPAGE_PMD_SIZE > cvma->vm_end ||
+	    delta > page_offset)
+		return VM_FAULT_FALLBACK;
+
+	page_offset -= delta;
+	if (!ttm_bo_vm_contiguous(bo, page_offset, page_last, HPAGE_PMD_NR))
+		return VM_FAULT_FALLBACK;
+
+	if (bo->mem.bus.is_iomem) {
+		/* Iomem should not be marked encrypted */
+		cvma->vm_page_prot = pgprot_decrypted(cvma->vm_page_prot);
+		pfn = ttm_bo_io_mem_pfn(bo, page_offset);
+	} else {
+		for (i = 0; i < HPAGE_PMD_NR; ++i)
+			bo->ttm->pages[page_offset + i]->index =
+				drm_vma_node_start(&bo->vma_node) +
+				page_offset + i;
+		pfn = page_to_pfn(bo->ttm->pages[page_offset]);
+	}
+
+	ret = vmf_insert_pfn_pmd(cvma, vmf->address, vmf->pmd,
+				 __pfn_to_pfn_t(pfn, PFN_DEV),
+				 vmf->flags & FAULT_FLAG_WRITE);
+	if (ret != VM_FAULT_NOPAGE)
+		return VM_FAULT_FALLBACK;
+
+	atomic64_inc(&ttm_bo_glob.vm_huge_faults);
+	atomic64_add(HPAGE_PMD_NR, &ttm_bo_glob.vm_fault_pages);
+	return VM_FAULT_NOPAGE;
+}
 #endif
+
+/*
+ * Common fault handler. @fault_page_size is the number of pages the core
+ * asks to be mapped with one entry, anything but 1 is a huge fault.
+ */
+static vm_fault_t ttm_bo_vm_fault_common(struct vm_fault *vmf,
+					 unsigned long fault_page_size)
 {
 	struct vm_area_struct *vma = vmf->vma;
 	struct ttm_buffer_object *bo = (struct ttm_buffer_object *)
@@ -129,6 +223,8 @@ static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault
 		&bdev->man[bo->mem.mem_type];
 	struct vm_area_struct cvma;
 
+	atomic64_inc(&ttm_bo_glob.vm_faults);
+
 	/*
 	 * Work around locking order reversal in fault / nopfn
 	 * between mmap_sem and bo_reserve: Perform a trylock operation
@@ -181,9 +277,9 @@ static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault
 		}
 
 		if (bo->moving != moving) {
-			spin_lock(&bdev->glob->lru_lock);
+			ttm_bo_lru_lock(bdev);
 			ttm_bo_move_to_lru_tail(bo, NULL);
-			spin_unlock(&bdev->glob->lru_lock);
+			ttm_bo_lru_unlock(bdev);
 		}
 		dma_fence_put(moving);
 	}
@@ -254,6 +350,14 @@ static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault
 		}
 	}
 
+#if defined(__linux__) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+	if (fault_page_size > 1) {
+		ret = ttm_bo_vm_insert_huge(vmf, &cvma, bo, page_offset,
+					    page_last);
+		goto out_io_unlock;
+	}
+#endif
+
 	/*
 	 * Speculatively prefault a number of pages. Only error on
 	 * first page.
@@ -293,6 +397,7 @@ static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault
 		else if (unlikely(ret & VM_FAULT_ERROR))
 			goto out_io_unlock;
 
+		atomic64_inc(&ttm_bo_glob.vm_fault_pages);
 		address += PAGE_SIZE;
 		if (unlikely(++page_offset >= page_last))
 			break;
@@ -300,14 +405,33 @@ static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault
 #elif defined(__FreeBSD__)
 	vm_object_t obj;
 	vm_pindex_t pidx;
+	unsigned long huge_nr = pagesizes[1] >> PAGE_SHIFT;
+	int num_prefault = TTM_BO_VM_NUM_PREFAULT;
 
 	ret = VM_FAULT_NOPAGE;
 	obj = vma->vm_obj;
 	pidx = OFF_TO_IDX(address);
+
+	/*
+	 * If the superpage sized window around the fault is backed by
+	 * contiguous and aligned memory, prefault all of it at once instead
+	 * of the usual TTM_BO_VM_NUM_PREFAULT pages. This still enters 4K
+	 * mappings; pmap can't promote them as the pages are fictitious or
+	 * not reservation backed, it only saves the follow-up faults.
+	 */
+	if (huge_nr > 1 && (pidx & (huge_nr - 1)) ==
+	    (page_offset & (huge_nr - 1)) &&
+	    ttm_bo_vm_contiguous(bo, page_offset & ~(huge_nr - 1),
+				 page_last, huge_nr)) {
+		pidx &= ~(vm_pindex_t)(huge_nr - 1);
+		page_offset &= ~(huge_nr - 1);
+		num_prefault = huge_nr;
+		atomic64_inc(&ttm_bo_glob.vm_window_faults);
+	}
 	vma->vm_pfn_first = pidx;
 
 	VM_OBJECT_WLOCK(obj);
-	for (i = 0; i < TTM_BO_VM_NUM_PREFAULT && page_offset < page_last;
+	for (i = 0; i < num_prefault && page_offset < page_last;
 	    i++, page_offset++, pidx++) {
 retry:
 		page = vm_page_grab(obj, pidx, VM_ALLOC_NOCREAT);
@@ -332,6 +456,7 @@ retry:
 		pmap_page_set_memattr(page,
 		    pgprot2cachemode(cvma.vm_page_prot));
 		vma->vm_pfn_count++;
+		atomic64_inc(&ttm_bo_glob.vm_fault_pages);
 		continue;
 fail:
 		if (i == 0)
@@ -347,6 +472,26 @@ out_unlock:
 	return ret;
 }
 
+#ifdef __linux__
+static vm_fault_t ttm_bo_vm_fault(struct vm_fault *vmf)
+#elif defined(__FreeBSD__)
+static vm_fault_t ttm_bo_vm_fault(struct vm_area_struct *dummy, struct vm_fault *vmf)
+#endif
+{
+	return ttm_bo_vm_fault_common(vmf, 1);
+}
+
+#if defined(__linux__) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+static vm_fault_t ttm_bo_vm_huge_fault(struct vm_fault *vmf,
+				       enum page_entry_size pe_size)
+{
+	if (pe_size != PE_SIZE_PMD)
+		return VM_FAULT_FALLBACK;
+
+	return ttm_bo_vm_fault_common(vmf, HPAGE_PMD_NR);
+}
+#endif
+
 static void ttm_bo_vm_open(struct vm_area_struct *vma)
 {
 	struct ttm_buffer_object *bo =
@@ -446,6 +591,9 @@ static int ttm_bo_vm_access(struct vm_area_struct *vma, unsigned long addr,
 
 static const struct vm_operations_struct ttm_bo_vm_ops = {
 	.fault = ttm_bo_vm_fault,
+#if defined(__linux__) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+	.huge_fault = ttm_bo_vm_huge_fault,
+#endif
 	.open = ttm_bo_vm_open,
 	.close = ttm_bo_vm_close,
 	.access = ttm_bo_vm_access
@@ -32,6 +32,8 @@
 #include <linux/wait.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/list_sort.h>
+#include <linux/ktime.h>
 
 static void ttm_eu_backoff_reservation_reverse(struct list_head *list,
 					      struct ttm_validate_buffer *entry)
@@ -43,43 +45,100 @@ static void ttm_eu_backoff_reservation_reverse(struct list_head *list,
 	}
 }
 
-static void ttm_eu_del_from_lru_locked(struct list_head *list)
+/*
+ * The LRU lock is per device. Lists normally hold BOs of a single device, so
+ * keep the lock of the current one and only switch when the device changes.
+ */
+static void ttm_eu_lru_switch(struct ttm_bo_device **locked,
+			      struct ttm_bo_device *bdev)
+{
+	if (*locked == bdev)
+		return;
+
+	if (*locked)
+		ttm_bo_lru_unlock(*locked);
+	if (bdev)
+		ttm_bo_lru_lock(bdev);
+	*locked = bdev;
+}
+
+static void ttm_eu_del_from_lru(struct list_head *list)
 {
 	struct ttm_validate_buffer *entry;
+	struct ttm_bo_device *locked = NULL;
 
 	list_for_each_entry(entry, list, head) {
 		struct ttm_buffer_object *bo = entry->bo;
+
+		ttm_eu_lru_switch(&locked, bo->bdev);
 		ttm_bo_del_from_lru(bo);
 	}
+	ttm_eu_lru_switch(&locked, NULL);
 }
 
 void ttm_eu_backoff_reservation(struct ww_acquire_ctx *ticket,
 				struct list_head *list)
 {
 	struct ttm_validate_buffer *entry;
-	struct ttm_bo_global *glob;
+	struct ttm_bo_device *locked = NULL;
 
 	if (list_empty(list))
 		return;
 
-	entry = list_first_entry(list, struct ttm_validate_buffer, head);
-	glob = entry->bo->bdev->glob;
-
-	spin_lock(&glob->lru_lock);
 	list_for_each_entry(entry, list, head) {
 		struct ttm_buffer_object *bo = entry->bo;
 
+		ttm_eu_lru_switch(&locked, bo->bdev);
 		if (list_empty(&bo->lru))
 			ttm_bo_add_to_lru(bo);
 		reservation_object_unlock(bo->resv);
 	}
-	spin_unlock(&glob->lru_lock);
+	ttm_eu_lru_switch(&locked, NULL);
 
 	if (ticket)
 		ww_acquire_fini(ticket);
 }
 EXPORT_SYMBOL(ttm_eu_backoff_reservation);
 
+/*
+ * Canonical reservation order. Two submissions sharing BOs that both lock
+ * in resv address order only need to back off when the wait/die rules
+ * force the younger one to, not whenever their lists disagree.
+ */
+static int ttm_eu_cmp_resv(void *priv, struct list_head *a,
+			   struct list_head *b)
+{
+	struct reservation_object *ra =
+		list_entry(a, struct ttm_validate_buffer, head)->bo->resv;
+	struct reservation_object *rb =
+		list_entry(b, struct ttm_validate_buffer, head)->bo->resv;
+
+	if (ra == rb)
+		return 0;
+	return (uintptr_t)ra < (uintptr_t)rb ? -1 : 1;
+}
+
+static int ttm_eu_cmp_order(void *priv, struct list_head *a,
+			    struct list_head *b)
+{
+	unsigned int oa = list_entry(a, struct ttm_validate_buffer, head)->order;
+	unsigned int ob = list_entry(b, struct ttm_validate_buffer, head)->order;
+
+	return oa < ob ? -1 : oa > ob;
+}
+
+static void ttm_eu_account(unsigned backoffs, s64 backoff_ns)
+{
+	struct ttm_bo_global *glob = &ttm_bo_glob;
+
+	atomic64_inc(&glob->eu_reserves);
+	if (backoffs) {
+		atomic64_add(backoffs, &glob->eu_backoffs);
+		atomic64_inc(&glob->eu_contended);
+		atomic64_add(backoff_ns, &glob->eu_backoff_ns);
+	}
+}
+
 /*
  * Reserve buffers for validation.
  *
@@ -96,15 +155,28 @@ int ttm_eu_reserve_buffers(struct ww_acquire_ctx *ticket,
 			   struct list_head *list, bool intr,
 			   struct list_head *dups, bool del_lru)
 {
-	struct ttm_bo_global *glob;
 	struct ttm_validate_buffer *entry;
+	unsigned backoffs = 0;
+	s64 backoff_ns = 0;
+	bool sorted;
 	int ret;
 
 	if (list_empty(list))
 		return 0;
 
-	entry = list_first_entry(list, struct ttm_validate_buffer, head);
-	glob = entry->bo->bdev->glob;
+	/*
+	 * Drivers rely on the list order, e.g. for BO priorities, so the
+	 * sort only picks the locking order and the caller's order is
+	 * restored before returning.
+	 */
+	sorted = READ_ONCE(ttm_bo_glob.eu_sorted);
+	if (sorted) {
+		unsigned int i = 0;
+
+		list_for_each_entry(entry, list, head)
+			entry->order = i++;
+		list_sort(NULL, list, ttm_eu_cmp_resv);
+	}
 
 	if (ticket)
 		ww_acquire_init(ticket, &reservation_ww_class);
@@ -143,6 +215,9 @@ int ttm_eu_reserve_buffers(struct ww_acquire_ctx *ticket,
 		ttm_eu_backoff_reservation_reverse(list, entry);
 
 		if (ret == -EDEADLK) {
+			ktime_t start = ktime_get();
+
+			++backoffs;
 			if (intr) {
 				ret = ww_mutex_lock_slow_interruptible(&bo->resv->lock,
 								       ticket);
@@ -150,6 +225,7 @@ int ttm_eu_reserve_buffers(struct ww_acquire_ctx *ticket,
 				ww_mutex_lock_slow(&bo->resv->lock, ticket);
 				ret = 0;
 			}
+			backoff_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 		}
 
 		if (!ret && entry->num_shared)
@@ -163,6 +239,9 @@ int ttm_eu_reserve_buffers(struct ww_acquire_ctx *ticket,
 				ww_acquire_done(ticket);
 				ww_acquire_fini(ticket);
 			}
+			if (sorted)
+				list_sort(NULL, list, ttm_eu_cmp_order);
+			ttm_eu_account(backoffs, backoff_ns);
 			return ret;
 		}
 
@@ -173,11 +252,11 @@ int ttm_eu_reserve_buffers(struct ww_acquire_ctx *ticket,
 		list_add(&entry->head, list);
 	}
 
-	if (del_lru) {
-		spin_lock(&glob->lru_lock);
-		ttm_eu_del_from_lru_locked(list);
-		spin_unlock(&glob->lru_lock);
-	}
+	if (sorted)
+		list_sort(NULL, list, ttm_eu_cmp_order);
+	if (del_lru)
+		ttm_eu_del_from_lru(list);
+	ttm_eu_account(backoffs, backoff_ns);
 	return 0;
 }
 EXPORT_SYMBOL(ttm_eu_reserve_buffers);
@@ -188,18 +267,14 @@ void ttm_eu_fence_buffer_objects(struct ww_acquire_ctx *ticket,
 {
 	struct ttm_validate_buffer *entry;
 	struct ttm_buffer_object *bo;
-	struct ttm_bo_global *glob;
+	struct ttm_bo_device *locked = NULL;
 
 	if (list_empty(list))
 		return;
 
-	bo = list_first_entry(list, struct ttm_validate_buffer, head)->bo;
-	glob = bo->bdev->glob;
-
-	spin_lock(&glob->lru_lock);
-
 	list_for_each_entry(entry, list, head) {
 		bo = entry->bo;
+		ttm_eu_lru_switch(&locked, bo->bdev);
 		if (entry->num_shared)
 			reservation_object_add_shared_fence(bo->resv, fence);
 		else
@@ -210,7 +285,7 @@ void ttm_eu_fence_buffer_objects(struct ww_acquire_ctx *ticket,
 			ttm_bo_move_to_lru_tail(bo, NULL);
 		reservation_object_unlock(bo->resv);
 	}
-	spin_unlock(&glob->lru_lock);
+	ttm_eu_lru_switch(&locked, NULL);
 	if (ticket)
 		ww_acquire_fini(ticket);
 }
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Streaming copy loop used by ttm_bo_move_memcpy().
+ *
+ * Kept free of kernel headers so that tools/ttm_memcpy can build the very
+ * same loop in userspace. Callers are responsible for checking SSE4.1,
+ * saving the FPU state and the 64 byte alignment of all arguments.
+ */
+#ifndef _TTM_MEMCPY_STREAM_H_
+#define _TTM_MEMCPY_STREAM_H_
+
+static inline void ttm_memcpy_stream_loop(void *dst, const void *src,
+					  unsigned long len)
+{
+	len >>= 6;
+	while (len--) {
+		__asm__ __volatile__(
+		    "movntdqa   (%0), %%xmm0\n"
+		    "movntdqa 16(%0), %%xmm1\n"
+		    "movntdqa 32(%0), %%xmm2\n"
+		    "movntdqa 48(%0), %%xmm3\n"
+		    "movntdq %%xmm0,   (%1)\n"
+		    "movntdq %%xmm1, 16(%1)\n"
+		    "movntdq %%xmm2, 32(%1)\n"
+		    "movntdq %%xmm3, 48(%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src = (const char *)src + 64;
+		dst = (char *)dst + 64;
+	}
+	__asm__ __volatile__("sfence" ::: "memory");
+}
+
+#endif
@@ -37,9 +37,12 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/smp.h>
 #include <linux/swap.h>
 
 #define TTM_MEMORY_ALLOC_RETRIES 4
+/* Per-CPU accounting slack before the local charges are folded */
+#define TTM_MEMORY_PCPU_BATCH (64ULL * PAGE_SIZE)
 
 struct ttm_mem_global ttm_mem_glob;
 EXPORT_SYMBOL(ttm_mem_glob);
@@ -55,6 +58,85 @@ struct ttm_mem_zone {
 	uint64_t used_mem;
 };
 
+/**
+ * struct ttm_mem_pcpu - Per-CPU charges not yet folded into the zones.
+ *
+ * @delta: Signed byte count per zone, indexed like ttm_mem_global::zones.
+ */
+struct ttm_mem_pcpu {
+	atomic64_t delta[TTM_MEM_MAX_ZONES];
+};
+
+/*
+ * Fold all per-CPU charges into the zones, which makes used_mem exact.
+ * Called with glob->lock held.
+ */
+static void ttm_mem_fold_locked(struct ttm_mem_global *glob)
+{
+	unsigned int cpu, i;
+
+	if (!glob->pcpu)
+		return;
+
+	for (cpu = 0; cpu < nr_cpu_ids; ++cpu)
+		for (i = 0; i < glob->num_zones; ++i)
+			glob->zones[i]->used_mem +=
+				atomic64_xchg(&glob->pcpu[cpu].delta[i], 0);
+}
+
+/*
+ * Charge or uncharge @amount on the local CPU without taking glob->lock.
+ *
+ * Charging only takes this path while every affected zone stays below its
+ * swap and allocation limits even if all CPUs used up their slack, so the
+ * limits are still enforced exactly by ttm_mem_global_reserve().
+ */
+static bool ttm_mem_charge_pcpu(struct ttm_mem_global *glob,
+				struct ttm_mem_zone *single_zone,
+				int64_t amount)
+{
+	uint64_t slack = nr_cpu_ids * TTM_MEMORY_PCPU_BATCH;
+	struct ttm_mem_pcpu *pcpu;
+	struct ttm_mem_zone *zone;
+	bool fold = false;
+	unsigned int i;
+
+	if (!glob->pcpu || amount > (int64_t)TTM_MEMORY_PCPU_BATCH ||
+	    amount < -(int64_t)TTM_MEMORY_PCPU_BATCH)
+		return false;
+
+	for (i = 0; amount > 0 && i < glob->num_zones; ++i) {
+		zone = glob->zones[i];
+		if (single_zone && zone != single_zone)
+			continue;
+
+		if (READ_ONCE(zone->used_mem) + slack + amount >
+		    min(zone->max_mem, zone->swap_limit))
+			return false;
+	}
+
+	pcpu = &glob->pcpu[get_cpu()];
+	for (i = 0; i < glob->num_zones; ++i) {
+		int64_t delta;
+
+		if (single_zone && glob->zones[i] != single_zone)
+			continue;
+
+		delta = atomic64_add_return(amount, &pcpu->delta[i]);
+		if (delta > (int64_t)TTM_MEMORY_PCPU_BATCH ||
+		    delta < -(int64_t)TTM_MEMORY_PCPU_BATCH)
+			fold = true;
+	}
+	put_cpu();
+
+	if (fold) {
+		spin_lock(&glob->lock);
+		ttm_mem_fold_locked(glob);
+		spin_unlock(&glob->lock);
+	}
+	return true;
+}
+
 static struct attribute ttm_mem_sys = {
 	.name = "zone_memory",
 	.mode = S_IRUGO
@@ -95,6 +177,7 @@ static ssize_t ttm_mem_zone_show(struct kobject *kobj,
 	uint64_t val = 0;
 
 	spin_lock(&zone->glob->lock);
+	ttm_mem_fold_locked(zone->glob);
 	if (attr == &ttm_mem_sys)
 		val = zone->zone_mem;
 	else if (attr == &ttm_mem_emer)
@@ -276,11 +359,13 @@ static void ttm_shrink(struct ttm_mem_global *glob, bool from_wq,
 	int ret;
 
 	spin_lock(&glob->lock);
+	ttm_mem_fold_locked(glob);
 
 	while (ttm_zones_above_swap_target(glob, from_wq, extra)) {
 		spin_unlock(&glob->lock);
 		ret = ttm_bo_swapout(glob->bo_glob, ctx);
 		spin_lock(&glob->lock);
+		ttm_mem_fold_locked(glob);
 		if (unlikely(ret != 0))
 			break;
 	}
@@ -424,6 +509,8 @@ int ttm_mem_global_init(struct ttm_mem_global *glob)
 	struct ttm_mem_zone *zone;
 
 	spin_lock_init(&glob->lock);
+	/* Without the per-CPU batches all accounting is exact and locked */
+	glob->pcpu = kcalloc(nr_cpu_ids, sizeof(*glob->pcpu), GFP_KERNEL);
 	glob->swap_queue = create_singlethread_workqueue("ttm_swap");
 	INIT_WORK(&glob->work, ttm_shrink_work);
 	ret = kobject_init_and_add(
@@ -475,6 +562,13 @@ void ttm_mem_global_release(struct ttm_mem_global *glob)
 	flush_workqueue(glob->swap_queue);
 	destroy_workqueue(glob->swap_queue);
 	glob->swap_queue = NULL;
+
+	spin_lock(&glob->lock);
+	ttm_mem_fold_locked(glob);
+	spin_unlock(&glob->lock);
+	kfree(glob->pcpu);
+	glob->pcpu = NULL;
+
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
 		kobject_del(&zone->kobj);
@@ -492,6 +586,7 @@ static void ttm_check_swapping(struct ttm_mem_global *glob)
 	struct ttm_mem_zone *zone;
 
 	spin_lock(&glob->lock);
+	ttm_mem_fold_locked(glob);
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
 		if (zone->used_mem > zone->swap_limit) {
@@ -514,7 +609,11 @@ static void ttm_mem_global_free_zone(struct ttm_mem_global *glob,
 	unsigned int i;
 	struct ttm_mem_zone *zone;
 
+	if (ttm_mem_charge_pcpu(glob, single_zone, -(int64_t)amount))
+		return;
+
 	spin_lock(&glob->lock);
+	ttm_mem_fold_locked(glob);
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
 		if (single_zone && zone != single_zone)
@@ -574,7 +673,12 @@ static int ttm_mem_global_reserve(struct ttm_mem_global *glob,
 	unsigned int i;
 	struct ttm_mem_zone *zone;
 
+	/* Far from any limit, so no need to check or swap */
+	if (reserve && ttm_mem_charge_pcpu(glob, single_zone, amount))
+		return 0;
+
 	spin_lock(&glob->lock);
+	ttm_mem_fold_locked(glob);
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
 		if (single_zone && zone != single_zone)
@@ -638,41 +742,128 @@ int ttm_mem_global_alloc(struct ttm_mem_global *glob, uint64_t memory,
 }
 EXPORT_SYMBOL(ttm_mem_global_alloc);
 
-int ttm_mem_global_alloc_page(struct ttm_mem_global *glob,
-			      struct page *page, uint64_t size,
-			      struct ttm_operation_ctx *ctx)
+/*
+ * Page allocations may be registed in a single zone only if highmem or
+ * !dma32, otherwise they are charged to all zones (NULL).
+ */
+static struct ttm_mem_zone *ttm_mem_page_zone(struct ttm_mem_global *glob,
+					      struct page *page)
 {
-	struct ttm_mem_zone *zone = NULL;
-
-	/**
-	 * Page allocations may be registed in a single zone
-	 * only if highmem or !dma32.
-	 */
-
 #ifdef CONFIG_HIGHMEM
 	if (PageHighMem(page) && glob->zone_highmem != NULL)
-		zone = glob->zone_highmem;
+		return glob->zone_highmem;
 #else
 	if (glob->zone_dma32 && page_to_pfn(page) > 0x00100000UL)
-		zone = glob->zone_kernel;
+		return glob->zone_kernel;
 #endif
-	return ttm_mem_global_alloc_zone(glob, zone, size, ctx);
+	return NULL;
+}
+
+int ttm_mem_global_alloc_page(struct ttm_mem_global *glob,
+			      struct page *page, uint64_t size,
+			      struct ttm_operation_ctx *ctx)
+{
+	return ttm_mem_global_alloc_zone(glob, ttm_mem_page_zone(glob, page),
+					 size, ctx);
 }
 
 void ttm_mem_global_free_page(struct ttm_mem_global *glob, struct page *page,
 			      uint64_t size)
 {
-	struct ttm_mem_zone *zone = NULL;
+	ttm_mem_global_free_zone(glob, ttm_mem_page_zone(glob, page), size);
+}
 
-#ifdef CONFIG_HIGHMEM
-	if (PageHighMem(page) && glob->zone_highmem != NULL)
-		zone = glob->zone_highmem;
-#else
-	if (glob->zone_dma32 && page_to_pfn(page) > 0x00100000UL)
-		zone = glob->zone_kernel;
-#endif
-	ttm_mem_global_free_zone(glob, zone, size);
+/*
+ * Sum up the size of @pages by the zone they are charged to, split into
+ * pages charged to all zones and pages charged to a single zone.
+ */
+static struct ttm_mem_zone *ttm_mem_pages_size(struct ttm_mem_global *glob,
+					       struct page **pages,
+					       unsigned npages,
+					       uint64_t *all, uint64_t *single)
+{
+	struct ttm_mem_zone *single_zone = NULL;
+	unsigned i;
+
+	*all = *single = 0;
+	for (i = 0; i < npages; ++i) {
+		struct ttm_mem_zone *zone;
+
+		if (!pages[i])
+			continue;
+
+		zone = ttm_mem_page_zone(glob, pages[i]);
+		if (zone) {
+			single_zone = zone;
+			*single += PAGE_SIZE;
+		} else {
+			*all += PAGE_SIZE;
+		}
+	}
+	return single_zone;
+}
+
+/**
+ * ttm_mem_global_alloc_pages - charge an array of pages at once
+ *
+ * @glob: The memory accounting structure.
+ * @pages: The pages to charge, NULL entries are skipped.
+ * @npages: Number of entries in @pages.
+ * @ctx: The operation context.
+ *
+ * Equivalent to calling ttm_mem_global_alloc_page() for every page, but
+ * takes the accounting lock at most twice. Either all or no pages are
+ * charged.
+ */
+int ttm_mem_global_alloc_pages(struct ttm_mem_global *glob,
+			       struct page **pages, unsigned npages,
+			       struct ttm_operation_ctx *ctx)
+{
+	struct ttm_mem_zone *single_zone;
+	uint64_t all, single;
+	int ret;
+
+	single_zone = ttm_mem_pages_size(glob, pages, npages, &all, &single);
+
+	if (all) {
+		ret = ttm_mem_global_alloc_zone(glob, NULL, all, ctx);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	if (single) {
+		ret = ttm_mem_global_alloc_zone(glob, single_zone, single, ctx);
+		if (unlikely(ret)) {
+			if (all)
+				ttm_mem_global_free_zone(glob, NULL, all);
+			return ret;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL(ttm_mem_global_alloc_pages);
+
+/**
+ * ttm_mem_global_free_pages - uncharge an array of pages at once
+ *
+ * @glob: The memory accounting structure.
+ * @pages: The pages to uncharge, NULL entries are skipped.
+ * @npages: Number of entries in @pages.
+ */
+void ttm_mem_global_free_pages(struct ttm_mem_global *glob,
+			       struct page **pages, unsigned npages)
+{
+	struct ttm_mem_zone *single_zone;
+	uint64_t all, single;
+
+	single_zone = ttm_mem_pages_size(glob, pages, npages, &all, &single);
+
+	if (all)
+		ttm_mem_global_free_zone(glob, NULL, all);
+	if (single)
+		ttm_mem_global_free_zone(glob, single_zone, single);
 }
+EXPORT_SYMBOL(ttm_mem_global_free_pages);
 
 size_t ttm_round_pot(size_t size)
 {
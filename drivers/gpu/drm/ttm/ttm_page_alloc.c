@@ -41,6 +41,9 @@
 #include <linux/mm.h>
 #include <linux/seq_file.h> /* for seq_printf */
 #include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 #include <linux/dma-mapping.h>
 
 #include <linux/atomic.h>
@@ -54,6 +57,22 @@
 #define FREE_ALL_PAGES			(~0U)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
+/* per-CPU magazine capacity, in pages */
+#define TTM_MAGAZINE_SIZE		64
+
+/**
+ * struct ttm_page_magazine - Per-CPU cache in front of a shared pool.
+ *
+ * @lock: Protects the magazine. Only contended when the shrinker drains it
+ * or a task migrated after picking it. Nests inside the pool lock.
+ * @count: Number of pages in the magazine.
+ * @pages: Pages already in the caching state of the pool.
+ */
+struct ttm_page_magazine {
+	spinlock_t		lock;
+	unsigned		count;
+	struct page		*pages[TTM_MAGAZINE_SIZE];
+};
 
 /**
  * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
@@ -65,6 +84,18 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @mags: Per-CPU magazines, only for order 0 pools, may be NULL.
+ * @mag_hits: Allocations served from a magazine without touching the pool.
+ * @mag_misses: Allocations that had to refill a magazine from the pool.
+ * @lock_waits: Number of times @lock was contended.
+ * @lock_wait_ns: Total time spent waiting for @lock.
+ * @cstate: Caching state of the pages in the pool.
+ * @active: Set once the pool served an allocation, only active pools are
+ * refilled in the background.
+ * @bg_refills: Number of background refills.
+ * @bg_refill_pages: Pages added by background refills.
+ * @bg_refill_ns: Total time spent in background refills.
+ * @fg_misses: Allocations that had to allocate and convert pages inline.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -80,6 +111,17 @@ struct ttm_page_pool {
 	unsigned long		nfrees;
 	unsigned long		nrefills;
 	unsigned int		order;
+	struct ttm_page_magazine *mags;
+	atomic64_t		mag_hits;
+	atomic64_t		mag_misses;
+	atomic64_t		lock_waits;
+	atomic64_t		lock_wait_ns;
+	enum ttm_caching_state	cstate;
+	bool			active;
+	atomic64_t		bg_refills;
+	atomic64_t		bg_refill_pages;
+	atomic64_t		bg_refill_ns;
+	atomic64_t		fg_misses;
 };
 
 /**
@@ -92,6 +134,8 @@ struct ttm_pool_opts {
 	unsigned	alloc_size;
 	unsigned	max_size;
 	unsigned	small;
+	unsigned	low_watermark;
+	unsigned	high_watermark;
 };
 
 #define NUM_POOLS 6
@@ -106,6 +150,10 @@ struct ttm_pool_opts {
  * @work: Work that is used to shrink the pool. Work is only run when there is
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
+ * @refill_work: Keeps the order 0 pools between the low and high watermark,
+ * so that allocations rarely have to change page caching inline.
+ * @last_shrink: Jiffies of the last shrinker run, refilling is held off for
+ * a moment afterwards to not undo the work of the shrinker.
  *
  * @pools: All pool objects in use.
  **/
@@ -113,6 +161,8 @@ struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
+	struct work_struct	refill_work;
+	unsigned long		last_shrink;
 
 	union {
 		struct ttm_page_pool	pools[NUM_POOLS];
@@ -139,14 +189,52 @@ static struct attribute ttm_page_pool_alloc_size = {
 	.name = "pool_allocation_size",
 	.mode = S_IRUGO | S_IWUSR
 };
+static struct attribute ttm_page_pool_low_watermark = {
+	.name = "pool_low_watermark",
+	.mode = S_IRUGO | S_IWUSR
+};
+static struct attribute ttm_page_pool_high_watermark = {
+	.name = "pool_high_watermark",
+	.mode = S_IRUGO | S_IWUSR
+};
+static struct attribute ttm_page_pool_level = {
+	.name = "pool_level",
+	.mode = S_IRUGO
+};
+static struct attribute ttm_page_pool_bg_refills = {
+	.name = "pool_bg_refills",
+	.mode = S_IRUGO
+};
+static struct attribute ttm_page_pool_bg_refill_pages = {
+	.name = "pool_bg_refill_pages",
+	.mode = S_IRUGO
+};
+static struct attribute ttm_page_pool_bg_refill_us = {
+	.name = "pool_bg_refill_us",
+	.mode = S_IRUGO
+};
+static struct attribute ttm_page_pool_fg_misses = {
+	.name = "pool_fg_misses",
+	.mode = S_IRUGO
+};
 
 static struct attribute *ttm_pool_attrs[] = {
 	&ttm_page_pool_max,
 	&ttm_page_pool_small,
 	&ttm_page_pool_alloc_size,
+	&ttm_page_pool_low_watermark,
+	&ttm_page_pool_high_watermark,
+	&ttm_page_pool_level,
+	&ttm_page_pool_bg_refills,
+	&ttm_page_pool_bg_refill_pages,
+	&ttm_page_pool_bg_refill_us,
+	&ttm_page_pool_fg_misses,
 	NULL
 };
 
+static void ttm_page_pool_drain_magazines(struct ttm_page_pool *pool);
+static unsigned ttm_page_pool_magazine_pages(struct ttm_page_pool *pool);
+
 static void ttm_pool_kobj_release(struct kobject *kobj)
 {
 	struct ttm_pool_manager *m =
@@ -183,7 +271,10 @@ static ssize_t ttm_pool_store(struct kobject *kobj,
 				NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 10));
 		}
 		m->options.alloc_size = val;
-	}
+	} else if (attr == &ttm_page_pool_low_watermark)
+		m->options.low_watermark = val;
+	else if (attr == &ttm_page_pool_high_watermark)
+		m->options.high_watermark = val;
 
 	return size;
 }
@@ -194,6 +285,39 @@ static ssize_t ttm_pool_show(struct kobject *kobj,
 	struct ttm_pool_manager *m =
 		container_of(kobj, struct ttm_pool_manager, kobj);
 	unsigned val = 0;
+	u64 sum = 0;
+	unsigned i;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		struct ttm_page_pool *pool = &m->pools[i];
+
+		if (attr == &ttm_page_pool_level)
+			sum += ((u64)READ_ONCE(pool->npages) +
+				ttm_page_pool_magazine_pages(pool)) <<
+				pool->order;
+		else if (attr == &ttm_page_pool_bg_refills)
+			sum += atomic64_read(&pool->bg_refills);
+		else if (attr == &ttm_page_pool_bg_refill_pages)
+			sum += atomic64_read(&pool->bg_refill_pages);
+		else if (attr == &ttm_page_pool_bg_refill_us)
+			sum += atomic64_read(&pool->bg_refill_ns);
+		else if (attr == &ttm_page_pool_fg_misses)
+			sum += atomic64_read(&pool->fg_misses);
+		else
+			break;
+	}
+
+	if (attr == &ttm_page_pool_level)
+		/* convert from number of pages to KB */
+		return snprintf(buffer, PAGE_SIZE, "%llu\n",
+				(unsigned long long)sum * (PAGE_SIZE >> 10));
+	else if (attr == &ttm_page_pool_bg_refill_us)
+		return snprintf(buffer, PAGE_SIZE, "%llu\n",
+				(unsigned long long)div_u64(sum,
+							    NSEC_PER_USEC));
+	else if (i == NUM_POOLS)
+		return snprintf(buffer, PAGE_SIZE, "%llu\n",
+				(unsigned long long)sum);
 
 	if (attr == &ttm_page_pool_max)
 		val = m->options.max_size;
@@ -201,6 +325,10 @@ static ssize_t ttm_pool_show(struct kobject *kobj,
 		val = m->options.small;
 	else if (attr == &ttm_page_pool_alloc_size)
 		val = m->options.alloc_size;
+	else if (attr == &ttm_page_pool_low_watermark)
+		val = m->options.low_watermark;
+	else if (attr == &ttm_page_pool_high_watermark)
+		val = m->options.high_watermark;
 
 	val = val * (PAGE_SIZE >> 10);
 
@@ -247,6 +375,34 @@ static struct ttm_page_pool *ttm_get_pool(int flags, bool huge,
 	return &_manager->pools[pool_index];
 }
 
+/* Take the pool lock, accounting the time spent waiting for it. */
+static void ttm_page_pool_lock(struct ttm_page_pool *pool,
+			       unsigned long *irq_flags)
+{
+	ktime_t start;
+
+	if (spin_trylock_irqsave(&pool->lock, *irq_flags))
+		return;
+
+	start = ktime_get();
+	spin_lock_irqsave(&pool->lock, *irq_flags);
+	atomic64_inc(&pool->lock_waits);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &pool->lock_wait_ns);
+}
+
+static void ttm_page_clear(struct page *page)
+{
+#ifdef __linux__
+	if (PageHighMem(page))
+		clear_highpage(page);
+	else
+		clear_page(page_address(page));
+#elif defined(__FreeBSD__)
+	pmap_zero_page(page);
+#endif
+}
+
 /* set memory back to wb and free the pages. */
 static void ttm_pages_put(struct page *pages[], unsigned npages,
 		unsigned int order)
@@ -312,7 +468,7 @@ static int ttm_page_pool_free(struct ttm_page_pool *pool, unsigned nr_free,
 	}
 
 restart:
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	ttm_page_pool_lock(pool, &irq_flags);
 
 #ifdef __linux__
 	list_for_each_entry_reverse(p, &pool->list, lru) {
@@ -411,6 +567,7 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 
 	if (!mutex_trylock(&lock))
 		return SHRINK_STOP;
+	WRITE_ONCE(_manager->last_shrink, jiffies);
 	pool_offset = ++start_pool % NUM_POOLS;
 	/* select start pool in round robin fashion */
 	for (i = 0; i < NUM_POOLS; ++i) {
@@ -421,6 +578,7 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 			break;
 
 		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		ttm_page_pool_drain_magazines(pool);
 		page_nr = (1 << pool->order);
 		/* OK to use static buffer since global mutex is held. */
 		nr_free_pool = roundup(nr_free, page_nr) >> pool->order;
@@ -445,6 +603,7 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 	for (i = 0; i < NUM_POOLS; ++i) {
 		pool = &_manager->pools[i];
 		count += (pool->npages << pool->order);
+		count += ttm_page_pool_magazine_pages(pool);
 	}
 
 	return count;
@@ -607,21 +766,25 @@ out:
 /**
  * Fill the given pool if there aren't enough pages and the requested number of
  * pages is small.
+ *
+ * @return true if pages had to be allocated inline, the caller accounts
+ * for that in @pool->fg_misses.
  */
-static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
+static bool ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 				      enum ttm_caching_state cstate,
 				      unsigned count, unsigned long *irq_flags)
 {
 	struct page *p;
 	int r;
 	unsigned cpages = 0;
+	bool filled = false;
 	/**
 	 * Only allow one pool fill operation at a time.
 	 * If pool doesn't have enough pages for the allocation new pages are
 	 * allocated from outside of pool.
 	 */
 	if (pool->fill_lock)
-		return;
+		return false;
 
 	pool->fill_lock = true;
 
@@ -636,6 +799,8 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 #endif
 		unsigned alloc_size = _manager->options.alloc_size;
 
+		filled = true;
+
 		/**
 		 * Can't change page caching if in irqsave context. We have to
 		 * drop the pool->lock.
@@ -649,7 +814,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 #endif
 		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags, ttm_flags,
 					cstate, alloc_size, 0);
-		spin_lock_irqsave(&pool->lock, *irq_flags);
+		ttm_page_pool_lock(pool, irq_flags);
 
 		if (!r) {
 #ifdef __linux__
@@ -679,6 +844,108 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 
 	}
 	pool->fill_lock = false;
+	return filled;
+}
+
+/*
+ * Top up @pool to the high watermark if it dropped below the low one. Pages
+ * are allocated and converted in NUM_PAGES_TO_ALLOC batches without holding
+ * the pool lock, just like ttm_page_pool_fill_locked() does inline.
+ */
+static void ttm_page_pool_refill(struct ttm_pool_manager *m,
+				 struct ttm_page_pool *pool)
+{
+	unsigned low = m->options.low_watermark;
+	unsigned high = max(m->options.high_watermark, low);
+	unsigned long irq_flags;
+	unsigned npages, count;
+	struct page *p;
+	ktime_t start;
+	int r;
+
+	high = min(high, m->options.max_size);
+	npages = READ_ONCE(pool->npages);
+	if (!low || npages >= low)
+		return;
+
+	start = ktime_get();
+	while (npages < high) {
+#ifdef __linux__
+		struct list_head new_pages;
+
+		INIT_LIST_HEAD(&new_pages);
+#elif defined(__FreeBSD__)
+		struct pglist new_pages;
+
+		TAILQ_INIT(&new_pages);
+#endif
+		count = min(high - npages, (unsigned)NUM_PAGES_TO_ALLOC);
+		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags |
+					__GFP_NORETRY | __GFP_NOWARN, 0,
+					pool->cstate, count, 0);
+
+		/* On failure only the converted pages are left in the list */
+		count = 0;
+#ifdef __linux__
+		list_for_each_entry(p, &new_pages, lru)
+#elif defined(__FreeBSD__)
+		TAILQ_FOREACH(p, &new_pages, plinks.q)
+#endif
+			++count;
+
+		ttm_page_pool_lock(pool, &irq_flags);
+#ifdef __linux__
+		list_splice(&new_pages, &pool->list);
+#elif defined(__FreeBSD__)
+		TAILQ_CONCAT(&pool->list, &new_pages, plinks.q);
+#endif
+		pool->npages += count;
+		npages = pool->npages;
+		spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+		atomic64_add(count, &pool->bg_refill_pages);
+		if (r || !count)
+			break;
+		cond_resched();
+	}
+
+	atomic64_inc(&pool->bg_refills);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &pool->bg_refill_ns);
+}
+
+static void ttm_page_pool_refill_work(struct work_struct *work)
+{
+	struct ttm_pool_manager *m =
+		container_of(work, struct ttm_pool_manager, refill_work);
+	unsigned i;
+
+	/* Don't refill what the shrinker just took away */
+	if (time_before(jiffies, READ_ONCE(m->last_shrink) + HZ))
+		return;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		struct ttm_page_pool *pool = &m->pools[i];
+
+		if (pool->order || !READ_ONCE(pool->active))
+			continue;
+		ttm_page_pool_refill(m, pool);
+	}
+}
+
+/* Kick the background refill if @pool dropped below its low watermark. */
+static void ttm_page_pool_check_refill(struct ttm_page_pool *pool)
+{
+	unsigned low = _manager->options.low_watermark;
+
+	if (pool->order)
+		return;
+
+	if (!READ_ONCE(pool->active))
+		WRITE_ONCE(pool->active, true);
+
+	if (low && READ_ONCE(pool->npages) < low)
+		queue_work(system_unbound_wq, &_manager->refill_work);
 }
 
 /**
@@ -703,12 +970,13 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 	struct page *p;
 #endif
 	unsigned i;
+	bool miss = false;
 	int r = 0;
 
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	ttm_page_pool_lock(pool, &irq_flags);
 	if (!order)
-		ttm_page_pool_fill_locked(pool, ttm_flags, cstate, count,
-					  &irq_flags);
+		miss = ttm_page_pool_fill_locked(pool, ttm_flags, cstate,
+						 count, &irq_flags);
 
 	if (count >= pool->npages) {
 		/* take all pages from the pool */
@@ -750,23 +1018,18 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 	count = 0;
 out:
 	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	ttm_page_pool_check_refill(pool);
 
 	/* clear the pages coming from the pool if requested */
 	if (ttm_flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
 		struct page *page;
 
 #ifdef __linux__
-		list_for_each_entry(page, pages, lru) {
-			if (PageHighMem(page))
-				clear_highpage(page);
-			else
-				clear_page(page_address(page));
-		}
+		list_for_each_entry(page, pages, lru)
 #elif defined(__FreeBSD__)
-		TAILQ_FOREACH(page, pages, plinks.q) {
-			pmap_zero_page(page);
-		}
+		TAILQ_FOREACH(page, pages, plinks.q)
 #endif
+			ttm_page_clear(page);
 	}
 
 	/* If pool didn't have enough pages allocate new one. */
@@ -780,6 +1043,8 @@ out:
 		if (ttm_flags & TTM_PAGE_FLAG_NO_RETRY)
 			gfp_flags |= __GFP_RETRY_MAYFAIL;
 
+		miss = true;
+
 		/* ttm_alloc_new_pages doesn't reference pool so we can run
 		 * multiple requests in parallel.
 		 **/
@@ -787,9 +1052,156 @@ out:
 					count, order);
 	}
 
+	if (miss)
+		atomic64_inc(&pool->fg_misses);
 	return r;
 }
 
+/**
+ * Take @npages pages from the magazine of the current CPU, refilling it in
+ * one go from the shared pool if it runs short.
+ *
+ * @return number of pages taken, either zero or @npages.
+ */
+static unsigned ttm_page_pool_get_magazine(struct ttm_page_pool *pool,
+					   struct page **pages,
+					   unsigned npages, int ttm_flags,
+					   enum ttm_caching_state cstate)
+{
+	struct ttm_page_magazine *mag;
+	unsigned long irq_flags;
+	unsigned i;
+
+	if (!pool->mags || !npages || npages > TTM_MAGAZINE_SIZE)
+		return 0;
+
+	mag = &pool->mags[get_cpu()];
+	put_cpu();
+
+	spin_lock_irqsave(&mag->lock, irq_flags);
+	if (mag->count >= npages) {
+		atomic64_inc(&pool->mag_hits);
+		goto take;
+	}
+	spin_unlock_irqrestore(&mag->lock, irq_flags);
+
+	atomic64_inc(&pool->mag_misses);
+
+	ttm_page_pool_lock(pool, &irq_flags);
+	if (ttm_page_pool_fill_locked(pool, ttm_flags, cstate, npages,
+				      &irq_flags))
+		atomic64_inc(&pool->fg_misses);
+	spin_lock(&mag->lock);
+	while (mag->count < TTM_MAGAZINE_SIZE && pool->npages) {
+		struct page *p;
+
+#ifdef __linux__
+		p = list_first_entry(&pool->list, struct page, lru);
+		list_del(&p->lru);
+#elif defined(__FreeBSD__)
+		p = TAILQ_FIRST(&pool->list);
+		TAILQ_REMOVE(&pool->list, p, plinks.q);
+#endif
+		mag->pages[mag->count++] = p;
+		pool->npages--;
+	}
+	spin_unlock(&pool->lock);
+	ttm_page_pool_check_refill(pool);
+
+	if (mag->count < npages) {
+		spin_unlock_irqrestore(&mag->lock, irq_flags);
+		return 0;
+	}
+
+take:
+	mag->count -= npages;
+	memcpy(pages, &mag->pages[mag->count], npages * sizeof(*pages));
+	spin_unlock_irqrestore(&mag->lock, irq_flags);
+
+	if (ttm_flags & TTM_PAGE_FLAG_ZERO_ALLOC)
+		for (i = 0; i < npages; ++i)
+			ttm_page_clear(pages[i]);
+
+	return npages;
+}
+
+/**
+ * Stash freed pages in the magazine of the current CPU. Whatever doesn't fit
+ * is left in @pages for the caller to put into the shared pool.
+ */
+static void ttm_page_pool_put_magazine(struct ttm_page_pool *pool,
+				       struct page **pages, unsigned npages)
+{
+	struct ttm_page_magazine *mag;
+	unsigned long irq_flags;
+	unsigned i;
+
+	if (!pool->mags || npages > TTM_MAGAZINE_SIZE)
+		return;
+
+	mag = &pool->mags[get_cpu()];
+	put_cpu();
+
+	spin_lock_irqsave(&mag->lock, irq_flags);
+	for (i = 0; i < npages && mag->count < TTM_MAGAZINE_SIZE; ++i) {
+		if (!pages[i])
+			continue;
+
+		if (page_count(pages[i]) != 1) {
+			pr_err("Erroneous page count. Leaking pages.\n");
+			continue;
+		}
+		mag->pages[mag->count++] = pages[i];
+		pages[i] = NULL;
+	}
+	spin_unlock_irqrestore(&mag->lock, irq_flags);
+}
+
+/* Move all pages cached in the magazines back into the shared pool. */
+static void ttm_page_pool_drain_magazines(struct ttm_page_pool *pool)
+{
+	struct ttm_page_magazine *mag;
+	unsigned long irq_flags;
+	unsigned cpu;
+
+	if (!pool->mags)
+		return;
+
+	for (cpu = 0; cpu < nr_cpu_ids; ++cpu) {
+		mag = &pool->mags[cpu];
+		if (!READ_ONCE(mag->count))
+			continue;
+
+		ttm_page_pool_lock(pool, &irq_flags);
+		spin_lock(&mag->lock);
+		while (mag->count) {
+			struct page *p = mag->pages[--mag->count];
+
+#ifdef __linux__
+			list_add_tail(&p->lru, &pool->list);
+#elif defined(__FreeBSD__)
+			TAILQ_INSERT_TAIL(&pool->list, p, plinks.q);
+#endif
+			pool->npages++;
+		}
+		spin_unlock(&mag->lock);
+		spin_unlock_irqrestore(&pool->lock, irq_flags);
+	}
+}
+
+static unsigned ttm_page_pool_magazine_pages(struct ttm_page_pool *pool)
+{
+	unsigned cpu, count = 0;
+
+	if (!pool->mags)
+		return 0;
+
+	for (cpu = 0; cpu < nr_cpu_ids; ++cpu)
+		count += READ_ONCE(pool->mags[cpu].count);
+
+	return count;
+}
+
 /* Put all pages in pages list to correct pool to wait for reuse */
 static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			  enum ttm_caching_state cstate)
@@ -845,7 +1257,7 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 	if (huge) {
 		unsigned max_size, n2free;
 
-		spin_lock_irqsave(&huge->lock, irq_flags);
+		ttm_page_pool_lock(huge, &irq_flags);
 		while ((npages - i) >= HPAGE_PMD_NR) {
 			struct page *p = pages[i];
 			unsigned j;
@@ -880,7 +1292,9 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 	}
 #endif
 
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	ttm_page_pool_put_magazine(pool, &pages[i], npages - i);
+
+	ttm_page_pool_lock(pool, &irq_flags);
 	while (i < npages) {
 		if (pages[i]) {
 			if (page_count(pages[i]) != 1)
@@ -1009,6 +1423,11 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 	}
 #endif
 
+	count += ttm_page_pool_get_magazine(pool, &pages[count],
+					    npages - count, flags, cstate);
+	if (count == npages)
+		return 0;
+
 	INIT_LIST_HEAD(&plist);
 	r = ttm_page_pool_get_pages(pool, &plist, flags, cstate,
 				    npages - count, 0);
@@ -1024,10 +1443,14 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 	}
 
 #elif defined(__FreeBSD__)
+	count = ttm_page_pool_get_magazine(pool, pages, npages, flags, cstate);
+	if (count == npages)
+		return 0;
+
 	TAILQ_INIT(&plist);
 	r = ttm_page_pool_get_pages(pool, &plist, flags, cstate,
-	    npages, 0);
-	count = 0;
+	    npages - count, 0);
+	first = count;
 	TAILQ_FOREACH(p, &plist, plinks.q) {
 		struct page *tmp = p;
 
@@ -1051,7 +1474,7 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
-		char *name, unsigned int order)
+		enum ttm_caching_state cstate, char *name, unsigned int order)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
@@ -1062,8 +1485,21 @@ static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
 #endif
 	pool->npages = pool->nfrees = 0;
 	pool->gfp_flags = flags;
+	pool->cstate = cstate;
 	pool->name = name;
 	pool->order = order;
+
+	/* The magazines are only an optimization, work without them */
+	if (!order) {
+		pool->mags = kcalloc(nr_cpu_ids, sizeof(*pool->mags),
+				     GFP_KERNEL);
+		if (pool->mags) {
+			unsigned cpu;
+
+			for (cpu = 0; cpu < nr_cpu_ids; ++cpu)
+				spin_lock_init(&pool->mags[cpu].lock);
+		}
+	}
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
@@ -1083,31 +1519,37 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 	if (!_manager)
 		return -ENOMEM;
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc", 0);
+	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, tt_wc,
+				  "wc", 0);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc", 0);
+	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER,
+				  tt_uncached, "uc", 0);
 
 	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma", 0);
+				  GFP_USER | GFP_DMA32, tt_wc, "wc dma", 0);
 
 	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma", 0);
+				  GFP_USER | GFP_DMA32, tt_uncached, "uc dma",
+				  0);
 
 	ttm_page_pool_init_locked(&_manager->wc_pool_huge,
 				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
 				   __GFP_KSWAPD_RECLAIM) &
 				  ~(__GFP_MOVABLE | __GFP_COMP),
-				  "wc huge", order);
+				  tt_wc, "wc huge", order);
 
 	ttm_page_pool_init_locked(&_manager->uc_pool_huge,
 				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
 				   __GFP_KSWAPD_RECLAIM) &
-				  ~(__GFP_MOVABLE | __GFP_COMP)
-				  , "uc huge", order);
+				  ~(__GFP_MOVABLE | __GFP_COMP),
+				  tt_uncached, "uc huge", order);
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
 	_manager->options.alloc_size = NUM_PAGES_TO_ALLOC;
+	_manager->options.low_watermark = NUM_PAGES_TO_ALLOC / 2;
+	_manager->options.high_watermark = NUM_PAGES_TO_ALLOC;
+	INIT_WORK(&_manager->refill_work, ttm_page_pool_refill_work);
 
 	ret = kobject_init_and_add(&_manager->kobj, &ttm_pool_kobj_type,
 				   &glob->kobj, "pool");
@@ -1131,10 +1573,14 @@ void ttm_page_alloc_fini(void)
 
 	pr_info("Finalizing pool allocator\n");
 	ttm_pool_mm_shrink_fini(_manager);
+	cancel_work_sync(&_manager->refill_work);
 
 	/* OK to use static buffer since global mutex is no longer used. */
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < NUM_POOLS; ++i) {
+		ttm_page_pool_drain_magazines(&_manager->pools[i]);
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES, true);
+		kfree(_manager->pools[i].mags);
+	}
 
 	kobject_put(&_manager->kobj);
 	_manager = NULL;
@@ -1144,19 +1590,11 @@ static void
 ttm_pool_unpopulate_helper(struct ttm_tt *ttm, unsigned mem_count_update)
 {
 	struct ttm_mem_global *mem_glob = ttm->bdev->glob->mem_glob;
-	unsigned i;
-
-	if (mem_count_update == 0)
-		goto put_pages;
-
-	for (i = 0; i < mem_count_update; ++i) {
-		if (!ttm->pages[i])
-			continue;
 
-		ttm_mem_global_free_page(mem_glob, ttm->pages[i], PAGE_SIZE);
-	}
+	if (mem_count_update)
+		ttm_mem_global_free_pages(mem_glob, ttm->pages,
+					  mem_count_update);
 
-put_pages:
 	ttm_put_pages(ttm->pages, ttm->num_pages, ttm->page_flags,
 		      ttm->caching_state);
 	ttm->state = tt_unpopulated;
@@ -1165,7 +1603,6 @@ put_pages:
 int ttm_pool_populate(struct ttm_tt *ttm, struct ttm_operation_ctx *ctx)
 {
 	struct ttm_mem_global *mem_glob = ttm->bdev->glob->mem_glob;
-	unsigned i;
 	int ret;
 
 	if (ttm->state != tt_unpopulated)
@@ -1181,13 +1618,11 @@ int ttm_pool_populate(struct ttm_tt *ttm, struct ttm_operation_ctx *ctx)
 		return ret;
 	}
 
-	for (i = 0; i < ttm->num_pages; ++i) {
-		ret = ttm_mem_global_alloc_page(mem_glob, ttm->pages[i],
-						PAGE_SIZE, ctx);
-		if (unlikely(ret != 0)) {
-			ttm_pool_unpopulate_helper(ttm, i);
-			return -ENOMEM;
-		}
+	ret = ttm_mem_global_alloc_pages(mem_glob, ttm->pages, ttm->num_pages,
+					 ctx);
+	if (unlikely(ret != 0)) {
+		ttm_pool_unpopulate_helper(ttm, 0);
+		return -ENOMEM;
 	}
 
 	if (unlikely(ttm->page_flags & TTM_PAGE_FLAG_SWAPPED)) {
@@ -1285,19 +1720,31 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	char *h[] = {"pool", "refills", "pages freed", "size",
+		     "mag size", "mag hits", "mag misses", "lock waits",
+		     "wait us", "bg refills", "bg pages", "fg misses"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%7s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
+	seq_printf(m, "%7s %12s %13s %8s %8s %12s %12s %12s %12s %12s %12s %12s\n",
+			h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8],
+			h[9], h[10], h[11]);
 	for (i = 0; i < NUM_POOLS; ++i) {
 		p = &_manager->pools[i];
 
-		seq_printf(m, "%7s %12ld %13ld %8d\n",
+		seq_printf(m, "%7s %12ld %13ld %8d %8u %12lld %12lld %12lld %12lld %12lld %12lld %12lld\n",
 				p->name, p->nrefills,
-				p->nfrees, p->npages);
+				p->nfrees, p->npages,
+				ttm_page_pool_magazine_pages(p),
+				(long long)atomic64_read(&p->mag_hits),
+				(long long)atomic64_read(&p->mag_misses),
+				(long long)atomic64_read(&p->lock_waits),
+				(long long)div_u64(atomic64_read(&p->lock_wait_ns),
+						   NSEC_PER_USEC),
+				(long long)atomic64_read(&p->bg_refills),
+				(long long)atomic64_read(&p->bg_refill_pages),
+				(long long)atomic64_read(&p->fg_misses));
 	}
 	return 0;
 }
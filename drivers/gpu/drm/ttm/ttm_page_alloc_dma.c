@@ -90,6 +90,11 @@ enum pool_type {
  * @nfrees: Stats when pool is shrinking.
  * @nrefills: Stats when the pool is grown.
  * @gfp_flags: Flags to pass for alloc_page.
+ * @nid: NUMA node the device sits on, NUMA_NO_NODE if unknown.
+ * @nr_nodes: Number of entries in @node_allocs.
+ * @node_allocs: Stats of pages allocated per NUMA node.
+ * @local_allocs: Stats of pages allocated on @nid.
+ * @remote_allocs: Stats of pages that had to fall back to another node.
  * @name: Name of the pool.
  * @dev_name: Name derieved from dev - similar to how dev_info works.
  *   Used during shutdown as the dev_info during release is unavailable.
@@ -106,6 +111,11 @@ struct dma_pool {
 	unsigned long nfrees; /* Stats when shrunk. */
 	unsigned long nrefills; /* Stats when grown. */
 	gfp_t gfp_flags;
+	int nid;
+	unsigned nr_nodes;
+	unsigned long *node_allocs;
+	unsigned long local_allocs;
+	unsigned long remote_allocs;
 	char name[13]; /* "cached dma32" */
 	char dev_name[64]; /* Constructed from dev */
 };
@@ -118,12 +128,14 @@ struct dma_pool {
  * huge pool
  * @dma: The bus address of the page. If the page is not allocated
  *   via the DMA API, it will be -1.
+ * @nid: The NUMA node the page was allocated from.
  */
 struct dma_page {
 	struct list_head page_list;
 	unsigned long vaddr;
 	struct page *p;
 	dma_addr_t dma;
+	int nid;
 };
 
 /*
@@ -296,11 +308,33 @@ static void __ttm_dma_free_page(struct dma_pool *pool, struct dma_page *d_page)
 	kfree(d_page);
 	d_page = NULL;
 }
+
+static bool ttm_dma_page_is_local(struct dma_pool *pool,
+				  struct dma_page *d_page)
+{
+	return pool->nid == NUMA_NO_NODE || d_page->nid == pool->nid;
+}
+
+static void ttm_dma_pool_account_node(struct dma_pool *pool,
+				      struct dma_page *d_page)
+{
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	if ((unsigned)d_page->nid < pool->nr_nodes)
+		pool->node_allocs[d_page->nid]++;
+	if (ttm_dma_page_is_local(pool, d_page))
+		pool->local_allocs++;
+	else
+		pool->remote_allocs++;
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+}
+
 static struct dma_page *__ttm_dma_alloc_page(struct dma_pool *pool)
 {
 	struct dma_page *d_page;
 	unsigned long attrs = 0;
-	void *vaddr;
+	void *vaddr = NULL;
 
 	d_page = kmalloc(sizeof(struct dma_page), GFP_KERNEL);
 	if (!d_page)
@@ -309,8 +343,20 @@ static struct dma_page *__ttm_dma_alloc_page(struct dma_pool *pool)
 	if (pool->type & IS_HUGE)
 		attrs = DMA_ATTR_NO_WARN;
 
-	vaddr = dma_alloc_attrs(pool->dev, pool->size, &d_page->dma,
-				pool->gfp_flags, attrs);
+	/*
+	 * Try the node the device sits on first. The DMA API allocates from
+	 * dev_to_node() already, __GFP_THISNODE just keeps it from silently
+	 * spilling over. When the local node is exhausted fall back to the
+	 * normal zonelist, which walks the remaining nodes in distance order.
+	 */
+	if (pool->nid != NUMA_NO_NODE)
+		vaddr = dma_alloc_attrs(pool->dev, pool->size, &d_page->dma,
+					pool->gfp_flags | __GFP_THISNODE |
+					__GFP_NOWARN | __GFP_NORETRY,
+					attrs | DMA_ATTR_NO_WARN);
+	if (!vaddr)
+		vaddr = dma_alloc_attrs(pool->dev, pool->size, &d_page->dma,
+					pool->gfp_flags, attrs);
 	if (vaddr) {
 		if (is_vmalloc_addr(vaddr))
 			d_page->p = vmalloc_to_page(vaddr);
@@ -319,6 +365,8 @@ static struct dma_page *__ttm_dma_alloc_page(struct dma_pool *pool)
 		d_page->vaddr = (unsigned long)vaddr;
 		if (pool->type & IS_HUGE)
 			d_page->vaddr |= VADDR_FLAG_HUGE_POOL;
+		d_page->nid = page_to_nid(d_page->p);
+		ttm_dma_pool_account_node(pool, d_page);
 	} else {
 		kfree(d_page);
 		d_page = NULL;
@@ -528,6 +576,7 @@ static void ttm_dma_free_pool(struct device *dev, enum pool_type type)
 		 * touching it. In case somebody is trying to _add_ we are
 		 * guarded by the mutex. */
 		list_del(&pool->pools);
+		kfree(pool->node_allocs);
 		kfree(pool);
 		break;
 	}
@@ -571,11 +620,18 @@ static struct dma_pool *ttm_dma_pool_init(struct device *dev, gfp_t flags,
 
 	ret = -ENOMEM;
 
-	pool = kmalloc_node(sizeof(struct dma_pool), GFP_KERNEL,
+	pool = kzalloc_node(sizeof(struct dma_pool), GFP_KERNEL,
 			    dev_to_node(dev));
 	if (!pool)
 		goto err_mem;
 
+	pool->nr_nodes = nr_node_ids;
+	pool->node_allocs = kcalloc_node(pool->nr_nodes,
+					 sizeof(*pool->node_allocs),
+					 GFP_KERNEL, dev_to_node(dev));
+	if (!pool->node_allocs)
+		goto err_mem;
+
 	sec_pool = kmalloc_node(sizeof(struct device_pools), GFP_KERNEL,
 				dev_to_node(dev));
 	if (!sec_pool)
@@ -589,6 +645,7 @@ static struct dma_pool *ttm_dma_pool_init(struct device *dev, gfp_t flags,
 	INIT_LIST_HEAD(&pool->pools);
 	spin_lock_init(&pool->lock);
 	pool->dev = dev;
+	pool->nid = dev_to_node(dev);
 	pool->npages_free = pool->npages_in_use = 0;
 	pool->nfrees = 0;
 	pool->gfp_flags = flags;
@@ -629,6 +686,8 @@ static struct dma_pool *ttm_dma_pool_init(struct device *dev, gfp_t flags,
 err_mem:
 	devres_free(ptr);
 	kfree(sec_pool);
+	if (pool)
+		kfree(pool->node_allocs);
 	kfree(pool);
 	return ERR_PTR(ret);
 }
@@ -781,6 +840,29 @@ out:
 	return r;
 }
 
+/*
+ * Hand pages back to the free list. Pages local to the device go to the head
+ * so ttm_dma_pool_get_pages() hands them out first, remote ones go to the tail
+ * where ttm_dma_page_pool_free() picks its victims.
+ *
+ * @return number of pages moved.
+ */
+static unsigned ttm_dma_pool_splice_locked(struct dma_pool *pool,
+					   struct list_head *d_pages)
+{
+	struct dma_page *d_page, *tmp;
+	unsigned count = 0;
+
+	list_for_each_entry_safe(d_page, tmp, d_pages, page_list) {
+		if (ttm_dma_page_is_local(pool, d_page))
+			list_move(&d_page->page_list, &pool->free_list);
+		else
+			list_move_tail(&d_page->page_list, &pool->free_list);
+		count++;
+	}
+	return count;
+}
+
 /*
  * @return count of pages still required to fulfill the request.
  */
@@ -804,21 +886,17 @@ static int ttm_dma_page_pool_fill_locked(struct dma_pool *pool,
 		spin_lock_irqsave(&pool->lock, *irq_flags);
 		if (!r) {
 			/* Add the fresh to the end.. */
-			list_splice(&d_pages, &pool->free_list);
+			ttm_dma_pool_splice_locked(pool, &d_pages);
 			++pool->nrefills;
 			pool->npages_free += count;
 			r = count;
 		} else {
-			struct dma_page *d_page;
-			unsigned cpages = 0;
+			unsigned cpages;
 
 			pr_debug("%s: Failed to fill %s pool (r:%d)!\n",
 				 pool->dev_name, pool->name, r);
 
-			list_for_each_entry(d_page, &d_pages, page_list) {
-				cpages++;
-			}
-			list_splice_tail(&d_pages, &pool->free_list);
+			cpages = ttm_dma_pool_splice_locked(pool, &d_pages);
 			pool->npages_free += cpages;
 			r = cpages;
 		}
@@ -1057,7 +1135,7 @@ void ttm_dma_unpopulate(struct ttm_dma_tt *ttm_dma, struct device *dev)
 		pool->nfrees += count;
 	} else {
 		pool->npages_free += count;
-		list_splice(&ttm_dma->pages_list, &pool->free_list);
+		ttm_dma_pool_splice_locked(pool, &ttm_dma->pages_list);
 		/*
 		 * Wait to have at at least NUM_PAGES_TO_ALLOC number of pages
 		 * to free in order to minimize calls to set_memory_wb().
@@ -1234,6 +1312,19 @@ int ttm_dma_page_alloc_debugfs(struct seq_file *m, void *data)
 				pool->npages_free,
 				pool->dev_name);
 	}
+	seq_printf(m, "\n         pool     node        local       remote     per-node\n");
+	list_for_each_entry(p, &_manager->pools, pools) {
+		unsigned i;
+
+		if (!p->dev)
+			continue;
+		pool = p->pool;
+		seq_printf(m, "%13s %8d %12lu %12lu ", pool->name, pool->nid,
+			   pool->local_allocs, pool->remote_allocs);
+		for (i = 0; i < pool->nr_nodes; i++)
+			seq_printf(m, " %lu", pool->node_allocs[i]);
+		seq_printf(m, "\n");
+	}
 	mutex_unlock(&_manager->lock);
 	return 0;
 }
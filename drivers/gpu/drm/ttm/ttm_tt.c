@@ -35,6 +35,8 @@
 #include <linux/pagemap.h>
 #include <linux/shmem_fs.h>
 #include <linux/file.h>
+#include <linux/highmem.h>
+#include <linux/ktime.h>
 #include <drm/drm_cache.h>
 #include <drm/ttm/ttm_bo_driver.h>
 #include <drm/ttm/ttm_page_alloc.h>
@@ -205,6 +207,274 @@ int ttm_tt_set_placement_caching(struct ttm_tt *ttm, uint32_t placement)
 }
 EXPORT_SYMBOL(ttm_tt_set_placement_caching);
 
+/*
+ * Compressed swap tier.
+ *
+ * Pages of a swapped out ttm_tt are kept in kernel memory instead of shmem
+ * when that saves enough space. Pages that are all zero cost nothing,
+ * pages filled with one repeated word store only that word, everything else
+ * is run length encoded on zero words, which is what sparse textures and
+ * partially used staging buffers mostly consist of.
+ *
+ * An encoded page is a sequence of tokens, each a struct ttm_tt_ztoken
+ * followed by @lits literal words.
+ */
+enum ttm_tt_zpage_type {
+	TTM_ZPAGE_ZERO,
+	TTM_ZPAGE_FILL,
+	TTM_ZPAGE_RLE,
+	TTM_ZPAGE_RAW,
+};
+
+struct ttm_tt_zpage {
+	union {
+		void *data;
+		u64 fill;
+	};
+	u32 len;
+	u8 type;
+};
+
+struct ttm_tt_compressed {
+	size_t orig;
+	size_t stored;
+	unsigned long zero;
+	struct ttm_tt_zpage pages[];
+};
+
+struct ttm_tt_ztoken {
+	u16 zeros;
+	u16 lits;
+};
+
+#define TTM_ZPAGE_WORDS		(PAGE_SIZE / sizeof(u64))
+
+/* Stop encoding a page once it would take more than this */
+#define TTM_ZPAGE_MAX_LEN	(PAGE_SIZE * 3 / 4)
+
+static size_t ttm_tt_zpage_encode(const u64 *src, u8 *dst)
+{
+	struct ttm_tt_ztoken tok;
+	size_t out = 0;
+	unsigned i = 0;
+
+	while (i < TTM_ZPAGE_WORDS) {
+		unsigned start;
+
+		for (start = i; i < TTM_ZPAGE_WORDS && !src[i]; ++i)
+			;
+		tok.zeros = i - start;
+		for (start = i; i < TTM_ZPAGE_WORDS && src[i]; ++i)
+			;
+		tok.lits = i - start;
+
+		if (out + sizeof(tok) + tok.lits * sizeof(u64) >
+		    TTM_ZPAGE_MAX_LEN)
+			return 0;
+
+		memcpy(dst + out, &tok, sizeof(tok));
+		out += sizeof(tok);
+		memcpy(dst + out, src + start, tok.lits * sizeof(u64));
+		out += tok.lits * sizeof(u64);
+	}
+
+	return out;
+}
+
+static void ttm_tt_zpage_decode(const u8 *src, size_t len, u64 *dst)
+{
+	struct ttm_tt_ztoken tok;
+	size_t in = 0;
+
+	while (in < len) {
+		memcpy(&tok, src + in, sizeof(tok));
+		in += sizeof(tok);
+		memset(dst, 0, tok.zeros * sizeof(u64));
+		dst += tok.zeros;
+		memcpy(dst, src + in, tok.lits * sizeof(u64));
+		dst += tok.lits;
+		in += tok.lits * sizeof(u64);
+	}
+}
+
+static int ttm_tt_zpage_store(struct ttm_tt_zpage *zp, const u64 *src,
+			      u8 *scratch)
+{
+	const void *data = src;
+	size_t len;
+	unsigned i;
+
+	for (i = 1; i < TTM_ZPAGE_WORDS && src[i] == src[0]; ++i)
+		;
+	if (i == TTM_ZPAGE_WORDS) {
+		zp->type = src[0] ? TTM_ZPAGE_FILL : TTM_ZPAGE_ZERO;
+		zp->fill = src[0];
+		zp->len = 0;
+		return 0;
+	}
+
+	len = ttm_tt_zpage_encode(src, scratch);
+	if (len) {
+		zp->type = TTM_ZPAGE_RLE;
+		data = scratch;
+	} else {
+		zp->type = TTM_ZPAGE_RAW;
+		len = PAGE_SIZE;
+	}
+
+	zp->data = kmemdup(data, len, GFP_KERNEL | __GFP_NORETRY |
+			   __GFP_NOWARN);
+	if (!zp->data)
+		return -ENOMEM;
+	zp->len = len;
+	return 0;
+}
+
+static void ttm_tt_zpage_load(const struct ttm_tt_zpage *zp, u64 *dst)
+{
+	unsigned i;
+
+	switch (zp->type) {
+	case TTM_ZPAGE_ZERO:
+		memset(dst, 0, PAGE_SIZE);
+		break;
+	case TTM_ZPAGE_FILL:
+		for (i = 0; i < TTM_ZPAGE_WORDS; ++i)
+			dst[i] = zp->fill;
+		break;
+	case TTM_ZPAGE_RLE:
+		ttm_tt_zpage_decode(zp->data, zp->len, dst);
+		break;
+	case TTM_ZPAGE_RAW:
+		memcpy(dst, zp->data, PAGE_SIZE);
+		break;
+	}
+}
+
+static void __ttm_tt_compressed_free(struct ttm_tt_compressed *ztt,
+				     unsigned long num_pages)
+{
+	unsigned long i;
+
+	for (i = 0; i < num_pages; ++i) {
+		if (ztt->pages[i].type == TTM_ZPAGE_RLE ||
+		    ztt->pages[i].type == TTM_ZPAGE_RAW)
+			kfree(ztt->pages[i].data);
+	}
+	kvfree(ztt);
+}
+
+static void ttm_tt_compressed_free(struct ttm_tt *ttm)
+{
+	struct ttm_tt_compressed *ztt = ttm->swap_compressed;
+
+	if (!ztt)
+		return;
+
+	atomic64_sub(ztt->orig, &ttm_bo_glob.swap_comp_orig);
+	atomic64_sub(ztt->stored, &ttm_bo_glob.swap_comp_stored);
+	atomic64_sub(ztt->zero, &ttm_bo_glob.swap_comp_zero);
+	__ttm_tt_compressed_free(ztt, ttm->num_pages);
+	ttm->swap_compressed = NULL;
+}
+
+/*
+ * Try to move the pages of @ttm into the compressed tier. Returns 0 on
+ * success, or an error if the BO doesn't compress well enough or the tier
+ * is full, in which case the caller falls back to shmem.
+ */
+static int ttm_tt_swapout_compressed(struct ttm_tt *ttm)
+{
+	struct ttm_bo_global *glob = &ttm_bo_glob;
+	struct ttm_tt_compressed *ztt;
+	unsigned long i;
+	u8 *scratch;
+	int ret = 0;
+
+	ztt = kvzalloc(struct_size(ztt, pages, ttm->num_pages),
+		       GFP_KERNEL | __GFP_NOWARN);
+	if (!ztt)
+		return -ENOMEM;
+
+	scratch = kmalloc(TTM_ZPAGE_MAX_LEN, GFP_KERNEL | __GFP_NOWARN);
+	if (!scratch) {
+		kvfree(ztt);
+		return -ENOMEM;
+	}
+
+	ztt->orig = ttm->num_pages << PAGE_SHIFT;
+	ztt->stored = struct_size(ztt, pages, ttm->num_pages);
+	for (i = 0; i < ttm->num_pages; ++i) {
+		struct ttm_tt_zpage *zp = &ztt->pages[i];
+		struct page *page = ttm->pages[i];
+		void *src;
+
+		/* Never populated, reads back as zero like from shmem */
+		if (unlikely(page == NULL)) {
+			zp->type = TTM_ZPAGE_ZERO;
+			++ztt->zero;
+			continue;
+		}
+
+		/* Not atomic, ttm_tt_zpage_store() allocates */
+		src = kmap(page);
+		ret = ttm_tt_zpage_store(zp, src, scratch);
+		kunmap(page);
+		if (ret)
+			break;
+
+		ztt->stored += zp->len;
+		if (zp->type == TTM_ZPAGE_ZERO)
+			++ztt->zero;
+
+		/* Give up early on BOs that won't make the cut */
+		if (ztt->stored > ztt->orig / 2) {
+			ret = -E2BIG;
+			break;
+		}
+	}
+	kfree(scratch);
+
+	if (!ret && atomic64_add_return(ztt->stored, &glob->swap_comp_stored) >
+	    READ_ONCE(glob->swap_compress_limit)) {
+		atomic64_sub(ztt->stored, &glob->swap_comp_stored);
+		ret = -ENOSPC;
+	}
+
+	if (ret) {
+		__ttm_tt_compressed_free(ztt, ttm->num_pages);
+		atomic64_inc(&glob->swap_comp_rejects);
+		return ret;
+	}
+
+	atomic64_add(ztt->orig, &glob->swap_comp_orig);
+	atomic64_add(ztt->zero, &glob->swap_comp_zero);
+	ttm->swap_compressed = ztt;
+	return 0;
+}
+
+static int ttm_tt_swapin_compressed(struct ttm_tt *ttm)
+{
+	struct ttm_tt_compressed *ztt = ttm->swap_compressed;
+	unsigned long i;
+
+	for (i = 0; i < ttm->num_pages; ++i) {
+		struct page *to_page = ttm->pages[i];
+		void *dst;
+
+		if (unlikely(to_page == NULL))
+			return -ENOMEM;
+
+		dst = kmap_atomic(to_page);
+		ttm_tt_zpage_load(&ztt->pages[i], dst);
+		kunmap_atomic(dst);
+	}
+
+	ttm_tt_compressed_free(ttm);
+	ttm->page_flags &= ~TTM_PAGE_FLAG_SWAPPED;
+	return 0;
+}
+
 void ttm_tt_destroy(struct ttm_tt *ttm)
 {
 	if (ttm == NULL)
@@ -220,6 +490,7 @@ void ttm_tt_destroy(struct ttm_tt *ttm)
 		fput(ttm->swap_storage);
 
 	ttm->swap_storage = NULL;
+	ttm_tt_compressed_free(ttm);
 	ttm->func->destroy(ttm);
 }
 
@@ -232,6 +503,7 @@ void ttm_tt_init_fields(struct ttm_tt *ttm, struct ttm_buffer_object *bo,
 	ttm->page_flags = page_flags;
 	ttm->state = tt_unpopulated;
 	ttm->swap_storage = NULL;
+	ttm->swap_compressed = NULL;
 	ttm->sg = bo->sg;
 }
 
@@ -344,7 +616,7 @@ int ttm_tt_bind(struct ttm_tt *ttm, struct ttm_mem_reg *bo_mem,
 }
 EXPORT_SYMBOL(ttm_tt_bind);
 
-int ttm_tt_swapin(struct ttm_tt *ttm)
+static int ttm_tt_swapin_shmem(struct ttm_tt *ttm)
 {
 #ifdef __linux__
 	struct address_space *swap_space;
@@ -394,6 +666,31 @@ out_err:
 	return ret;
 }
 
+int ttm_tt_swapin(struct ttm_tt *ttm)
+{
+	struct ttm_bo_global *glob = &ttm_bo_glob;
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (ttm->swap_compressed) {
+		ret = ttm_tt_swapin_compressed(ttm);
+		if (!ret) {
+			atomic64_inc(&glob->swapin_comp);
+			atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+				     &glob->swapin_comp_ns);
+		}
+	} else {
+		ret = ttm_tt_swapin_shmem(ttm);
+		if (!ret) {
+			atomic64_inc(&glob->swapin_shmem);
+			atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+				     &glob->swapin_shmem_ns);
+		}
+	}
+
+	return ret;
+}
+
 int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 {
 #ifdef __linux__
@@ -410,6 +707,17 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 	BUG_ON(ttm->state != tt_unbound && ttm->state != tt_unpopulated);
 	BUG_ON(ttm->caching_state != tt_cached);
 
+	/*
+	 * Persistent swap storage is owned by the driver, which expects the
+	 * contents to end up there.
+	 */
+	if (!persistent_swap_storage && READ_ONCE(ttm_bo_glob.swap_compress) &&
+	    !ttm_tt_swapout_compressed(ttm)) {
+		ttm_tt_unpopulate(ttm);
+		ttm->page_flags |= TTM_PAGE_FLAG_SWAPPED;
+		return 0;
+	}
+
 	if (!persistent_swap_storage) {
 		swap_storage = shmem_file_setup("ttm swap",
 						ttm->num_pages << PAGE_SHIFT,
@@ -46,8 +46,10 @@
 struct drm_prime_file_private {
 /* private: */
 	struct mutex lock;
-	struct rb_root dmabufs;
-	struct rb_root handles;
+	struct hlist_head *dmabufs;	/* hashed by dma_buf pointer */
+	struct hlist_head *handles;	/* hashed by GEM handle */
+	unsigned int bits;
+	unsigned int count;
 };
 
 struct device;
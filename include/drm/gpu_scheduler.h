@@ -26,6 +26,9 @@
 
 #include <drm/spsc_queue.h>
 #include <linux/dma-fence.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/kref.h>
 
 #ifdef __FreeBSD__
 #include <linux/workqueue.h>
@@ -33,8 +36,12 @@
 
 #define MAX_WAIT_SCHED_ENTITY_Q_EMPTY msecs_to_jiffies(1000)
 
+/* Entity weight which gets charged the plain execution time of its jobs */
+#define DRM_SCHED_WEIGHT_DEFAULT	1024
+
 struct drm_gpu_scheduler;
 struct drm_sched_rq;
+struct drm_printer;
 
 enum drm_sched_priority {
 	DRM_SCHED_PRIORITY_MIN,
@@ -48,12 +55,74 @@ enum drm_sched_priority {
 	DRM_SCHED_PRIORITY_UNSET = -2
 };
 
+/**
+ * enum drm_sched_policy - how entities of the same priority are picked
+ *
+ * @DRM_SCHED_POLICY_RR: round robin between the ready entities.
+ * @DRM_SCHED_POLICY_FAIR: pick the ready entity with the lowest virtual
+ *                         runtime, i.e. the GPU time its jobs used so far
+ *                         scaled by the entity weight.
+ */
+enum drm_sched_policy {
+	DRM_SCHED_POLICY_RR,
+	DRM_SCHED_POLICY_FAIR,
+	DRM_SCHED_POLICY_COUNT
+};
+
+/* Bucket n counts latencies of [2^(n-1), 2^n) * 1024ns, the last one all above */
+#define DRM_SCHED_HIST_BUCKETS		24
+
+enum drm_sched_hist_type {
+	DRM_SCHED_HIST_QUEUE,	/* push_job until picked, minus dependency wait */
+	DRM_SCHED_HIST_DEP,	/* blocked on a dependency at the queue head */
+	DRM_SCHED_HIST_EXEC,	/* run_job until the hardware fence signaled */
+	DRM_SCHED_HIST_COUNT
+};
+
+/**
+ * struct drm_sched_hist - log2 latency histograms of the job phases
+ *
+ * @buckets: job counts per phase and latency bucket.
+ */
+struct drm_sched_hist {
+	atomic_t	buckets[DRM_SCHED_HIST_COUNT][DRM_SCHED_HIST_BUCKETS];
+};
+
+/**
+ * struct drm_sched_entity_stats - accounting target of an entity's jobs
+ *
+ * @refcount: held by the entity and by each of its jobs.
+ * @lock: protects @entity. Taken from fence callbacks, so it must be used
+ *        with the irqsave variants.
+ * @entity: the entity, NULL once drm_sched_entity_fini() ran.
+ * @hist: latency histograms of the jobs of the entity.
+ *
+ * Jobs can outlive their entity, so the execution time of a finished job
+ * is charged and accounted through this instead of &drm_sched_job.entity.
+ */
+struct drm_sched_entity_stats {
+	struct kref			refcount;
+	spinlock_t			lock;
+	struct drm_sched_entity		*entity;
+	struct drm_sched_hist		hist;
+};
+
 /**
  * struct drm_sched_entity - A wrapper around a job queue (typically
  * attached to the DRM file_priv).
  *
  * @list: used to append this struct to the list of entities in the
  *        runqueue.
+ * @ready_list: used to append this struct to the list of ready entities in
+ *              the runqueue.
+ * @ready_node: used to insert this struct into the tree of ready entities in
+ *              the runqueue when the fair share policy is in use.
+ * @vruntime: execution time of the jobs of this entity in ns, scaled by
+ *            DRM_SCHED_WEIGHT_DEFAULT / @weight.
+ * @weight: share of the GPU time this entity gets under the fair share
+ *          policy, relative to DRM_SCHED_WEIGHT_DEFAULT.
+ * @stats: execution time accounting and latency histograms of the jobs of
+ *         this entity.
  * @rq: runqueue on which this entity is currently scheduled.
  * @rq_list: a list of run queues on which jobs from this entity can
  *           be scheduled
@@ -82,6 +151,11 @@ enum drm_sched_priority {
  */
 struct drm_sched_entity {
 	struct list_head		list;
+	struct list_head		ready_list;
+	struct rb_node			ready_node;
+	u64				vruntime;
+	unsigned int			weight;
+	struct drm_sched_entity_stats	*stats;
 	struct drm_sched_rq		*rq;
 	struct drm_sched_rq		**rq_list;
 	unsigned int                    num_rq_list;
@@ -103,9 +177,17 @@ struct drm_sched_entity {
 /**
  * struct drm_sched_rq - queue of entities to be scheduled.
  *
- * @lock: to modify the entities list.
+ * @lock: to modify the entities and ready lists. Taken from fence
+ *        callbacks, so it must be used with the irqsave variants.
  * @sched: the scheduler to which this rq belongs to.
  * @entities: list of the entities to be scheduled.
+ * @ready: FIFO of the entities which have a job queued and no unsignaled
+ *         dependency, in the order they are to be scheduled.
+ * @ready_tree: same as @ready but sorted by vruntime, used instead of @ready
+ *              by the fair share policy.
+ * @min_vruntime: vruntime of the last entity picked by the fair share policy.
+ *                Entities becoming ready start no lower than this, so they
+ *                can't monopolize the ring after being idle.
  * @current_entity: the entity which is to be scheduled.
  *
  * Run queue is a set of entities scheduling command submissions for
@@ -116,6 +198,9 @@ struct drm_sched_rq {
 	spinlock_t			lock;
 	struct drm_gpu_scheduler	*sched;
 	struct list_head		entities;
+	struct list_head		ready;
+	struct rb_root_cached		ready_tree;
+	u64				min_vruntime;
 	struct drm_sched_entity		*current_entity;
 };
 
@@ -178,7 +263,14 @@ struct drm_sched_fence *to_drm_sched_fence(struct dma_fence *f);
  *         be scheduled further.
  * @s_priority: the priority of the job.
  * @entity: the entity to which this job belongs.
+ * @stats: reference to the stats of @entity, for use after the job was
+ *         taken from the entity.
  * @cb: the callback for the parent fence in s_fence.
+ * @push_time: when the job was pushed to the entity.
+ * @dep_time: when the job was first found blocked on a dependency, zero if
+ *            it never was.
+ * @start_time: when the job was handed to the hardware.
+ * @exec_ns: execution time of the job, valid once it finished.
  *
  * A job is created by the driver using drm_sched_job_init(), and
  * should call drm_sched_entity_push_job() once it wants the scheduler
@@ -194,7 +286,12 @@ struct drm_sched_job {
 	atomic_t			karma;
 	enum drm_sched_priority		s_priority;
 	struct drm_sched_entity  *entity;
+	struct drm_sched_entity_stats	*stats;
 	struct dma_fence_cb		cb;
+	ktime_t				push_time;
+	ktime_t				dep_time;
+	ktime_t				start_time;
+	u64				exec_ns;
 };
 
 static inline bool drm_sched_invalidate_job(struct drm_sched_job *s_job,
@@ -264,6 +361,12 @@ struct drm_sched_backend_ops {
  * @num_jobs: the number of jobs in queue in the scheduler
  * @ready: marks if the underlying HW is ready to work
  * @free_guilty: A hit to time out handler to free the guilty job.
+ * @policy: how entities of the same priority are picked, see
+ *          &enum drm_sched_policy. Only to be changed before the first job
+ *          gets pushed.
+ * @last_done: completion time of the last job, used to tell execution time
+ *             apart from time spent queued behind the previous job.
+ * @hist: latency histograms of all jobs run by this scheduler.
  *
  * One scheduler is implemented for each hardware ring.
  */
@@ -285,6 +388,9 @@ struct drm_gpu_scheduler {
 	atomic_t                        num_jobs;
 	bool			ready;
 	bool				free_guilty;
+	enum drm_sched_policy		policy;
+	ktime_t				last_done;
+	struct drm_sched_hist		hist;
 };
 
 int drm_sched_init(struct drm_gpu_scheduler *sched,
@@ -311,6 +417,7 @@ void drm_sched_rq_add_entity(struct drm_sched_rq *rq,
 			     struct drm_sched_entity *entity);
 void drm_sched_rq_remove_entity(struct drm_sched_rq *rq,
 				struct drm_sched_entity *entity);
+void drm_sched_rq_update_ready(struct drm_sched_entity *entity);
 
 int drm_sched_entity_init(struct drm_sched_entity *entity,
 			  struct drm_sched_rq **rq_list,
@@ -325,6 +432,11 @@ void drm_sched_entity_push_job(struct drm_sched_job *sched_job,
 			       struct drm_sched_entity *entity);
 void drm_sched_entity_set_priority(struct drm_sched_entity *entity,
 				   enum drm_sched_priority priority);
+void drm_sched_entity_set_weight(struct drm_sched_entity *entity,
+				 unsigned int weight);
+struct drm_sched_entity_stats *
+drm_sched_entity_stats_get(struct drm_sched_entity_stats *stats);
+void drm_sched_entity_stats_put(struct drm_sched_entity_stats *stats);
 bool drm_sched_entity_is_ready(struct drm_sched_entity *entity);
 
 struct drm_sched_fence *drm_sched_fence_create(
@@ -332,6 +444,12 @@ struct drm_sched_fence *drm_sched_fence_create(
 void drm_sched_fence_scheduled(struct drm_sched_fence *fence);
 void drm_sched_fence_finished(struct drm_sched_fence *fence);
 
+void drm_sched_hist_add(struct drm_sched_hist *hist,
+			enum drm_sched_hist_type type, u64 ns);
+void drm_sched_hist_reset(struct drm_gpu_scheduler *sched);
+void drm_sched_hist_print(struct drm_gpu_scheduler *sched,
+			  struct drm_printer *p);
+
 unsigned long drm_sched_suspend_timeout(struct drm_gpu_scheduler *sched);
 void drm_sched_resume_timeout(struct drm_gpu_scheduler *sched,
 		                unsigned long remaining);
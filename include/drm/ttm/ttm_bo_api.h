@@ -209,6 +209,7 @@ struct ttm_buffer_object {
 	struct list_head ddestroy;
 	struct list_head swap;
 	struct list_head io_reserve_lru;
+	unsigned evict_ref;
 
 	/**
 	 * Members protected by a bo reservation.
@@ -376,7 +377,7 @@ void ttm_bo_put(struct ttm_buffer_object *bo);
  *
  * Add this bo to the relevant mem type lru and, if it's backed by
  * system pages (ttms) to the swap list.
- * This function must be called with struct ttm_bo_global::lru_lock held, and
+ * This function must be called with struct ttm_bo_device::lru_lock held, and
  * is typically called immediately prior to unreserving a bo.
  */
 void ttm_bo_add_to_lru(struct ttm_buffer_object *bo);
@@ -387,7 +388,7 @@ void ttm_bo_add_to_lru(struct ttm_buffer_object *bo);
  * @bo: The buffer object.
  *
  * Remove this bo from all lru lists used to lookup and reserve an object.
- * This function must be called with struct ttm_bo_global::lru_lock held,
+ * This function must be called with struct ttm_bo_device::lru_lock held,
  * and is usually called just immediately after the bo has been reserved to
  * avoid recursive reservation from lru lists.
  */
@@ -400,7 +401,7 @@ void ttm_bo_del_from_lru(struct ttm_buffer_object *bo);
  * @bulk: optional bulk move structure to remember BO positions
  *
  * Move this BO to the tail of all lru lists used to lookup and reserve an
- * object. This function must be called with struct ttm_bo_global::lru_lock
+ * object. This function must be called with struct ttm_bo_device::lru_lock
  * held, and is used to make a BO less likely to be considered for eviction.
  */
 void ttm_bo_move_to_lru_tail(struct ttm_buffer_object *bo,
@@ -412,7 +413,7 @@ void ttm_bo_move_to_lru_tail(struct ttm_buffer_object *bo,
  * @bulk: bulk move structure
  *
  * Bulk move BOs to the LRU tail, only valid to use when driver makes sure that
- * BO order never changes. Should be called with ttm_bo_global::lru_lock held.
+ * BO order never changes. Should be called with ttm_bo_device::lru_lock held.
  */
 void ttm_bo_bulk_move_lru_tail(struct ttm_lru_bulk_move *bulk);
 
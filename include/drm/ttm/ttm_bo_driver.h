@@ -41,6 +41,7 @@
 #include <linux/workqueue.h>
 #include <linux/fs.h>
 #include <linux/spinlock.h>
+#include <linux/ktime.h>
 #include <linux/reservation.h>
 
 #ifndef __linux__
@@ -55,6 +56,9 @@
 
 #define TTM_MAX_BO_PRIORITY	4U
 
+/* Default cap on memory held by the compressed swap tier */
+#define TTM_SWAP_COMPRESS_DEFAULT_LIMIT	(256ULL << 20)
+
 #define TTM_MEMTYPE_FLAG_FIXED         (1 << 0)	/* Fixed (on-card) PCI memory */
 #define TTM_MEMTYPE_FLAG_MAPPABLE      (1 << 1)	/* Memory mappable */
 #define TTM_MEMTYPE_FLAG_CMA           (1 << 3)	/* Can't map aperture */
@@ -145,6 +149,41 @@ struct ttm_mem_type_manager_func {
 		      struct drm_printer *printer);
 };
 
+/**
+ * struct ttm_evict_policy
+ *
+ * @name: Name of the policy, see ttm_evict_policy_find().
+ * @select: Optional. Called with the device LRU lock held to fill @cand
+ * with up to @max BOs from @lru, in the order ttm_mem_evict_first()
+ * should try them. @num_pages is the size of the allocation that needs the
+ * space, or 0 if unknown. BOs not returned are still tried afterwards, in
+ * LRU order, so a policy can't make an evictable BO unevictable.
+ *
+ * Decides which BO ttm_mem_evict_first() evicts from a memory type.
+ */
+struct ttm_evict_policy {
+	const char *name;
+	unsigned (*select)(struct ttm_mem_type_manager *man,
+			   struct list_head *lru, unsigned long num_pages,
+			   struct ttm_buffer_object **cand, unsigned max);
+};
+
+/* Plain LRU, the default */
+extern const struct ttm_evict_policy ttm_evict_policy_lru;
+/* Prefer the smallest of the oldest BOs that frees enough space */
+extern const struct ttm_evict_policy ttm_evict_policy_size;
+/* CLOCK, recently used BOs get a second chance */
+extern const struct ttm_evict_policy ttm_evict_policy_clock;
+
+/**
+ * ttm_evict_policy_find
+ *
+ * @name: Policy name.
+ *
+ * Returns the eviction policy called @name, or NULL if there is none.
+ */
+const struct ttm_evict_policy *ttm_evict_policy_find(const char *name);
+
 /**
  * struct ttm_mem_type_manager
  *
@@ -169,6 +208,9 @@ struct ttm_mem_type_manager_func {
  * @move_lock: lock for move fence
  * static information. bdev::driver::io_mem_free is never used.
  * @lru: The lru list for this memory type.
+ * @evict_policy: How to pick eviction victims, NULL means LRU.
+ * @evictions: Number of BOs evicted from this memory type.
+ * @evicted_bytes: Bytes evicted from this memory type.
  * @move: The fence of the last pipelined move operation.
  *
  * This structure is used to identify and manage memory types for a device.
@@ -192,6 +234,7 @@ struct ttm_mem_type_manager {
 	uint32_t available_caching;
 	uint32_t default_caching;
 	const struct ttm_mem_type_manager_func *func;
+	const struct ttm_evict_policy *evict_policy;
 	void *priv;
 	struct mutex io_reserve_mutex;
 	bool use_io_reserve_lru;
@@ -205,10 +248,12 @@ struct ttm_mem_type_manager {
 	struct list_head io_reserve_lru;
 
 	/*
-	 * Protected by the global->lru_lock.
+	 * Protected by the bdev->lru_lock.
 	 */
 
 	struct list_head lru[TTM_MAX_BO_PRIORITY];
+	uint64_t evictions;
+	uint64_t evicted_bytes;
 
 	/*
 	 * Protected by @move_lock.
@@ -412,7 +457,8 @@ struct ttm_bo_driver {
  * @shrink: A shrink callback object used for buffer object swap.
  * @device_list_mutex: Mutex protecting the device list.
  * This mutex is held while traversing the device list for pm options.
- * @lru_lock: Spinlock protecting the bo subsystem lru lists.
+ * @swap_lock: Spinlock protecting the swap lru lists. Nests inside
+ * ttm_bo_device::lru_lock.
  * @device_list: List of buffer object devices.
  * @swap_lru: Lru list of buffer objects used for swapping.
  */
@@ -426,7 +472,7 @@ extern struct ttm_bo_global {
 	struct kobject kobj;
 	struct ttm_mem_global *mem_glob;
 	struct page *dummy_read_page;
-	spinlock_t lru_lock;
+	spinlock_t swap_lock;
 
 	/**
 	 * Protected by ttm_global_mutex.
@@ -434,7 +480,7 @@ extern struct ttm_bo_global {
 	struct list_head device_list;
 
 	/**
-	 * Protected by the lru_lock.
+	 * Protected by the swap_lock.
 	 */
 	struct list_head swap_lru[TTM_MAX_BO_PRIORITY];
 
@@ -442,6 +488,48 @@ extern struct ttm_bo_global {
 	 * Internal protection.
 	 */
 	atomic_t bo_count;
+
+	/**
+	 * CPU mapping fault statistics.
+	 */
+	atomic64_t vm_faults;
+	atomic64_t vm_huge_faults;
+	atomic64_t vm_window_faults;
+	atomic64_t vm_fault_pages;
+
+	/**
+	 * CPU fallback move (ttm_bo_move_memcpy) statistics.
+	 */
+	atomic64_t memcpy_moves;
+	atomic64_t memcpy_bytes;
+	atomic64_t memcpy_ns;
+
+	/**
+	 * ttm_eu_reserve_buffers() settings and statistics. When @eu_sorted
+	 * is set, validation lists are reserved in resv address order.
+	 */
+	bool eu_sorted;
+	atomic64_t eu_reserves;
+	atomic64_t eu_backoffs;
+	atomic64_t eu_contended;
+	atomic64_t eu_backoff_ns;
+
+	/**
+	 * Compressed in-memory swap tier. @swap_compress enables it,
+	 * @swap_compress_limit caps the memory it may hold in bytes.
+	 * The orig/stored/zero counters describe what is currently held,
+	 * the rest are cumulative.
+	 */
+	bool swap_compress;
+	uint64_t swap_compress_limit;
+	atomic64_t swap_comp_orig;
+	atomic64_t swap_comp_stored;
+	atomic64_t swap_comp_zero;
+	atomic64_t swap_comp_rejects;
+	atomic64_t swapin_comp;
+	atomic64_t swapin_comp_ns;
+	atomic64_t swapin_shmem;
+	atomic64_t swapin_shmem_ns;
 } ttm_bo_glob;
 
 
@@ -453,8 +541,9 @@ extern struct ttm_bo_global {
  * @driver: Pointer to a struct ttm_bo_driver struct setup by the driver.
  * @man: An array of mem_type_managers.
  * @vma_manager: Address space manager
- * lru_lock: Spinlock that protects the buffer+device lru lists and
- * ddestroy lists.
+ * @lru_lock: Spinlock that protects the buffer+device lru lists and
+ * ddestroy lists. Only taken through ttm_bo_lru_lock()/ttm_bo_lru_unlock()
+ * which account the hold time in @lru_stats.
  * @dev_mapping: A pointer to the struct address_space representing the
  * device address space.
  * @wq: Work queue structure for the delayed delete workqueue.
@@ -481,9 +570,17 @@ struct ttm_bo_device {
 	struct drm_vma_offset_manager vma_manager;
 
 	/*
-	 * Protected by the global:lru lock.
+	 * Protected by the lru lock.
 	 */
+	spinlock_t lru_lock;
 	struct list_head ddestroy;
+	struct {
+		u64 start;
+		u64 count;
+		u64 contended;
+		u64 hold_ns;
+		u64 hold_max_ns;
+	} lru_stats;
 
 #ifdef __linux__
 	/*
@@ -504,6 +601,45 @@ struct ttm_bo_device {
 	bool no_retry;
 };
 
+/**
+ * ttm_bo_lru_lock
+ *
+ * @bdev: The buffer object device.
+ *
+ * Take the LRU lock of @bdev and start accounting its hold time.
+ */
+static inline void ttm_bo_lru_lock(struct ttm_bo_device *bdev)
+{
+	bool contended = !spin_trylock(&bdev->lru_lock);
+
+	if (contended)
+		spin_lock(&bdev->lru_lock);
+
+	bdev->lru_stats.contended += contended;
+	bdev->lru_stats.start = ktime_get_ns();
+}
+
+/**
+ * ttm_bo_lru_unlock
+ *
+ * @bdev: The buffer object device.
+ *
+ * Account the hold time and drop the LRU lock of @bdev.
+ */
+static inline void ttm_bo_lru_unlock(struct ttm_bo_device *bdev)
+{
+	u64 held = ktime_get_ns() - bdev->lru_stats.start;
+
+	bdev->lru_stats.count++;
+	bdev->lru_stats.hold_ns += held;
+	if (held > bdev->lru_stats.hold_max_ns)
+		bdev->lru_stats.hold_max_ns = held;
+	spin_unlock(&bdev->lru_lock);
+}
+
+struct drm_printer;
+void ttm_bo_lru_debug(struct ttm_bo_device *bdev, struct drm_printer *p);
+
 /**
  * struct ttm_lru_bulk_move_pos
  *
@@ -787,12 +923,12 @@ static inline int ttm_bo_reserve_slowpath(struct ttm_buffer_object *bo,
  */
 static inline void ttm_bo_unreserve(struct ttm_buffer_object *bo)
 {
-	spin_lock(&bo->bdev->glob->lru_lock);
+	ttm_bo_lru_lock(bo->bdev);
 	if (list_empty(&bo->lru))
 		ttm_bo_add_to_lru(bo);
 	else
 		ttm_bo_move_to_lru_tail(bo, NULL);
-	spin_unlock(&bo->bdev->glob->lru_lock);
+	ttm_bo_lru_unlock(bo->bdev);
 	reservation_object_unlock(bo->resv);
 }
 
@@ -41,12 +41,15 @@
  * @head:           list head for thread-private list.
  * @bo:             refcounted buffer object pointer.
  * @num_shared:     How many shared fences we want to add.
+ * @order:          Position in the caller's list, used internally while
+ *                  reserving in sorted order.
  */
 
 struct ttm_validate_buffer {
 	struct list_head head;
 	struct ttm_buffer_object *bo;
 	unsigned int num_shared;
+	unsigned int order;
 };
 
 /**
@@ -86,6 +89,12 @@ extern void ttm_eu_backoff_reservation(struct ww_acquire_ctx *ticket,
  * calling process receives a signal while waiting. In that case, no
  * buffers on the list will be reserved upon return.
  *
+ * If the buffer_objects "eu_sorted" sysfs knob is set, the list is sorted by
+ * reservation object address for locking, so that concurrent submissions
+ * sharing buffers rarely have to back off. The list order is restored before
+ * returning. The number of backoffs and the time spent waiting in them are
+ * accounted in the same kobject.
+ *
  * If dups is non NULL all buffers already reserved by the current thread
  * (e.g. duplicates) are added to this list, otherwise -EALREADY is returned
  * on the first already reserved buffer and all buffers from the list are
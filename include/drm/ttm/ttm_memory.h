@@ -56,6 +56,7 @@
  * @zone_kernel: Pointer to the kernel zone.
  * @zone_highmem: Pointer to the highmem zone if there is one.
  * @zone_dma32: Pointer to the dma32 zone if there is one.
+ * @pcpu: Per-CPU accounting batches, NULL if they couldn't be allocated.
  *
  * Note that this structure is not per device. It should be global for all
  * graphics devices.
@@ -63,6 +64,7 @@
 
 #define TTM_MEM_MAX_ZONES 2
 struct ttm_mem_zone;
+struct ttm_mem_pcpu;
 extern struct ttm_mem_global {
 	struct kobject kobj;
 	struct ttm_bo_global *bo_glob;
@@ -78,6 +80,7 @@ extern struct ttm_mem_global {
 #else
 	struct ttm_mem_zone *zone_dma32;
 #endif
+	struct ttm_mem_pcpu *pcpu;
 } ttm_mem_glob;
 
 extern int ttm_mem_global_init(struct ttm_mem_global *glob);
@@ -91,6 +94,11 @@ extern int ttm_mem_global_alloc_page(struct ttm_mem_global *glob,
 				     struct ttm_operation_ctx *ctx);
 extern void ttm_mem_global_free_page(struct ttm_mem_global *glob,
 				     struct page *page, uint64_t size);
+extern int ttm_mem_global_alloc_pages(struct ttm_mem_global *glob,
+				      struct page **pages, unsigned npages,
+				      struct ttm_operation_ctx *ctx);
+extern void ttm_mem_global_free_pages(struct ttm_mem_global *glob,
+				      struct page **pages, unsigned npages);
 extern size_t ttm_round_pot(size_t size);
 extern uint64_t ttm_get_kernel_zone_memory_size(struct ttm_mem_global *glob);
 extern bool ttm_check_under_lowerlimit(struct ttm_mem_global *glob,
@@ -30,6 +30,7 @@
 #include <linux/types.h>
 
 struct ttm_tt;
+struct ttm_tt_compressed;
 struct ttm_mem_reg;
 struct ttm_buffer_object;
 struct ttm_operation_ctx;
@@ -95,6 +96,8 @@ struct ttm_backend_func {
  * @bdev: Pointer to the current struct ttm_bo_device.
  * @be: Pointer to the ttm backend.
  * @swap_storage: Pointer to shmem struct file for swap storage.
+ * @swap_compressed: In-memory compressed copy of the pages while swapped
+ * out, used instead of @swap_storage when the compressed tier took the BO.
  * @caching_state: The current caching state of the pages.
  * @state: The current binding state of the pages.
  *
@@ -110,6 +113,7 @@ struct ttm_tt {
 	unsigned long num_pages;
 	struct sg_table *sg; /* for SG objects via dma-buf */
 	struct file *swap_storage;
+	struct ttm_tt_compressed *swap_compressed;
 	enum ttm_caching_state caching_state;
 	enum {
 		tt_bound,
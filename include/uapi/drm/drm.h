@@ -789,6 +789,23 @@ struct drm_syncobj_timeline_array {
 	__u32 pad;
 };
 
+/*
+ * FreeBSD extension, see DRM_IOCTL_SYNCOBJ_WAIT_FD.
+ *
+ * Returns a file descriptor that polls readable once the wait described by
+ * handles, points and flags (DRM_SYNCOBJ_WAIT_FLAGS_*) is satisfied. A
+ * read() on it then returns the __u32 index of the first signaled handle.
+ * points may be 0 to wait on binary syncobjs.
+ */
+struct drm_syncobj_wait_fd {
+	__u64 handles;
+	__u64 points;
+	__u32 count_handles;
+	__u32 flags;
+	__s32 fd;
+	__u32 pad;
+};
+
 
 /* Query current scanout sequence number */
 struct drm_crtc_get_sequence {
@@ -951,6 +968,12 @@ extern "C" {
 #define DRM_IOCTL_SYNCOBJ_TRANSFER	DRM_IOWR(0xCC, struct drm_syncobj_transfer)
 #define DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL	DRM_IOWR(0xCD, struct drm_syncobj_timeline_array)
 
+/*
+ * FreeBSD extensions. Upstream allocates generic ioctls upwards from 0xA0,
+ * 0xF0 to 0xFF are kept for ioctls that only exist in this port.
+ */
+#define DRM_IOCTL_SYNCOBJ_WAIT_FD	DRM_IOWR(0xF0, struct drm_syncobj_wait_fd)
+
 /**
  * Device specific ioctls should only be in their respective headers
  * The device specific ioctl range is from 0x40 to 0x9f.
@@ -25,6 +25,12 @@
 #ifndef _LINUX_GPLV2_DMA_BUF_H_
 #define _LINUX_GPLV2_DMA_BUF_H_
 
+#include <sys/param.h>
+#include <sys/_lock.h>
+#include <sys/_mutex.h>
+#include <sys/_task.h>
+#include <sys/selinfo.h>
+
 #include <linux/file.h>
 #include <linux/err.h>
 #include <linux/scatterlist.h>
@@ -61,6 +67,16 @@ struct dma_buf_export_info {
 					 .owner = THIS_MODULE }
 
 struct dma_buf_ops {
+	/*
+	 * If true, dma_buf_map_attachment() keeps the mapping of each
+	 * attachment cached per direction until detach or
+	 * dma_buf_move_notify(), and dma_buf_unmap_attachment() only drops
+	 * a reference.  Only for exporters whose buffers stay in place
+	 * while attached, or that call dma_buf_move_notify() on moves.
+	 * map_dma_buf/unmap_dma_buf are then called with dmabuf->lock held.
+	 */
+	bool cache_sgt_mapping;
+
 	int (*attach)(struct dma_buf *, struct dma_buf_attachment *);
 
 	void (*detach)(struct dma_buf *, struct dma_buf_attachment *);
@@ -114,10 +130,14 @@ struct dma_buf {
 
 	/* poll support */
 	wait_queue_head_t poll;
+	struct mtx poll_mtx;		/* protects cb_excl, cb_shared, knotes */
+	struct selinfo poll_sel;
+	struct task poll_task;
 
 	struct dma_buf_poll_cb_t {
 		struct dma_fence_cb cb;
 		wait_queue_head_t *poll;
+		struct dma_fence *fence;	/* armed fence, referenced */
 
 		unsigned long active;
 	} cb_excl, cb_shared;
@@ -128,6 +148,13 @@ struct dma_buf_attachment {
 	struct device *dev;
 	struct list_head node;
 	void *priv;
+
+	/* cached mappings indexed by direction, protected by dmabuf->lock */
+	struct dma_buf_sgt_cache {
+		struct sg_table *sgt;
+		unsigned int users;
+		bool stale;		/* unmap when users drops to 0 */
+	} sgt_cache[DMA_NONE];
 };
 #define file linux_file
 static inline void
@@ -156,6 +183,7 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *,
 					enum dma_data_direction);
 void dma_buf_unmap_attachment(struct dma_buf_attachment *, struct sg_table *,
 				enum dma_data_direction);
+void dma_buf_move_notify(struct dma_buf *);
 void *dma_buf_vmap(struct dma_buf *);
 void dma_buf_vunmap(struct dma_buf *, void *vaddr);
 
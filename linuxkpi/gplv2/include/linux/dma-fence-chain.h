@@ -19,6 +19,8 @@
  * @lock: spinlock for fence handling
  * @prev: previous fence of the chain
  * @prev_seqno: original previous seqno before garbage collection
+ * @skip: older node of the chain to speed up dma_fence_chain_find_seqno()
+ * @depth: position of the node in the chain, used to place @skip
  * @fence: encapsulated fence
  * @cb: callback structure for signaling
  * @work: irq work item for signaling
@@ -28,6 +30,8 @@ struct dma_fence_chain {
 	spinlock_t lock;
 	struct dma_fence __rcu *prev;
 	u64 prev_seqno;
+	struct dma_fence __rcu *skip;
+	u64 depth;
 	struct dma_fence *fence;
 	struct dma_fence_cb cb;
 	struct irq_work work;
@@ -72,6 +72,7 @@ struct dma_fence {
 	u64 seqno;
 	unsigned long flags;
 	ktime_t timestamp;
+	ktime_t init_time;	/* set by dma_fence_init() while tracing */
 	int error;
 };
 
@@ -47,6 +47,8 @@
 #include <linux/atomic.h>
 #include <linux/radix-tree.h>
 
+struct reservation_object_index;
+
 extern struct ww_class reservation_ww_class;
 extern struct lock_class_key reservation_seqcount_class;
 extern const char reservation_seqcount_string[];
@@ -71,6 +73,7 @@ struct reservation_object_list {
  * @fence_excl: the exclusive fence, if there is one currently
  * @fence: list of current shared fences
  * @staged: staged copy of shared fences for RCU updates
+ * @index: update side index of the shared fences by context
  */
 struct reservation_object {
 	struct ww_mutex lock;
@@ -79,6 +82,7 @@ struct reservation_object {
 	struct dma_fence __rcu *fence_excl;
 	struct reservation_object_list __rcu *fence;
 	struct reservation_object_list *staged;
+	struct reservation_object_index *index;
 };
 
 #define reservation_object_held(obj) lockdep_is_held(&(obj)->lock.base)
@@ -98,6 +102,7 @@ reservation_object_init(struct reservation_object *obj)
 	RCU_INIT_POINTER(obj->fence, NULL);
 	RCU_INIT_POINTER(obj->fence_excl, NULL);
 	obj->staged = NULL;
+	obj->index = NULL;
 }
 
 /**
@@ -127,6 +132,7 @@ reservation_object_fini(struct reservation_object *obj)
 		kfree(fobj);
 	}
 	kfree(obj->staged);
+	kfree(obj->index);
 
 	ww_mutex_destroy(&obj->lock);
 }
@@ -32,18 +32,69 @@ static struct dma_fence *dma_fence_chain_get_prev(struct dma_fence_chain *chain)
 	return prev;
 }
 
+/**
+ * dma_fence_chain_get_skip - use RCU to get a reference to the skip node
+ * @chain: chain node to get the skip node from
+ */
+static struct dma_fence *dma_fence_chain_get_skip(struct dma_fence_chain *chain)
+{
+	struct dma_fence *skip;
+
+	rcu_read_lock();
+	skip = dma_fence_get_rcu_safe(&chain->skip);
+	rcu_read_unlock();
+	return skip;
+}
+
+/**
+ * dma_fence_chain_skip - get the skip node if it is still worth following
+ * @chain: chain node to get the skip node from
+ *
+ * Returns a reference to the skip node, or NULL. Skip nodes whose fence is
+ * already signaled are dropped, they would be garbage collected by
+ * dma_fence_chain_walk() anyway and holding on to them would keep the
+ * signaled part of the chain alive.
+ */
+static struct dma_fence *dma_fence_chain_skip(struct dma_fence_chain *chain)
+{
+	struct dma_fence *skip, *tmp;
+
+	skip = dma_fence_chain_get_skip(chain);
+	if (!skip)
+		return NULL;
+
+	if (!dma_fence_is_signaled(to_dma_fence_chain(skip)->fence))
+		return skip;
+
+	tmp = cmpxchg((void **)&chain->skip, (void *)skip, NULL);
+	if (tmp == skip)
+		dma_fence_put(tmp);
+	dma_fence_put(skip);
+	return NULL;
+}
+
+/**
+ * dma_fence_chain_prune_skip - drop the skip node if it is signaled
+ * @chain: chain node to prune
+ */
+static void dma_fence_chain_prune_skip(struct dma_fence_chain *chain)
+{
+	dma_fence_put(dma_fence_chain_skip(chain));
+}
+
 /**
  * dma_fence_chain_walk - chain walking function
  * @fence: current chain node
  *
  * Walk the chain to the next node. Returns the next fence or NULL if we are at
  * the end of the chain. Garbage collects chain nodes which are already
- * signaled.
+ * signaled, including a skip pointer of the current node to one of them.
  */
 struct dma_fence *dma_fence_chain_walk(struct dma_fence *fence)
 {
 	struct dma_fence_chain *chain, *prev_chain;
 	struct dma_fence *prev, *replacement, *tmp;
+	bool collapsed = false;
 
 	chain = to_dma_fence_chain(fence);
 	if (!chain) {
@@ -67,13 +118,19 @@ struct dma_fence *dma_fence_chain_walk(struct dma_fence *fence)
 		}
 
 		tmp = cmpxchg((void **)&chain->prev, (void *)prev, (void *)replacement);
-		if (tmp == prev)
+		if (tmp == prev) {
 			dma_fence_put(tmp);
-		else
+			collapsed = true;
+		} else {
 			dma_fence_put(replacement);
+		}
 		dma_fence_put(prev);
 	}
 
+	/* The skip node may be one of the nodes just unlinked */
+	if (collapsed)
+		dma_fence_chain_prune_skip(chain);
+
 	dma_fence_put(fence);
 	return prev;
 }
@@ -101,9 +158,32 @@ int dma_fence_chain_find_seqno(struct dma_fence **pfence, uint64_t seqno)
 	if (!chain || chain->base.seqno < seqno)
 		return -EINVAL;
 
+	/*
+	 * Nodes between the current one and its skip node all have a
+	 * prev_seqno of at least the seqno of the skip node. So as long as
+	 * the skip node is still at or after the point we are looking for we
+	 * can jump there directly, otherwise take a single step back.
+	 */
 	dma_fence_chain_for_each(*pfence, &chain->base) {
+		struct dma_fence_chain *node = to_dma_fence_chain(*pfence);
+		struct dma_fence *skip;
+
 		if ((*pfence)->context != chain->base.context ||
-		    to_dma_fence_chain(*pfence)->prev_seqno < seqno)
+		    node->prev_seqno < seqno)
+			break;
+
+		while ((skip = dma_fence_chain_skip(node))) {
+			if (skip->seqno < seqno) {
+				dma_fence_put(skip);
+				break;
+			}
+			dma_fence_put(*pfence);
+			*pfence = skip;
+			node = to_dma_fence_chain(skip);
+			if (node->prev_seqno < seqno)
+				break;
+		}
+		if (node->prev_seqno < seqno)
 			break;
 	}
 	dma_fence_put(&chain->base);
@@ -184,6 +264,7 @@ static void dma_fence_chain_release(struct dma_fence *fence)
 	struct dma_fence_chain *chain = to_dma_fence_chain(fence);
 
 	dma_fence_put(rcu_dereference_protected(chain->prev, true));
+	dma_fence_put(rcu_dereference_protected(chain->skip, true));
 	dma_fence_put(chain->fence);
 	dma_fence_free(fence);
 }
@@ -198,6 +279,49 @@ const struct dma_fence_ops dma_fence_chain_ops = {
 };
 EXPORT_SYMBOL(dma_fence_chain_ops);
 
+/**
+ * dma_fence_chain_init_skip - place the skip pointer of a new node
+ * @chain: the new chain node
+ * @prev_chain: the previous node, in the same context
+ *
+ * Skip pointers follow the skew binary scheme of random access stacks: when
+ * the previous node and its skip node cover spans of equal length, the new
+ * node skips over both of them, otherwise it points to the previous node.
+ * That makes the skip distances powers of two minus one and finding any
+ * node takes a logarithmic number of steps. A skip node which is already
+ * signaled isn't installed, it would only keep the signaled part of the
+ * chain alive.
+ */
+static void dma_fence_chain_init_skip(struct dma_fence_chain *chain,
+				      struct dma_fence_chain *prev_chain)
+{
+	struct dma_fence *skip1, *skip2 = NULL, *skip;
+	struct dma_fence_chain *chain1;
+
+	chain->depth = prev_chain->depth + 1;
+
+	skip1 = dma_fence_chain_get_skip(prev_chain);
+	chain1 = to_dma_fence_chain(skip1);
+	if (chain1)
+		skip2 = dma_fence_chain_get_skip(chain1);
+
+	if (skip2 && prev_chain->depth - chain1->depth ==
+	    chain1->depth - to_dma_fence_chain(skip2)->depth) {
+		skip = skip2;
+	} else {
+		dma_fence_put(skip2);
+		skip = dma_fence_get(&prev_chain->base);
+	}
+	dma_fence_put(skip1);
+
+	if (dma_fence_is_signaled(to_dma_fence_chain(skip)->fence)) {
+		dma_fence_put(skip);
+		skip = NULL;
+	}
+
+	RCU_INIT_POINTER(chain->skip, skip);
+}
+
 /**
  * dma_fence_chain_init - initialize a fence chain
  * @chain: the chain node to initialize
@@ -219,12 +343,15 @@ void dma_fence_chain_init(struct dma_fence_chain *chain,
 	rcu_assign_pointer(chain->prev, prev);
 	chain->fence = fence;
 	chain->prev_seqno = 0;
+	RCU_INIT_POINTER(chain->skip, NULL);
+	chain->depth = 0;
 	init_irq_work(&chain->work, dma_fence_chain_irq_work);
 
 	/* Try to reuse the context of the previous chain node. */
 	if (prev_chain && __dma_fence_is_later(seqno, prev->seqno, prev->ops)) {
 		context = prev->context;
 		chain->prev_seqno = prev->seqno;
+		dma_fence_chain_init_skip(chain, prev_chain);
 	} else {
 		context = dma_fence_context_alloc(1);
 		/* Make sure that we always have a valid sequence number. */
@@ -43,6 +43,11 @@ __FBSDID("$FreeBSD$");
 #include <sys/filio.h>
 #include <sys/unistd.h>
 #include <sys/capsicum.h>
+#include <sys/counter.h>
+#include <sys/event.h>
+#include <sys/poll.h>
+#include <sys/selinfo.h>
+#include <sys/taskqueue.h>
 
 #include <vm/vm.h>
 #include <vm/pmap.h>
@@ -66,6 +71,20 @@ struct db_list {
 static struct db_list db_list;
 MALLOC_DEFINE(M_DMABUF, "dmabuf", "dmabuf allocator");
 
+SYSCTL_DECL(_compat_linuxkpi);
+static SYSCTL_NODE(_compat_linuxkpi, OID_AUTO, dma_buf, CTLFLAG_RD, 0,
+    "dma-buf");
+
+static counter_u64_t dma_buf_sgt_hits;
+SYSCTL_COUNTER_U64(_compat_linuxkpi_dma_buf, OID_AUTO, sgt_cache_hits,
+    CTLFLAG_RD, &dma_buf_sgt_hits, "Attachment maps served from the cache");
+static counter_u64_t dma_buf_sgt_misses;
+SYSCTL_COUNTER_U64(_compat_linuxkpi_dma_buf, OID_AUTO, sgt_cache_misses,
+    CTLFLAG_RD, &dma_buf_sgt_misses, "Attachment maps that called the exporter");
+static counter_u64_t dma_buf_poll_wakeups;
+SYSCTL_COUNTER_U64(_compat_linuxkpi_dma_buf, OID_AUTO, poll_wakeups,
+    CTLFLAG_RD, &dma_buf_poll_wakeups, "Poll wakeups after a fence signaled");
+
 static fo_close_t dma_buf_close;
 static fo_stat_t dma_buf_stat;
 static fo_fill_kinfo_t dma_buf_fill_kinfo;
@@ -73,6 +92,7 @@ static fo_mmap_t dma_buf_mmap_fileops;
 static fo_poll_t dma_buf_poll;
 static fo_seek_t dma_buf_seek;
 static fo_ioctl_t dma_buf_ioctl;
+static fo_kqfilter_t dma_buf_kqfilter;
 
 struct fileops dma_buf_fileops  = {
 	.fo_close = dma_buf_close,
@@ -82,6 +102,7 @@ struct fileops dma_buf_fileops  = {
 	.fo_poll = dma_buf_poll,
 	.fo_seek = dma_buf_seek,
 	.fo_ioctl = dma_buf_ioctl,
+	.fo_kqfilter = dma_buf_kqfilter,
 	.fo_flags = DFLAG_PASSABLE|DFLAG_SEEKABLE,
 };
 
@@ -90,6 +111,8 @@ struct fileops dma_buf_fileops  = {
 
 #define fp_is_db(fp) ((fp)->f_ops == &dma_buf_fileops)
 
+static void dma_buf_poll_reap(struct dma_buf_poll_cb_t *dcb, bool all);
+
 static int
 dma_buf_close(struct file *fp, struct thread *td)
 {
@@ -100,8 +123,19 @@ dma_buf_close(struct file *fp, struct thread *td)
 
 	db = fp->f_data;
 
-	MPASS(db->cb_shared.active == 0);
-	MPASS(db->cb_excl.active == 0);
+	/*
+	 * Nobody can poll a closing file, but fence callbacks armed by
+	 * earlier pollers may still be pending.  Pull them off their
+	 * fences and wait for any wakeup they already queued.
+	 */
+	mtx_lock(&db->poll_mtx);
+	dma_buf_poll_reap(&db->cb_excl, true);
+	dma_buf_poll_reap(&db->cb_shared, true);
+	mtx_unlock(&db->poll_mtx);
+	taskqueue_drain(taskqueue_thread, &db->poll_task);
+	seldrain(&db->poll_sel);
+	knlist_destroy(&db->poll_sel.si_note);
+	mtx_destroy(&db->poll_mtx);
 
 	/* release DMA buffer */
 	db->ops->release(db);
@@ -184,11 +218,241 @@ dma_buf_seek(struct file *fp, off_t offset, int whence, struct thread *td)
 	return (0);
 }
 
+/*
+ * Implicit sync readiness follows Linux: a buffer is readable (POLLIN)
+ * once its exclusive fence has signaled, and writable (POLLOUT) once
+ * the exclusive fence and all shared fences have signaled.
+ *
+ * Each direction arms at most one fence callback at a time, on the
+ * first unsignaled fence found.  The callback runs with the fence lock
+ * held, possibly from interrupt context, so it only queues poll_task;
+ * the task reaps the callback and wakes select/poll and kqueue waiters,
+ * which re-evaluate readiness and arm the next pending fence if any.
+ * Lock order is poll_mtx -> fence lock.
+ */
+
+/*
+ * Return a reference to the first unsignaled fence a waiter for
+ * @write readiness has to wait on, or NULL if the buffer is ready.
+ */
+static struct dma_fence *
+dma_buf_poll_fence(struct reservation_object *resv, bool write)
+{
+	struct reservation_object_list *fobj;
+	struct dma_fence *fence, *f;
+	unsigned int seq, count, i;
+
+retry:
+	seq = read_seqcount_begin(&resv->seq);
+	rcu_read_lock();
+
+	fence = NULL;
+	f = rcu_dereference(resv->fence_excl);
+	if (f != NULL && !test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &f->flags))
+		fence = f;
+
+	fobj = rcu_dereference(resv->fence);
+	count = (write && fobj != NULL) ? fobj->shared_count : 0;
+	for (i = 0; fence == NULL && i < count; i++) {
+		f = rcu_dereference(fobj->shared[i]);
+		if (!test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &f->flags))
+			fence = f;
+	}
+
+	if (fence != NULL && (fence = dma_fence_get_rcu(fence)) == NULL) {
+		rcu_read_unlock();
+		goto retry;
+	}
+	rcu_read_unlock();
+
+	if (read_seqcount_retry(&resv->seq, seq)) {
+		dma_fence_put(fence);
+		goto retry;
+	}
+
+	/* Give fences without interrupt driven signaling a chance. */
+	if (fence != NULL && dma_fence_is_signaled(fence)) {
+		dma_fence_put(fence);
+		goto retry;
+	}
+	return (fence);
+}
+
+static void
+dma_buf_poll_cb(struct dma_fence *fence, struct dma_fence_cb *cb)
+{
+	struct dma_buf_poll_cb_t *dcb;
+	struct dma_buf *db;
+
+	dcb = container_of(cb, struct dma_buf_poll_cb_t, cb);
+	db = container_of(dcb->poll, struct dma_buf, poll);
+	taskqueue_enqueue(taskqueue_thread, &db->poll_task);
+}
+
+/*
+ * Disarm @dcb if its fence has signaled, or unconditionally if @all.
+ * Removing the callback under the fence lock also waits out a callback
+ * that is running concurrently, so @dcb may be rearmed afterwards.
+ */
+static void
+dma_buf_poll_reap(struct dma_buf_poll_cb_t *dcb, bool all)
+{
+	struct dma_buf *db;
+
+	db = container_of(dcb->poll, struct dma_buf, poll);
+	mtx_assert(&db->poll_mtx, MA_OWNED);
+
+	if (dcb->active == 0)
+		return;
+	if (!all &&
+	    !test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &dcb->fence->flags))
+		return;
+
+	dma_fence_remove_callback(dcb->fence, &dcb->cb);
+	dma_fence_put(dcb->fence);
+	dcb->fence = NULL;
+	dcb->active = 0;
+}
+
+/*
+ * Return true if @db is ready for @event (POLLIN or POLLOUT), otherwise
+ * make sure a fence callback is armed to report when it may become so.
+ */
+static bool
+dma_buf_poll_arm(struct dma_buf *db, struct dma_buf_poll_cb_t *dcb,
+		 unsigned long event)
+{
+	struct dma_fence *fence;
+
+	mtx_assert(&db->poll_mtx, MA_OWNED);
+
+	for (;;) {
+		fence = dma_buf_poll_fence(db->resv, event == POLLOUT);
+		if (fence == NULL)
+			return (true);
+
+		if (dcb->active != 0) {
+			/* Already armed, poll_task re-evaluates. */
+			dma_fence_put(fence);
+			return (false);
+		}
+
+		if (dma_fence_add_callback(fence, &dcb->cb,
+		    dma_buf_poll_cb) == 0) {
+			dcb->fence = fence;
+			dcb->active = event;
+			return (false);
+		}
+
+		/* Signaled since we looked, try the next one. */
+		dma_fence_put(fence);
+	}
+}
+
+static void
+dma_buf_poll_task(void *arg, int pending __unused)
+{
+	struct dma_buf *db;
+
+	db = arg;
+	mtx_lock(&db->poll_mtx);
+	dma_buf_poll_reap(&db->cb_excl, false);
+	dma_buf_poll_reap(&db->cb_shared, false);
+	selwakeup(&db->poll_sel);
+	KNOTE_LOCKED(&db->poll_sel.si_note, 0);
+	mtx_unlock(&db->poll_mtx);
+	counter_u64_add(dma_buf_poll_wakeups, 1);
+}
+
 static int
 dma_buf_poll(struct file *fp, int events,
 	     struct ucred *active_cred, struct thread *td)
 {
-	panic("XXX implement me!!!");
+	struct dma_buf *db;
+	int revents;
+
+	if (!fp_is_db(fp))
+		return (0);
+
+	db = fp->f_data;
+	revents = 0;
+
+	mtx_lock(&db->poll_mtx);
+	if ((events & (POLLIN | POLLRDNORM)) != 0 &&
+	    dma_buf_poll_arm(db, &db->cb_excl, POLLIN))
+		revents |= events & (POLLIN | POLLRDNORM);
+	if ((events & (POLLOUT | POLLWRNORM)) != 0 &&
+	    dma_buf_poll_arm(db, &db->cb_shared, POLLOUT))
+		revents |= events & (POLLOUT | POLLWRNORM);
+	if (revents == 0 &&
+	    (events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM)) != 0)
+		selrecord(td, &db->poll_sel);
+	mtx_unlock(&db->poll_mtx);
+
+	return (revents);
+}
+
+static void
+filt_dma_buf_detach(struct knote *kn)
+{
+	struct dma_buf *db;
+
+	db = kn->kn_hook;
+	knlist_remove(&db->poll_sel.si_note, kn, 0);
+}
+
+static int
+filt_dma_buf_read(struct knote *kn, long hint __unused)
+{
+	struct dma_buf *db;
+
+	db = kn->kn_hook;
+	return (dma_buf_poll_arm(db, &db->cb_excl, POLLIN));
+}
+
+static int
+filt_dma_buf_write(struct knote *kn, long hint __unused)
+{
+	struct dma_buf *db;
+
+	db = kn->kn_hook;
+	return (dma_buf_poll_arm(db, &db->cb_shared, POLLOUT));
+}
+
+static struct filterops dma_buf_rfiltops = {
+	.f_isfd = 1,
+	.f_detach = filt_dma_buf_detach,
+	.f_event = filt_dma_buf_read,
+};
+
+static struct filterops dma_buf_wfiltops = {
+	.f_isfd = 1,
+	.f_detach = filt_dma_buf_detach,
+	.f_event = filt_dma_buf_write,
+};
+
+static int
+dma_buf_kqfilter(struct file *fp, struct knote *kn)
+{
+	struct dma_buf *db;
+
+	if (!fp_is_db(fp))
+		return (EINVAL);
+
+	db = fp->f_data;
+	switch (kn->kn_filter) {
+	case EVFILT_READ:
+		kn->kn_fop = &dma_buf_rfiltops;
+		break;
+	case EVFILT_WRITE:
+		kn->kn_fop = &dma_buf_wfiltops;
+		break;
+	default:
+		return (EINVAL);
+	}
+
+	kn->kn_hook = db;
+	knlist_add(&db->poll_sel.si_note, kn, 0);
 	return (0);
 }
 
@@ -259,6 +523,60 @@ dma_buf_ioctl(struct file *fp, u_long com, void *data,
 }
 
 
+static void
+dma_buf_sgt_drop(struct dma_buf_attachment *dba, enum dma_data_direction dir)
+{
+	struct dma_buf_sgt_cache *c;
+
+	c = &dba->sgt_cache[dir];
+	dba->dmabuf->ops->unmap_dma_buf(dba, c->sgt, dir);
+	c->sgt = NULL;
+	c->users = 0;
+	c->stale = false;
+}
+
+/*
+ * Unmap the cached mappings of @dba that nobody uses and mark the
+ * others stale, so that they are unmapped by their last user.  With
+ * @detach nobody may be using them anymore.
+ */
+static void
+dma_buf_sgt_flush(struct dma_buf_attachment *dba, bool detach)
+{
+	struct dma_buf_sgt_cache *c;
+	int dir;
+
+	sx_assert(&dba->dmabuf->lock.sx, SA_XLOCKED);
+
+	for (dir = 0; dir < DMA_NONE; dir++) {
+		c = &dba->sgt_cache[dir];
+		if (c->sgt == NULL)
+			continue;
+		WARN_ON(detach && c->users != 0);
+		if (c->users == 0 || detach)
+			dma_buf_sgt_drop(dba, dir);
+		else
+			c->stale = true;
+	}
+}
+
+/*
+ * A mapping for DMA_BIDIRECTIONAL serves either direction.
+ */
+static struct dma_buf_sgt_cache *
+dma_buf_sgt_lookup(struct dma_buf_attachment *dba, enum dma_data_direction dir)
+{
+	struct dma_buf_sgt_cache *c;
+
+	c = &dba->sgt_cache[dir];
+	if (c->sgt != NULL && !c->stale)
+		return (c);
+	c = &dba->sgt_cache[DMA_BIDIRECTIONAL];
+	if (c->sgt != NULL && !c->stale)
+		return (c);
+	return (NULL);
+}
+
 struct dma_buf_attachment *
 dma_buf_attach(struct dma_buf *db, struct device *dev)
 {
@@ -298,6 +616,8 @@ dma_buf_detach(struct dma_buf *db, struct dma_buf_attachment *dba)
 
 	sx_xlock(&db->lock.sx);
 	list_del(&dba->node);
+	if (db->ops->cache_sgt_mapping)
+		dma_buf_sgt_flush(dba, true);
 	if (db->ops->detach)
 		db->ops->detach(db, dba);
 	sx_xunlock(&db->lock.sx);
@@ -386,6 +706,9 @@ dma_buf_export(const struct dma_buf_export_info *exp_info)
 
 	db->linux_file = fp;
 	mutex_init(&db->lock);
+	mtx_init(&db->poll_mtx, "dmabufpoll", NULL, MTX_DEF);
+	knlist_init_mtx(&db->poll_sel.si_note, &db->poll_mtx);
+	TASK_INIT(&db->poll_task, 0, dma_buf_poll_task, db);
 	INIT_LIST_HEAD(&db->attachments);
 
 	sx_xlock(&db_list.lock);
@@ -400,6 +723,8 @@ err:
 struct sg_table *
 dma_buf_map_attachment(struct dma_buf_attachment *dba, enum dma_data_direction dir)
 {
+	struct dma_buf_sgt_cache *c;
+	struct dma_buf *db;
 	struct sg_table *sgt;
 
 	MPASS(dba != NULL);
@@ -408,10 +733,45 @@ dma_buf_map_attachment(struct dma_buf_attachment *dba, enum dma_data_direction d
 	if (dba == NULL || dba->dmabuf == NULL)
 		return (ERR_PTR(-EINVAL));
 
-	sgt = dba->dmabuf->ops->map_dma_buf(dba, dir);
-	if (sgt == NULL)
-		return (ERR_PTR(-ENOMEM));
+	db = dba->dmabuf;
+	if (!db->ops->cache_sgt_mapping) {
+		sgt = db->ops->map_dma_buf(dba, dir);
+		if (sgt == NULL)
+			return (ERR_PTR(-ENOMEM));
+		return (sgt);
+	}
 
+	if ((unsigned)dir >= DMA_NONE)
+		return (ERR_PTR(-EINVAL));
+
+	mutex_lock(&db->lock);
+	if ((c = dma_buf_sgt_lookup(dba, dir)) != NULL) {
+		counter_u64_add(dma_buf_sgt_hits, 1);
+		c->users++;
+		sgt = c->sgt;
+		goto out;
+	}
+
+	counter_u64_add(dma_buf_sgt_misses, 1);
+	sgt = db->ops->map_dma_buf(dba, dir);
+	if (sgt == NULL) {
+		sgt = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+	if (IS_ERR(sgt))
+		goto out;
+
+	/*
+	 * The slot may still hold a stale mapping in use, in which case
+	 * this one is handed out uncached.
+	 */
+	c = &dba->sgt_cache[dir];
+	if (c->sgt == NULL) {
+		c->sgt = sgt;
+		c->users = 1;
+	}
+out:
+	mutex_unlock(&db->lock);
 	return (sgt);
 }
 
@@ -420,7 +780,52 @@ dma_buf_unmap_attachment(struct dma_buf_attachment *dba,
 			 struct sg_table *sg_table,
 			 enum dma_data_direction dir)
 {
-	dba->dmabuf->ops->unmap_dma_buf(dba, sg_table, dir);
+	struct dma_buf_sgt_cache *c;
+	struct dma_buf *db;
+	int i;
+
+	db = dba->dmabuf;
+	if (!db->ops->cache_sgt_mapping) {
+		db->ops->unmap_dma_buf(dba, sg_table, dir);
+		return;
+	}
+
+	mutex_lock(&db->lock);
+	for (i = 0; i < DMA_NONE; i++) {
+		c = &dba->sgt_cache[i];
+		if (c->sgt != sg_table)
+			continue;
+		MPASS(c->users > 0);
+		if (--c->users == 0 && c->stale)
+			dma_buf_sgt_drop(dba, i);
+		mutex_unlock(&db->lock);
+		return;
+	}
+	db->ops->unmap_dma_buf(dba, sg_table, dir);
+	mutex_unlock(&db->lock);
+}
+
+/**
+ * dma_buf_move_notify - invalidate cached attachment mappings
+ * @db: buffer whose backing storage is about to move
+ *
+ * Called by exporters using cache_sgt_mapping before the pages backing
+ * @db move.  Mappings not currently in use are unmapped right away, the
+ * others are unmapped when their last user unmaps them, and subsequent
+ * dma_buf_map_attachment() calls ask the exporter for a new mapping.
+ */
+void
+dma_buf_move_notify(struct dma_buf *db)
+{
+	struct dma_buf_attachment *dba;
+
+	if (!db->ops->cache_sgt_mapping)
+		return;
+
+	mutex_lock(&db->lock);
+	list_for_each_entry(dba, &db->attachments, node)
+		dma_buf_sgt_flush(dba, false);
+	mutex_unlock(&db->lock);
 }
 
 void *
@@ -476,16 +881,179 @@ void dma_buf_vunmap(struct dma_buf *dmabuf, void *vaddr)
 	mutex_unlock(&dmabuf->lock);
 }
 
+/*
+ * Poll self test, run by writing 1 to compat.linuxkpi.dma_buf.poll_selftest.
+ * It exports a buffer whose reservation object only holds a software fence
+ * and drives the poll machinery directly; there is no poll(2) caller to
+ * selrecord() on, so the poll task running is taken as the wakeup.
+ */
+static DEFINE_SPINLOCK(dma_buf_selftest_lock);
+
+static const char *
+dma_buf_selftest_get_name(struct dma_fence *fence)
+{
+
+	return ("dma_buf_selftest");
+}
+
+static const struct dma_fence_ops dma_buf_selftest_fence_ops = {
+	.get_driver_name = dma_buf_selftest_get_name,
+	.get_timeline_name = dma_buf_selftest_get_name,
+};
+
+static void
+dma_buf_selftest_release(struct dma_buf *db __unused)
+{
+}
+
+static const struct dma_buf_ops dma_buf_selftest_ops = {
+	.release = dma_buf_selftest_release,
+};
+
+static struct dma_fence *
+dma_buf_selftest_fence(struct dma_buf *db, u64 context, u64 seqno)
+{
+	struct dma_fence *fence;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (fence == NULL)
+		return (NULL);
+	dma_fence_init(fence, &dma_buf_selftest_fence_ops,
+	    &dma_buf_selftest_lock, context, seqno);
+
+	reservation_object_lock(db->resv, NULL);
+	reservation_object_add_excl_fence(db->resv, fence);
+	reservation_object_unlock(db->resv);
+	return (fence);
+}
+
+/* Arm both directions, returns true if either reported ready. */
+static bool
+dma_buf_selftest_arm(struct dma_buf *db)
+{
+	bool ready;
+
+	mtx_lock(&db->poll_mtx);
+	ready = dma_buf_poll_arm(db, &db->cb_excl, POLLIN);
+	ready |= dma_buf_poll_arm(db, &db->cb_shared, POLLOUT);
+	mtx_unlock(&db->poll_mtx);
+	return (ready);
+}
+
+static int
+dma_buf_poll_selftest(void)
+{
+	struct dma_buf_export_info exp_info = {
+		.exp_name = "dma_buf_selftest",
+		.ops = &dma_buf_selftest_ops,
+		.size = PAGE_SIZE,
+		.flags = O_RDWR,
+	};
+	struct dma_fence *fence, *pending;
+	struct dma_buf *db;
+	uint64_t wakeups;
+	u64 context;
+	int error;
+
+	db = dma_buf_export(&exp_info);
+	if (IS_ERR(db))
+		return (-PTR_ERR(db));
+
+	error = 0;
+	pending = NULL;
+	context = dma_fence_context_alloc(1);
+	fence = dma_buf_selftest_fence(db, context, 1);
+	if (fence == NULL) {
+		error = ENOMEM;
+		goto out;
+	}
+
+	/* Unsignaled: neither readable nor writable, both callbacks armed. */
+	if (dma_buf_selftest_arm(db) || db->cb_excl.fence != fence ||
+	    db->cb_shared.fence != fence) {
+		printf("dma_buf_poll_selftest: ready before signaling\n");
+		error = EIO;
+		goto out;
+	}
+
+	/* Signaling queues the poll task, which disarms and wakes. */
+	wakeups = counter_u64_fetch(dma_buf_poll_wakeups);
+	dma_fence_signal(fence);
+	taskqueue_drain(taskqueue_thread, &db->poll_task);
+	if (counter_u64_fetch(dma_buf_poll_wakeups) == wakeups ||
+	    db->cb_excl.active != 0 || db->cb_shared.active != 0) {
+		printf("dma_buf_poll_selftest: no wakeup after signaling\n");
+		error = EIO;
+		goto out;
+	}
+	if (!dma_buf_selftest_arm(db)) {
+		printf("dma_buf_poll_selftest: not ready after signaling\n");
+		error = EIO;
+		goto out;
+	}
+
+	/* Close with callbacks armed, close has to take them off again. */
+	pending = dma_buf_selftest_fence(db, context, 2);
+	if (pending == NULL) {
+		error = ENOMEM;
+		goto out;
+	}
+	if (dma_buf_selftest_arm(db)) {
+		printf("dma_buf_poll_selftest: ready before signaling\n");
+		error = EIO;
+	}
+
+out:
+	dma_buf_put(db);
+	if (pending != NULL) {
+		if (!list_empty(&pending->cb_list)) {
+			printf("dma_buf_poll_selftest: callbacks left after "
+			    "close\n");
+			error = EIO;
+		}
+		dma_fence_signal(pending);
+		dma_fence_put(pending);
+	}
+	if (fence != NULL) {
+		dma_fence_signal(fence);
+		dma_fence_put(fence);
+	}
+	return (error);
+}
+
+static int
+dma_buf_poll_selftest_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	int error, val;
+
+	val = 0;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+	if (val != 1)
+		return (EINVAL);
+	return (dma_buf_poll_selftest());
+}
+SYSCTL_PROC(_compat_linuxkpi_dma_buf, OID_AUTO, poll_selftest,
+    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, NULL, 0,
+    dma_buf_poll_selftest_sysctl, "I", "Write 1 to run the poll self test");
+
 static void
 dma_buf_init(void *arg __unused)
 {
 	sx_init(&db_list.lock, "db_list_lock");
 	INIT_LIST_HEAD(&db_list.head);
+	dma_buf_sgt_hits = counter_u64_alloc(M_WAITOK);
+	dma_buf_sgt_misses = counter_u64_alloc(M_WAITOK);
+	dma_buf_poll_wakeups = counter_u64_alloc(M_WAITOK);
 }
 
 static void
 dma_buf_uninit(void *arg __unused)
 {
+	counter_u64_free(dma_buf_sgt_hits);
+	counter_u64_free(dma_buf_sgt_misses);
+	counter_u64_free(dma_buf_poll_wakeups);
 	sx_destroy(&db_list.lock);
 }
 
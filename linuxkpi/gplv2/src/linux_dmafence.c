@@ -25,13 +25,254 @@ EXPORT_TRACEPOINT_SYMBOL(dma_fence_emit);
 EXPORT_TRACEPOINT_SYMBOL(dma_fence_enable_signal);
 EXPORT_TRACEPOINT_SYMBOL(dma_fence_signaled);
 #elif defined(__FreeBSD__)
+#include <sys/param.h>
+#include <sys/kernel.h>
+#include <sys/sbuf.h>
+#include <sys/sdt.h>
+#include <sys/sysctl.h>
+
 #include <linux/lockdep.h>	/* For lockded_assert_hold (manu 20200511) */
-#define trace_dma_fence_init(x)
-#define trace_dma_fence_destroy(x)
-#define trace_dma_fence_enable_signal(x)
-#define trace_dma_fence_signaled(x)
-#define trace_dma_fence_wait_start(x)
-#define trace_dma_fence_wait_end(x)
+
+/*
+ * Stand-ins for the Linux dma_fence tracepoints: DTrace SDT probes plus
+ * optional per dma_fence_ops latency histograms, exported as
+ * compat.linuxkpi.dma_fence.hist once compat.linuxkpi.dma_fence.stats is
+ * set.  With both off, each hook costs a couple of predicted branches.
+ *
+ * Latencies are measured from dma_fence_init() to enable_signaling and
+ * to signaling, and around dma_fence_wait_timeout().  Fences initialized
+ * while tracing was off report no latency.
+ */
+SDT_PROVIDER_DEFINE(dma_fence);
+SDT_PROBE_DEFINE5(dma_fence, , , init, "struct dma_fence *",
+    "const char *", "const char *", "uint64_t", "uint64_t");
+SDT_PROBE_DEFINE2(dma_fence, , , enable_signal, "struct dma_fence *",
+    "int64_t");
+SDT_PROBE_DEFINE2(dma_fence, , , signaled, "struct dma_fence *",
+    "int64_t");
+SDT_PROBE_DEFINE2(dma_fence, , , wait_start, "struct dma_fence *",
+    "long");
+SDT_PROBE_DEFINE3(dma_fence, , , wait_end, "struct dma_fence *",
+    "long", "int64_t");
+SDT_PROBE_DEFINE1(dma_fence, , , destroy, "struct dma_fence *");
+
+enum dma_fence_stat {
+	DMA_FENCE_STAT_ENABLE,
+	DMA_FENCE_STAT_SIGNAL,
+	DMA_FENCE_STAT_WAIT,
+	DMA_FENCE_STAT_COUNT,
+};
+
+static const char *dma_fence_stat_names[DMA_FENCE_STAT_COUNT] = {
+	[DMA_FENCE_STAT_ENABLE] = "init-to-enable",
+	[DMA_FENCE_STAT_SIGNAL] = "init-to-signal",
+	[DMA_FENCE_STAT_WAIT] = "wait",
+};
+
+/* Bucket b counts latencies in [2^(b-1), 2^b) microseconds. */
+#define	DMA_FENCE_STAT_BUCKETS	24
+#define	DMA_FENCE_STAT_OPS	32
+
+struct dma_fence_stats {
+	const struct dma_fence_ops *ops;
+	char name[32];
+	atomic_t hist[DMA_FENCE_STAT_COUNT][DMA_FENCE_STAT_BUCKETS];
+};
+
+static struct dma_fence_stats dma_fence_stats[DMA_FENCE_STAT_OPS];
+static int dma_fence_stats_enabled;
+
+static inline bool
+dma_fence_tracing(void)
+{
+	return (__predict_false(dma_fence_stats_enabled != 0 ||
+	    SDT_PROBES_ENABLED()));
+}
+
+/*
+ * Find or claim the slot of fence->ops.  Slots are never released, so
+ * once the table is full further fence types go unaccounted.
+ */
+static struct dma_fence_stats *
+dma_fence_stats_get(struct dma_fence *fence)
+{
+	const struct dma_fence_ops *ops;
+	struct dma_fence_stats *st;
+	int i;
+
+	for (i = 0; i < DMA_FENCE_STAT_OPS; i++) {
+		st = &dma_fence_stats[i];
+		ops = READ_ONCE(st->ops);
+		if (ops == NULL) {
+			ops = cmpxchg(&st->ops, NULL, fence->ops);
+			if (ops == NULL) {
+				strlcpy(st->name,
+				    fence->ops->get_driver_name(fence),
+				    sizeof(st->name));
+				return (st);
+			}
+		}
+		if (ops == fence->ops)
+			return (st);
+	}
+	return (NULL);
+}
+
+static void
+dma_fence_stats_add(struct dma_fence *fence, enum dma_fence_stat type,
+    int64_t ns)
+{
+	struct dma_fence_stats *st;
+	int b;
+
+	if (dma_fence_stats_enabled == 0 || ns < 0)
+		return;
+	if ((st = dma_fence_stats_get(fence)) == NULL)
+		return;
+
+	b = fls64((uint64_t)ns >> 10);
+	if (b >= DMA_FENCE_STAT_BUCKETS)
+		b = DMA_FENCE_STAT_BUCKETS - 1;
+	atomic_inc(&st->hist[type][b]);
+}
+
+/* Nanoseconds since dma_fence_init(), or -1 if it was not recorded. */
+static inline int64_t
+dma_fence_age(struct dma_fence *fence, ktime_t now)
+{
+	if (ktime_to_ns(fence->init_time) == 0)
+		return (-1);
+	return (ktime_to_ns(ktime_sub(now, fence->init_time)));
+}
+
+static inline void
+trace_dma_fence_init(struct dma_fence *fence)
+{
+	fence->init_time = dma_fence_tracing() ? ktime_get() : ns_to_ktime(0);
+	SDT_PROBE5(dma_fence, , , init, fence,
+	    fence->ops->get_driver_name(fence),
+	    fence->ops->get_timeline_name(fence),
+	    fence->context, fence->seqno);
+}
+
+static inline void
+trace_dma_fence_destroy(struct dma_fence *fence)
+{
+	SDT_PROBE1(dma_fence, , , destroy, fence);
+}
+
+static inline void
+trace_dma_fence_enable_signal(struct dma_fence *fence)
+{
+	int64_t age;
+
+	if (!dma_fence_tracing())
+		return;
+	age = dma_fence_age(fence, ktime_get());
+	SDT_PROBE2(dma_fence, , , enable_signal, fence, age);
+	dma_fence_stats_add(fence, DMA_FENCE_STAT_ENABLE, age);
+}
+
+/* Called once fence->timestamp is set. */
+static inline void
+trace_dma_fence_signaled(struct dma_fence *fence)
+{
+	int64_t age;
+
+	if (!dma_fence_tracing())
+		return;
+	age = dma_fence_age(fence, fence->timestamp);
+	SDT_PROBE2(dma_fence, , , signaled, fence, age);
+	dma_fence_stats_add(fence, DMA_FENCE_STAT_SIGNAL, age);
+}
+
+static inline ktime_t
+dma_fence_trace_wait_start(struct dma_fence *fence, signed long timeout)
+{
+	if (!dma_fence_tracing())
+		return (ns_to_ktime(0));
+	SDT_PROBE2(dma_fence, , , wait_start, fence, timeout);
+	return (ktime_get());
+}
+
+static inline void
+dma_fence_trace_wait_end(struct dma_fence *fence, ktime_t start,
+    signed long ret)
+{
+	int64_t ns;
+
+	if (ktime_to_ns(start) == 0)
+		return;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	SDT_PROBE3(dma_fence, , , wait_end, fence, ret, ns);
+	dma_fence_stats_add(fence, DMA_FENCE_STAT_WAIT, ns);
+}
+
+static int
+dma_fence_stats_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	int error, i, j, k, val;
+
+	val = dma_fence_stats_enabled;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	/* Start from clean histograms whenever accounting is turned on. */
+	if (val != 0 && dma_fence_stats_enabled == 0) {
+		for (i = 0; i < DMA_FENCE_STAT_OPS; i++)
+			for (j = 0; j < DMA_FENCE_STAT_COUNT; j++)
+				for (k = 0; k < DMA_FENCE_STAT_BUCKETS; k++)
+					atomic_set(&dma_fence_stats[i].hist[j][k], 0);
+	}
+	dma_fence_stats_enabled = val != 0;
+	return (0);
+}
+
+static int
+dma_fence_hist_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct dma_fence_stats *st;
+	struct sbuf *sb;
+	int error, i, j, k;
+
+	error = sysctl_wire_old_buffer(req, 0);
+	if (error != 0)
+		return (error);
+	sb = sbuf_new_for_sysctl(NULL, NULL, 1024, req);
+
+	sbuf_printf(sb, "\n%-16s %-16s", "driver", "latency (us)");
+	for (k = 0; k < DMA_FENCE_STAT_BUCKETS; k++)
+		sbuf_printf(sb, " <%lu", 1UL << k);
+	for (i = 0; i < DMA_FENCE_STAT_OPS; i++) {
+		st = &dma_fence_stats[i];
+		if (READ_ONCE(st->ops) == NULL)
+			break;
+		for (j = 0; j < DMA_FENCE_STAT_COUNT; j++) {
+			sbuf_printf(sb, "\n%-16s %-16s", st->name,
+			    dma_fence_stat_names[j]);
+			for (k = 0; k < DMA_FENCE_STAT_BUCKETS; k++)
+				sbuf_printf(sb, " %u",
+				    atomic_read(&st->hist[j][k]));
+		}
+	}
+
+	error = sbuf_finish(sb);
+	sbuf_delete(sb);
+	return (error);
+}
+
+SYSCTL_DECL(_compat_linuxkpi);
+static SYSCTL_NODE(_compat_linuxkpi, OID_AUTO, dma_fence, CTLFLAG_RD, 0,
+    "dma_fence tracing");
+SYSCTL_PROC(_compat_linuxkpi_dma_fence, OID_AUTO, stats,
+    CTLTYPE_INT | CTLFLAG_RWTUN | CTLFLAG_MPSAFE, NULL, 0,
+    dma_fence_stats_sysctl, "I",
+    "Collect per dma_fence_ops latency histograms");
+SYSCTL_PROC(_compat_linuxkpi_dma_fence, OID_AUTO, hist,
+    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, 0,
+    dma_fence_hist_sysctl, "A",
+    "Per dma_fence_ops latency histograms");
 #endif
 
 static DEFINE_SPINLOCK(dma_fence_stub_lock);
@@ -231,16 +472,27 @@ signed long
 dma_fence_wait_timeout(struct dma_fence *fence, bool intr, signed long timeout)
 {
 	signed long ret;
+#ifdef __FreeBSD__
+	ktime_t start;
+#endif
 
 	if (WARN_ON(timeout < 0))
 		return -EINVAL;
 
+#ifdef __linux__
 	trace_dma_fence_wait_start(fence);
+#elif defined(__FreeBSD__)
+	start = dma_fence_trace_wait_start(fence, timeout);
+#endif
 	if (fence->ops->wait)
 		ret = fence->ops->wait(fence, intr, timeout);
 	else
 		ret = dma_fence_default_wait(fence, intr, timeout);
+#ifdef __linux__
 	trace_dma_fence_wait_end(fence);
+#elif defined(__FreeBSD__)
+	dma_fence_trace_wait_end(fence, start, ret);
+#endif
 	return ret;
 }
 EXPORT_SYMBOL(dma_fence_wait_timeout);
@@ -35,6 +35,8 @@
 #include <linux/reservation.h>
 #include <linux/export.h>
 #include <linux/lockdep.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 /**
  * DOC: Reservation Object Overview
@@ -56,6 +58,202 @@ EXPORT_SYMBOL(reservation_seqcount_class);
 const char reservation_seqcount_string[] = "reservation_seqcount";
 EXPORT_SYMBOL(reservation_seqcount_string);
 
+/* Shared fence lists smaller than this are just scanned */
+#define RESERVATION_INDEX_MIN	16
+
+/**
+ * struct reservation_object_index - shared fence slots by fence context
+ * @list: the shared fence list the index was built for
+ * @indexed: number of slots of @list covered by the index
+ * @bits: log2 of the number of hash buckets
+ * @slots: open addressed hash table of slot numbers + 1, 0 if empty
+ *
+ * Only used on the update side under obj->lock, readers never see it. The
+ * index is validated against the list on every use and rebuilt when the
+ * list was replaced or shrunk behind our back, so a stale index can only
+ * cost time, never correctness.
+ */
+struct reservation_object_index {
+	struct reservation_object_list *list;
+	u32 indexed;
+	unsigned int bits;
+	u32 slots[];
+};
+
+static void
+reservation_object_index_reserve(struct reservation_object *obj,
+				 unsigned int max)
+{
+	struct reservation_object_index *index;
+	unsigned int bits;
+
+	if (max < RESERVATION_INDEX_MIN)
+		return;
+
+	/* Keep the load factor at or below one half */
+	bits = ilog2(roundup_pow_of_two(max * 2));
+	if (obj->index && obj->index->bits >= bits)
+		return;
+
+	/* Not fatal, we fall back to scanning the list */
+	index = kmalloc(offsetof(typeof(*index), slots[1U << bits]),
+			GFP_KERNEL | __GFP_NOWARN);
+	if (!index)
+		return;
+
+	index->list = NULL;
+	index->indexed = 0;
+	index->bits = bits;
+	kfree(obj->index);
+	obj->index = index;
+}
+
+static void
+reservation_object_index_insert(struct reservation_object_index *index,
+				u64 context, u32 slot)
+{
+	u32 mask = (1U << index->bits) - 1;
+	u32 i;
+
+	for (i = hash_64(context, index->bits); index->slots[i];
+	     i = (i + 1) & mask)
+		;
+	index->slots[i] = slot + 1;
+}
+
+/* Bring the index up to date with @fobj, false if there is none to use */
+static bool
+reservation_object_index_sync(struct reservation_object *obj,
+			      struct reservation_object_list *fobj)
+{
+	struct reservation_object_index *index = obj->index;
+
+	if (!index || fobj->shared_max * 2 > (1U << index->bits))
+		return false;
+
+	if (index->list != fobj || fobj->shared_count < index->indexed) {
+		memset(index->slots, 0, sizeof(u32) << index->bits);
+		index->list = fobj;
+		index->indexed = 0;
+	}
+
+	for (; index->indexed < fobj->shared_count; ++index->indexed) {
+		struct dma_fence *fence;
+
+		fence = rcu_dereference_protected(fobj->shared[index->indexed],
+						  reservation_object_held(obj));
+		reservation_object_index_insert(index, fence->context,
+						index->indexed);
+	}
+	return true;
+}
+
+/**
+ * reservation_object_find_shared - find the shared slot of a fence context
+ * @obj: the reservation object
+ * @fobj: the current shared fence list
+ * @context: the fence context to look for
+ *
+ * Returns the slot or -1 if there is no fence of @context.
+ */
+static int
+reservation_object_find_shared(struct reservation_object *obj,
+			       struct reservation_object_list *fobj,
+			       u64 context)
+{
+	struct reservation_object_index *index = obj->index;
+	struct dma_fence *fence;
+	u32 i, mask, slot;
+
+	if (!reservation_object_index_sync(obj, fobj)) {
+		for (i = 0; i < fobj->shared_count; ++i) {
+			fence = rcu_dereference_protected(fobj->shared[i],
+						reservation_object_held(obj));
+			if (fence->context == context)
+				return i;
+		}
+		return -1;
+	}
+
+	mask = (1U << index->bits) - 1;
+	for (i = hash_64(context, index->bits); (slot = index->slots[i]);
+	     i = (i + 1) & mask) {
+		if (--slot >= fobj->shared_count)
+			continue;
+
+		fence = rcu_dereference_protected(fobj->shared[slot],
+						  reservation_object_held(obj));
+		if (fence->context == context)
+			return slot;
+	}
+	return -1;
+}
+
+/**
+ * reservation_object_compact_shared - drop signaled shared fences in place
+ * @obj: the reservation object
+ * @fobj: the current shared fence list
+ *
+ * Signaled fences are not replaced one by one when adding new fences any
+ * more, instead they are dropped in a batch once the list runs full. To keep
+ * that amortized constant time we only compact when it frees at least a
+ * quarter of the list, otherwise the caller grows the list which drops the
+ * signaled fences as well.
+ *
+ * Returns true if the list was compacted.
+ */
+static bool
+reservation_object_compact_shared(struct reservation_object *obj,
+				  struct reservation_object_list *fobj)
+{
+	unsigned int i, j, count = fobj->shared_count, signaled = 0;
+
+	for (i = 0; i < count; ++i) {
+		struct dma_fence *fence;
+
+		fence = rcu_dereference_protected(fobj->shared[i],
+						  reservation_object_held(obj));
+		if (dma_fence_is_signaled(fence))
+			++signaled;
+	}
+	if (signaled < fobj->shared_max / 4)
+		return false;
+
+	preempt_disable();
+	write_seqcount_begin(&obj->seq);
+	/*
+	 * Swap the unsignaled fences to the front, keeping their order. The
+	 * signaled ones end up behind shared_count where readers don't look.
+	 */
+	for (i = 0, j = 0; i < count; ++i) {
+		struct dma_fence *fence;
+
+		fence = rcu_dereference_protected(fobj->shared[i],
+						  reservation_object_held(obj));
+		if (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags))
+			continue;
+
+		if (i != j) {
+			RCU_INIT_POINTER(fobj->shared[i],
+				rcu_dereference_protected(fobj->shared[j],
+						reservation_object_held(obj)));
+			RCU_INIT_POINTER(fobj->shared[j], fence);
+		}
+		++j;
+	}
+	fobj->shared_count = j;
+	write_seqcount_end(&obj->seq);
+	preempt_enable();
+
+	for (i = j; i < count; ++i)
+		dma_fence_put(rcu_dereference_protected(fobj->shared[i],
+						reservation_object_held(obj)));
+
+	if (obj->index)
+		obj->index->list = NULL;
+	return true;
+}
+
 /**
  * reservation_object_reserve_shared - Reserve space to add a shared
  * fence to a reservation_object.
@@ -77,10 +275,12 @@ int reservation_object_reserve_shared(struct reservation_object *obj,
 
 	if (old && old->shared_max) {
 		if ((old->shared_count + num_fences) <= old->shared_max)
-			return 0;
-		else
-			max = max(old->shared_count + num_fences,
-				  old->shared_max * 2);
+			goto out;
+		if (reservation_object_compact_shared(obj, old) &&
+		    (old->shared_count + num_fences) <= old->shared_max)
+			goto out;
+		max = max(old->shared_count + num_fences,
+			  old->shared_max * 2);
 	} else {
 		max = 4;
 	}
@@ -118,19 +318,23 @@ int reservation_object_reserve_shared(struct reservation_object *obj,
 	write_seqcount_end(&obj->seq);
 	preempt_enable();
 
-	if (!old)
-		return 0;
-
-	/* Drop the references to the signaled fences */
-	for (i = k; i < new->shared_max; ++i) {
-		struct dma_fence *fence;
+	if (old) {
+		/* Drop the references to the signaled fences */
+		for (i = k; i < new->shared_max; ++i) {
+			struct dma_fence *fence;
 
-		fence = rcu_dereference_protected(new->shared[i],
-						  reservation_object_held(obj));
-		dma_fence_put(fence);
+			fence = rcu_dereference_protected(new->shared[i],
+						reservation_object_held(obj));
+			dma_fence_put(fence);
+		}
+		kfree_rcu(old, rcu);
 	}
-	kfree_rcu(old, rcu);
+	if (obj->index)
+		obj->index->list = NULL;
+	old = new;
 
+out:
+	reservation_object_index_reserve(obj, old->shared_max);
 	return 0;
 }
 EXPORT_SYMBOL(reservation_object_reserve_shared);
@@ -140,43 +344,26 @@ reservation_object_add_shared_inplace(struct reservation_object *obj,
 				      struct reservation_object_list *fobj,
 				      struct dma_fence *fence)
 {
-	struct dma_fence *signaled = NULL;
-	u32 i, signaled_idx;
+	struct dma_fence *old_fence = NULL;
+	int i;
 
 	dma_fence_get(fence);
 
+	i = reservation_object_find_shared(obj, fobj, fence->context);
+
 	preempt_disable();
 	write_seqcount_begin(&obj->seq);
 
-	for (i = 0; i < fobj->shared_count; ++i) {
-		struct dma_fence *old_fence;
-
-		old_fence = rcu_dereference_protected(fobj->shared[i],
-						reservation_object_held(obj));
-
-		if (old_fence->context == fence->context) {
-			/* memory barrier is added by write_seqcount_begin */
-			RCU_INIT_POINTER(fobj->shared[i], fence);
-			write_seqcount_end(&obj->seq);
-			preempt_enable();
-
-			dma_fence_put(old_fence);
-			return;
-		}
-
-		if (!signaled && dma_fence_is_signaled(old_fence)) {
-			signaled = old_fence;
-			signaled_idx = i;
-		}
-	}
-
 	/*
 	 * memory barrier is added by write_seqcount_begin,
 	 * fobj->shared_count is protected by this lock too
 	 */
-	if (signaled) {
-		RCU_INIT_POINTER(fobj->shared[signaled_idx], fence);
+	if (i >= 0) {
+		old_fence = rcu_dereference_protected(fobj->shared[i],
+						reservation_object_held(obj));
+		RCU_INIT_POINTER(fobj->shared[i], fence);
 	} else {
+		/* signaled fences are dropped by reserve_shared() in batches */
 		BUG_ON(fobj->shared_count >= fobj->shared_max);
 		RCU_INIT_POINTER(fobj->shared[fobj->shared_count], fence);
 		fobj->shared_count++;
@@ -185,7 +372,7 @@ reservation_object_add_shared_inplace(struct reservation_object *obj,
 	write_seqcount_end(&obj->seq);
 	preempt_enable();
 
-	dma_fence_put(signaled);
+	dma_fence_put(old_fence);
 }
 
 static void
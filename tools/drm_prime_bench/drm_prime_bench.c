@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Time PRIME export/import/close cycles against the number of live handles.
+ *
+ * For each live count the benchmark first creates that many amdgpu BOs and
+ * exports each of them once, so that both per-file PRIME caches hold an
+ * entry per buffer; the fds are closed again, the cache entries live as
+ * long as the handles. It then runs cycles of
+ *
+ *	GEM_CREATE -> PRIME_HANDLE_TO_FD -> PRIME_FD_TO_HANDLE -> close ->
+ *	GEM_CLOSE
+ *
+ * on a fresh BO. Importing an fd exported from the same file is answered
+ * from the cache, so every cycle inserts, looks up by dma-buf, looks up by
+ * handle and removes one entry with all the other entries present. The
+ * results are printed as one JSON object per live count.
+ *
+ * usage: drm_prime_bench [-d device] [-n cycles] [live ...]
+ */
+#include <sys/ioctl.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* the uapi headers of this tree are used unsanitized */
+#ifndef __user
+#define	__user
+#endif
+#include <drm/drm.h>
+#include <drm/amdgpu_drm.h>
+
+#define	BENCH_BO_SIZE	4096
+
+static const unsigned default_live[] = { 16, 256, 4096 };
+
+static int
+bench_ioctl(int fd, unsigned long request, void *arg)
+{
+	int r;
+
+	do {
+		r = ioctl(fd, request, arg);
+	} while (r == -1 && (errno == EINTR || errno == EAGAIN));
+	return (r);
+}
+
+static uint64_t
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static uint32_t
+bench_create(int fd)
+{
+	union drm_amdgpu_gem_create args;
+
+	memset(&args, 0, sizeof(args));
+	args.in.bo_size = BENCH_BO_SIZE;
+	args.in.alignment = BENCH_BO_SIZE;
+	args.in.domains = AMDGPU_GEM_DOMAIN_GTT;
+	if (bench_ioctl(fd, DRM_IOCTL_AMDGPU_GEM_CREATE, &args) != 0)
+		err(1, "DRM_IOCTL_AMDGPU_GEM_CREATE");
+	return (args.out.handle);
+}
+
+static int
+bench_export(int fd, uint32_t handle)
+{
+	struct drm_prime_handle args;
+
+	memset(&args, 0, sizeof(args));
+	args.handle = handle;
+	args.flags = DRM_CLOEXEC | DRM_RDWR;
+	if (bench_ioctl(fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &args) != 0)
+		err(1, "DRM_IOCTL_PRIME_HANDLE_TO_FD");
+	return (args.fd);
+}
+
+static uint32_t
+bench_import(int fd, int prime_fd)
+{
+	struct drm_prime_handle args;
+
+	memset(&args, 0, sizeof(args));
+	args.fd = prime_fd;
+	if (bench_ioctl(fd, DRM_IOCTL_PRIME_FD_TO_HANDLE, &args) != 0)
+		err(1, "DRM_IOCTL_PRIME_FD_TO_HANDLE");
+	return (args.handle);
+}
+
+static void
+bench_close(int fd, uint32_t handle)
+{
+	struct drm_gem_close args;
+
+	memset(&args, 0, sizeof(args));
+	args.handle = handle;
+	if (bench_ioctl(fd, DRM_IOCTL_GEM_CLOSE, &args) != 0)
+		err(1, "DRM_IOCTL_GEM_CLOSE");
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+static void
+bench_run(int fd, unsigned live, unsigned cycles, int last)
+{
+	uint64_t export_ns = 0, import_ns = 0, close_ns = 0;
+	uint64_t *samples, t0, t1, t2, t3;
+	uint32_t *handles, handle;
+	unsigned i;
+	int prime_fd;
+
+	handles = calloc(live, sizeof(*handles));
+	samples = calloc(cycles, sizeof(*samples));
+	if (handles == NULL || samples == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < live; i++) {
+		handles[i] = bench_create(fd);
+		close(bench_export(fd, handles[i]));
+	}
+
+	for (i = 0; i < cycles; i++) {
+		handle = bench_create(fd);
+
+		t0 = bench_now();
+		prime_fd = bench_export(fd, handle);
+		t1 = bench_now();
+		if (bench_import(fd, prime_fd) != handle)
+			errx(1, "import of an exported buffer returned a "
+			    "new handle");
+		t2 = bench_now();
+		close(prime_fd);
+		bench_close(fd, handle);
+		t3 = bench_now();
+
+		export_ns += t1 - t0;
+		import_ns += t2 - t1;
+		close_ns += t3 - t2;
+		samples[i] = t3 - t0;
+	}
+
+	for (i = 0; i < live; i++)
+		bench_close(fd, handles[i]);
+
+	qsort(samples, cycles, sizeof(*samples), cmp_u64);
+	printf("  {\"live\": %u, \"cycles\": %u, \"export_ns\": %" PRIu64
+	    ", \"import_ns\": %" PRIu64 ", \"close_ns\": %" PRIu64
+	    ", \"cycle_ns\": {\"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+	    ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}}%s\n",
+	    live, cycles, export_ns / cycles, import_ns / cycles,
+	    close_ns / cycles, samples[cycles * 50 / 100],
+	    samples[cycles * 90 / 100], samples[cycles * 99 / 100],
+	    samples[cycles - 1], last ? "" : ",");
+
+	free(samples);
+	free(handles);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr,
+	    "usage: drm_prime_bench [-d device] [-n cycles] [live ...]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *device = "/dev/dri/renderD128";
+	unsigned cycles = 10000, live;
+	int ch, fd, i, n;
+
+	while ((ch = getopt(argc, argv, "d:n:")) != -1) {
+		switch (ch) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			cycles = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (cycles == 0)
+		usage();
+
+	fd = open(device, O_RDWR | O_CLOEXEC);
+	if (fd == -1)
+		err(1, "%s", device);
+
+	n = argc > 0 ? argc :
+	    (int)(sizeof(default_live) / sizeof(default_live[0]));
+	printf("[\n");
+	for (i = 0; i < n; i++) {
+		live = argc > 0 ? strtoul(argv[i], NULL, 0) : default_live[i];
+		bench_run(fd, live, cycles, i == n - 1);
+	}
+	printf("]\n");
+
+	close(fd);
+	return (0);
+}
@@ -0,0 +1,388 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Replay BO validation traces against the TTM eviction policies.
+ *
+ * The simulator models a single memory type of a given capacity holding
+ * one LRU list and replays every validation of a trace with each of the
+ * lru, size and clock policies of ttm_bo.c, reporting the bytes that had
+ * to be moved in and evicted as one JSON object per policy. Placement is
+ * only accounted in pages, fragmentation of the range manager and BOs
+ * which can't be evicted are not modelled.
+ *
+ * Two trace formats are understood and can be mixed:
+ *
+ *  - amdgpu_cs_bo_validate events, as printed by ftrace on Linux or by
+ *    ktrdump(8) with KTR_DRM enabled on FreeBSD. Only validations
+ *    allowing VRAM are replayed, the BO pointer identifies the BO.
+ *
+ *  - "v <id> <pages>" lines, one validation of BO <id> each, which is
+ *    what -g prints for a synthetic workload.
+ *
+ * usage: ttm_evict_sim [-c capacity MiB] [trace]
+ *        ttm_evict_sim -g events [-b big MiB]
+ */
+#include <sys/queue.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	PAGE_SZ			4096ULL
+#define	AMDGPU_GEM_DOMAIN_VRAM	0x4
+
+/* keep in sync with ttm_bo.c */
+#define	TTM_EVICT_POLICY_WINDOW	16
+#define	TTM_EVICT_CLOCK_MAX_REF	3
+
+#define	SIM_HASH_BUCKETS	4096
+
+struct sim_event {
+	uint64_t	id;
+	unsigned long	pages;
+};
+
+struct sim_bo {
+	uint64_t		id;
+	unsigned long		pages;
+	unsigned		evict_ref;
+	bool			resident;
+	TAILQ_ENTRY(sim_bo)	lru;
+	struct sim_bo		*hnext;
+};
+
+TAILQ_HEAD(sim_lru, sim_bo);
+
+struct sim {
+	unsigned long	capacity;
+	unsigned long	used;
+	struct sim_lru	lru;
+	struct sim_bo	*hash[SIM_HASH_BUCKETS];
+
+	uint64_t	validates;
+	uint64_t	hits;
+	uint64_t	evictions;
+	uint64_t	too_big;
+	uint64_t	bytes_in;
+	uint64_t	bytes_evicted;
+};
+
+struct sim_policy {
+	const char	*name;
+	unsigned (*select)(struct sim *sim, unsigned long num_pages,
+	    struct sim_bo **cand, unsigned max);
+};
+
+static unsigned
+sim_lru_select(struct sim *sim, unsigned long num_pages,
+    struct sim_bo **cand, unsigned max)
+{
+	struct sim_bo *bo = TAILQ_FIRST(&sim->lru);
+
+	if (bo == NULL || max == 0)
+		return (0);
+	cand[0] = bo;
+	return (1);
+}
+
+static bool
+sim_size_before(struct sim_bo *a, struct sim_bo *b, unsigned long num_pages)
+{
+	bool a_fits = a->pages >= num_pages;
+	bool b_fits = b->pages >= num_pages;
+
+	if (a_fits != b_fits)
+		return (a_fits);
+	return (a_fits && a->pages < b->pages);
+}
+
+static unsigned
+sim_size_select(struct sim *sim, unsigned long num_pages,
+    struct sim_bo **cand, unsigned max)
+{
+	struct sim_bo *bo;
+	unsigned n = 0, i;
+
+	TAILQ_FOREACH(bo, &sim->lru, lru) {
+		if (n == max)
+			break;
+		for (i = n; i > 0 && sim_size_before(bo, cand[i - 1],
+		    num_pages); --i)
+			cand[i] = cand[i - 1];
+		cand[i] = bo;
+		++n;
+	}
+	return (n);
+}
+
+static unsigned
+sim_clock_select(struct sim *sim, unsigned long num_pages,
+    struct sim_bo **cand, unsigned max)
+{
+	struct sim_bo *bo, *tmp;
+	unsigned n = 0, scanned = 0;
+
+	for (bo = TAILQ_FIRST(&sim->lru); bo != NULL; bo = tmp) {
+		tmp = TAILQ_NEXT(bo, lru);
+		if (n == max || scanned++ == 4 * max)
+			break;
+		if (bo->evict_ref) {
+			bo->evict_ref--;
+			TAILQ_REMOVE(&sim->lru, bo, lru);
+			TAILQ_INSERT_TAIL(&sim->lru, bo, lru);
+			continue;
+		}
+		cand[n++] = bo;
+	}
+	/* everything was referenced, the kernel falls back to the LRU */
+	if (n == 0 && !TAILQ_EMPTY(&sim->lru))
+		cand[n++] = TAILQ_FIRST(&sim->lru);
+	return (n);
+}
+
+static const struct sim_policy sim_policies[] = {
+	{ "lru", sim_lru_select },
+	{ "size", sim_size_select },
+	{ "clock", sim_clock_select },
+};
+
+static struct sim_bo *
+sim_lookup(struct sim *sim, const struct sim_event *ev)
+{
+	unsigned h = (unsigned)((ev->id * 0x9e3779b97f4a7c15ULL) >> 52) %
+	    SIM_HASH_BUCKETS;
+	struct sim_bo *bo;
+
+	for (bo = sim->hash[h]; bo != NULL; bo = bo->hnext)
+		if (bo->id == ev->id)
+			return (bo);
+
+	bo = calloc(1, sizeof(*bo));
+	if (bo == NULL)
+		err(1, "calloc");
+	bo->id = ev->id;
+	bo->pages = ev->pages;
+	bo->hnext = sim->hash[h];
+	sim->hash[h] = bo;
+	return (bo);
+}
+
+static void
+sim_evict(struct sim *sim, struct sim_bo *bo)
+{
+	TAILQ_REMOVE(&sim->lru, bo, lru);
+	bo->resident = false;
+	sim->used -= bo->pages;
+	sim->evictions++;
+	sim->bytes_evicted += bo->pages * PAGE_SZ;
+}
+
+static void
+sim_validate(struct sim *sim, const struct sim_policy *policy,
+    const struct sim_event *ev)
+{
+	struct sim_bo *cand[TTM_EVICT_POLICY_WINDOW];
+	struct sim_bo *bo = sim_lookup(sim, ev);
+	unsigned n;
+
+	sim->validates++;
+	if (bo->resident) {
+		sim->hits++;
+		TAILQ_REMOVE(&sim->lru, bo, lru);
+	} else {
+		/* a BO can be recreated with a new size at the same address */
+		bo->pages = ev->pages;
+		if (bo->pages > sim->capacity) {
+			sim->too_big++;
+			return;
+		}
+		while (sim->capacity - sim->used < bo->pages) {
+			n = policy->select(sim, bo->pages, cand,
+			    TTM_EVICT_POLICY_WINDOW);
+			if (n == 0)
+				errx(1, "nothing to evict");
+			/* every BO is evictable, so the first candidate wins */
+			sim_evict(sim, cand[0]);
+		}
+		bo->resident = true;
+		sim->used += bo->pages;
+		sim->bytes_in += bo->pages * PAGE_SZ;
+	}
+
+	/* ttm_bo_move_to_lru_tail() */
+	TAILQ_INSERT_TAIL(&sim->lru, bo, lru);
+	if (bo->evict_ref < TTM_EVICT_CLOCK_MAX_REF)
+		bo->evict_ref++;
+}
+
+static void
+sim_run(const struct sim_policy *policy, const struct sim_event *events,
+    size_t nevents, unsigned long capacity)
+{
+	struct sim sim;
+	struct sim_bo *bo, *next;
+	size_t i;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.capacity = capacity;
+	TAILQ_INIT(&sim.lru);
+
+	for (i = 0; i < nevents; i++)
+		sim_validate(&sim, policy, &events[i]);
+
+	printf("  {\"policy\": \"%s\", \"capacity_pages\": %lu, "
+	    "\"validates\": %" PRIu64 ", \"hits\": %" PRIu64 ", "
+	    "\"too_big\": %" PRIu64 ", \"evictions\": %" PRIu64 ", "
+	    "\"bytes_in\": %" PRIu64 ", \"bytes_evicted\": %" PRIu64 ", "
+	    "\"bytes_moved\": %" PRIu64 "}",
+	    policy->name, capacity, sim.validates, sim.hits, sim.too_big,
+	    sim.evictions, sim.bytes_in, sim.bytes_evicted,
+	    sim.bytes_in + sim.bytes_evicted);
+
+	for (i = 0; i < SIM_HASH_BUCKETS; i++) {
+		for (bo = sim.hash[i]; bo != NULL; bo = next) {
+			next = bo->hnext;
+			free(bo);
+		}
+	}
+}
+
+static bool
+parse_field(const char *line, const char *key, int base, uint64_t *val)
+{
+	const char *p = strstr(line, key);
+	char *end;
+
+	if (p == NULL)
+		return (false);
+	p += strlen(key);
+	*val = strtoull(p, &end, base);
+	return (end != p);
+}
+
+static bool
+parse_line(const char *line, struct sim_event *ev)
+{
+	uint64_t id, pages, domain;
+
+	if (strstr(line, "amdgpu_cs_bo_validate") != NULL) {
+		if (!parse_field(line, "bo=", 16, &id) ||
+		    !parse_field(line, "pages=", 10, &pages) ||
+		    !parse_field(line, "domain=", 16, &domain))
+			return (false);
+		if (!(domain & AMDGPU_GEM_DOMAIN_VRAM))
+			return (false);
+	} else if (sscanf(line, "v %" SCNu64 " %" SCNu64, &id, &pages) != 2)
+		return (false);
+
+	if (pages == 0)
+		return (false);
+	ev->id = id;
+	ev->pages = pages;
+	return (true);
+}
+
+static struct sim_event *
+read_trace(FILE *f, size_t *nevents)
+{
+	struct sim_event *events = NULL, ev;
+	size_t n = 0, size = 0;
+	char line[1024];
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (!parse_line(line, &ev))
+			continue;
+		if (n == size) {
+			size = size ? size * 2 : 4096;
+			events = realloc(events, size * sizeof(*events));
+			if (events == NULL)
+				err(1, "realloc");
+		}
+		events[n++] = ev;
+	}
+	*nevents = n;
+	return (events);
+}
+
+/*
+ * A frame loop over a working set of small BOs, with one big BO that is
+ * only used every few frames and streaming BOs used once.
+ */
+static void
+generate(unsigned long nevents, unsigned long big_pages)
+{
+	unsigned long i;
+	uint64_t stream = 1000000;
+
+	srandom(1);
+	for (i = 0; i < nevents; i++) {
+		if (i % 200 == 0)
+			printf("v 1 %lu\n", big_pages);
+		else if (random() % 8 == 0)
+			printf("v %" PRIu64 " %ld\n", stream++,
+			    1 + random() % 256);
+		else
+			printf("v %ld %ld\n", 2 + random() % 256,
+			    16 + (random() % 4) * 16);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long capacity = 64, generate_events = 0, big = 16;
+	struct sim_event *events;
+	size_t nevents, i;
+	FILE *f = stdin;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "b:c:g:")) != -1) {
+		switch (ch) {
+		case 'b':
+			big = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			capacity = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			generate_events = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: ttm_evict_sim "
+			    "[-c capacity MiB] [trace]\n"
+			    "       ttm_evict_sim -g events [-b big MiB]\n");
+			return (1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (generate_events) {
+		generate(generate_events, (big << 20) / PAGE_SZ);
+		return (0);
+	}
+
+	if (argc > 0 && (f = fopen(argv[0], "r")) == NULL)
+		err(1, "%s", argv[0]);
+	events = read_trace(f, &nevents);
+	if (f != stdin)
+		fclose(f);
+	if (nevents == 0)
+		errx(1, "no validations found in the trace");
+
+	capacity = (capacity << 20) / PAGE_SZ;
+	printf("[\n");
+	for (i = 0; i < sizeof(sim_policies) / sizeof(sim_policies[0]); i++) {
+		sim_run(&sim_policies[i], events, nevents, capacity);
+		printf("%s\n", i + 1 < sizeof(sim_policies) /
+		    sizeof(sim_policies[0]) ? "," : "");
+	}
+	printf("]\n");
+
+	free(events);
+	return (0);
+}
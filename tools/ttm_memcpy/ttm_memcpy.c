@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Userspace harness for the streaming copy loop of ttm_bo_move_memcpy().
+ *
+ * Every thread copies its own set of page sized, 64 byte aligned buffers
+ * with memcpy() and with ttm_memcpy_stream_loop(), checks that both give
+ * the same result and prints the throughput of each as JSON.
+ *
+ * usage: ttm_memcpy [-t threads] [-s MiB per thread] [-r rounds]
+ */
+#include <err.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ttm_memcpy_stream.h"
+
+#define	PAGE_SZ		4096
+
+struct worker {
+	pthread_t	thread;
+	size_t		size;
+	unsigned	rounds;
+	bool		stream;
+	char		*src;
+	char		*dst;
+	bool		mismatch;
+};
+
+static pthread_barrier_t start_barrier;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	unsigned r;
+	size_t off;
+
+	pthread_barrier_wait(&start_barrier);
+	for (r = 0; r < w->rounds; r++) {
+		for (off = 0; off < w->size; off += PAGE_SZ) {
+			if (w->stream)
+				ttm_memcpy_stream_loop(w->dst + off,
+				    w->src + off, PAGE_SZ);
+			else
+				memcpy(w->dst + off, w->src + off, PAGE_SZ);
+		}
+	}
+	w->mismatch = memcmp(w->dst, w->src, w->size) != 0;
+	return (NULL);
+}
+
+static double
+run(struct worker *workers, unsigned nthreads, bool stream)
+{
+	uint64_t start, total = 0;
+	unsigned i;
+
+	if (pthread_barrier_init(&start_barrier, NULL, nthreads + 1) != 0)
+		err(1, "pthread_barrier_init");
+	for (i = 0; i < nthreads; i++) {
+		workers[i].stream = stream;
+		memset(workers[i].dst, 0, workers[i].size);
+		if (pthread_create(&workers[i].thread, NULL, worker_run,
+		    &workers[i]) != 0)
+			err(1, "pthread_create");
+		total += workers[i].size * workers[i].rounds;
+	}
+	start = now_ns();
+	pthread_barrier_wait(&start_barrier);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].mismatch)
+			errx(1, "%s copy of thread %u differs from the source",
+			    stream ? "streaming" : "memcpy", i);
+	}
+	pthread_barrier_destroy(&start_barrier);
+
+	return ((double)total / (now_ns() - start));
+}
+
+int
+main(int argc, char **argv)
+{
+	struct worker *workers;
+	unsigned nthreads = 1, rounds = 16, i;
+	size_t size = 64, j;
+	double plain, stream;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "t:s:r:")) != -1) {
+		switch (ch) {
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: ttm_memcpy [-t threads] "
+			    "[-s MiB per thread] [-r rounds]\n");
+			return (1);
+		}
+	}
+	if (nthreads == 0 || size == 0 || rounds == 0)
+		errx(1, "threads, size and rounds must be non-zero");
+	if (!__builtin_cpu_supports("sse4.1"))
+		errx(1, "SSE4.1 is required for the streaming copy");
+
+	size <<= 20;
+	workers = calloc(nthreads, sizeof(*workers));
+	if (workers == NULL)
+		err(1, "calloc");
+	for (i = 0; i < nthreads; i++) {
+		workers[i].size = size;
+		workers[i].rounds = rounds;
+		if (posix_memalign((void **)&workers[i].src, PAGE_SZ,
+		    size) != 0 ||
+		    posix_memalign((void **)&workers[i].dst, PAGE_SZ,
+		    size) != 0)
+			err(1, "posix_memalign");
+		for (j = 0; j < size; j++)
+			workers[i].src[j] = (char)(j * 31 + i);
+	}
+
+	plain = run(workers, nthreads, false);
+	stream = run(workers, nthreads, true);
+	printf("{\"threads\": %u, \"bytes_per_thread\": %zu, "
+	    "\"rounds\": %u, \"memcpy_gbps\": %.2f, "
+	    "\"stream_gbps\": %.2f}\n",
+	    nthreads, size, rounds, plain, stream);
+
+	for (i = 0; i < nthreads; i++) {
+		free(workers[i].src);
+		free(workers[i].dst);
+	}
+	free(workers);
+	return (0);
+}